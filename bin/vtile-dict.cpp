@@ -0,0 +1,95 @@
+#include <mapnik/util/file_io.hpp>
+#include "vector_tile_compression.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        if (argc < 3)
+        {
+            std::clog << "usage: vtile-dict /path/to/dictionary /path/to/tile.vector.mvt [/path/to/tile.vector.mvt ...] [--max-size bytes] [--level level]" << std::endl;
+            return -1;
+        }
+        std::string dictionary_path(argv[1]);
+        std::size_t max_size = 112640;
+        int level = ZSTD_CLEVEL_DEFAULT;
+        std::vector<std::string> samples;
+        std::size_t total_size = 0;
+        for (int i = 2; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--max-size" && i + 1 < argc)
+            {
+                max_size = std::stoul(argv[++i]);
+                continue;
+            }
+            if (arg == "--level" && i + 1 < argc)
+            {
+                level = std::stoi(argv[++i]);
+                continue;
+            }
+            mapnik::util::file input(arg);
+            if (!input.is_open())
+            {
+                std::clog << std::string("failed to open ") + arg << "\n";
+                return -1;
+            }
+            // The dictionary is trained on the tiles as they are encoded
+            std::string message(input.data().get(), input.size());
+            std::string uncompressed;
+            if (mapnik::vector_tile_impl::decompress(message.data(), message.size(), uncompressed))
+            {
+                message.swap(uncompressed);
+            }
+            total_size += message.size();
+            samples.push_back(std::move(message));
+        }
+
+        std::string dictionary;
+        mapnik::vector_tile_impl::zstd_train_dictionary(samples, dictionary, max_size);
+        mapnik::vector_tile_impl::zstd_dictionary dict(dictionary, level);
+
+        // Compare the size of the samples compressed with and without it
+        std::size_t plain_size = 0;
+        std::size_t dict_size = 0;
+        std::string compressed;
+        for (auto const& sample : samples)
+        {
+            mapnik::vector_tile_impl::zstd_compress(sample.data(), sample.size(), compressed, level);
+            plain_size += compressed.size();
+            mapnik::vector_tile_impl::zstd_compress(sample.data(), sample.size(), compressed, dict);
+            dict_size += compressed.size();
+        }
+
+        std::ofstream file(dictionary_path, std::ios::out | std::ios::binary);
+        if (!file)
+        {
+            std::clog << std::string("failed to open ") + dictionary_path << "\n";
+            return -1;
+        }
+        file << dictionary;
+        file.close();
+        if (!file)
+        {
+            std::clog << std::string("failed to write ") + dictionary_path << "\n";
+            return -1;
+        }
+
+        std::clog << "samples: " << samples.size() << " (" << total_size << " bytes)" << std::endl;
+        std::clog << "dictionary: " << dictionary.size() << " bytes, id " << dict.id() << std::endl;
+        std::clog << "zstd level " << level << ": " << plain_size << " bytes" << std::endl;
+        std::clog << "zstd level " << level << " with dictionary: " << dict_size << " bytes" << std::endl;
+        std::clog << "wrote to: " << dictionary_path << std::endl;
+    }
+    catch (std::exception const& ex)
+    {
+        std::clog << "error: " << ex.what() << "\n";
+        return -1;
+    }
+    return 0;
+}
@@ -5,6 +5,8 @@
   'variables': {
     'MAPNIK_PLUGINDIR%': '',
     'enable_sse%':'true',
+    'enable_libdeflate%':'false',
+    'enable_zstd%':'false',
     'common_defines' : [
         'MAPNIK_VECTOR_TILE_LIBRARY=1'
     ]
@@ -90,6 +92,20 @@
       'conditions': [
         ['enable_sse == "true"', {
           'defines' : [ 'SSE_MATH' ]
+        }],
+        ['enable_libdeflate == "true"', {
+          'defines' : [ 'MAPNIK_VECTOR_TILE_LIBDEFLATE' ],
+          'direct_dependent_settings': {
+            'defines' : [ 'MAPNIK_VECTOR_TILE_LIBDEFLATE' ],
+            'libraries':[ '-ldeflate' ]
+          }
+        }],
+        ['enable_zstd == "true"', {
+          'defines' : [ 'MAPNIK_VECTOR_TILE_ZSTD' ],
+          'direct_dependent_settings': {
+            'defines' : [ 'MAPNIK_VECTOR_TILE_ZSTD' ],
+            'libraries':[ '-lzstd' ]
+          }
         }]
       ],
       'cflags_cc' : [
@@ -260,5 +276,30 @@
       }
     }    
 
+  ],
+  'conditions': [
+    ['enable_zstd == "true"', {
+      'targets': [
+        {
+          "target_name": "vtile-dict",
+          'dependencies': [ 'mapnik_vector_tile_impl' ],
+          "type": "executable",
+          "defines": [
+            "<@(common_defines)"
+          ],
+          'conditions': [
+            ['enable_sse == "true"', {
+              'defines' : [ 'SSE_MATH' ]
+            }]
+          ],
+          "sources": [
+            "../bin/vtile-dict.cpp"
+          ],
+          "include_dirs": [
+            "../src",
+          ]
+        }
+      ]
+    }]
   ]
 }
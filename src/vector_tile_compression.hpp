@@ -6,8 +6,16 @@
 // zlib
 #include <zlib.h>
 
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+// zstd
+#include <zstd.h>
+#endif
+
 // std
+#include <cstdint>
+#include <limits>
 #include <string>
+#include <vector>
 
 namespace mapnik 
 {
@@ -49,6 +57,49 @@ inline bool is_gzip_compressed(std::string const& data)
     return data.size() > 2 && static_cast<uint8_t>(data[0]) == 0x1F && static_cast<uint8_t>(data[1]) == 0x8B;
 }
 
+inline bool is_zstd_compressed(const char * data, std::size_t size)
+{
+    return size > 4 &&
+           static_cast<uint8_t>(data[0]) == 0x28 &&
+           static_cast<uint8_t>(data[1]) == 0xB5 &&
+           static_cast<uint8_t>(data[2]) == 0x2F &&
+           static_cast<uint8_t>(data[3]) == 0xFD;
+}
+
+inline bool is_zstd_compressed(std::string const& data)
+{
+    return is_zstd_compressed(data.data(), data.size());
+}
+
+enum compression_type : std::uint8_t
+{
+    no_compression = 0,
+    zlib_compression,
+    gzip_compression,
+    zstd_compression
+};
+
+inline compression_type get_compression_type(const char * data, std::size_t size)
+{
+    if (is_gzip_compressed(data, size))
+    {
+        return gzip_compression;
+    }
+    if (is_zlib_compressed(data, size))
+    {
+        return zlib_compression;
+    }
+    if (is_zstd_compressed(data, size))
+    {
+        return zstd_compression;
+    }
+    return no_compression;
+}
+
+// Asks compress for the default level of the codec, as zstd gives a meaning
+// to every other level including the negative ones.
+constexpr int default_compression_level = std::numeric_limits<int>::min();
+
 // decodes both zlib and gzip
 // http://stackoverflow.com/a/1838702/2333354
 MAPNIK_VECTOR_INLINE void zlib_decompress(std::string const& input, 
@@ -71,6 +122,91 @@ MAPNIK_VECTOR_INLINE void zlib_compress(const char * data,
                                         int level=Z_DEFAULT_COMPRESSION, 
                                         int strategy=Z_DEFAULT_STRATEGY);
 
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+
+MAPNIK_VECTOR_INLINE void zstd_decompress(const char * data,
+                                          std::size_t size,
+                                          std::string & output);
+
+MAPNIK_VECTOR_INLINE void zstd_compress(const char * data,
+                                        std::size_t size,
+                                        std::string & output,
+                                        int level=ZSTD_CLEVEL_DEFAULT);
+
+// Small tiles of a tileset share their layer names, keys and common values but
+// compress poorly one by one. A dictionary trained on a sample of the tileset
+// primes the codec with them, tiles compressed with it can only be decoded
+// with the same dictionary.
+class zstd_dictionary
+{
+    std::string data_;
+    ZSTD_CDict * cdict_;
+    ZSTD_DDict * ddict_;
+
+public:
+    // Digests the dictionary once for the compression level and for decoding
+    MAPNIK_VECTOR_INLINE explicit zstd_dictionary(std::string const& data,
+                                                  int level=ZSTD_CLEVEL_DEFAULT);
+    MAPNIK_VECTOR_INLINE ~zstd_dictionary();
+
+    zstd_dictionary(zstd_dictionary const&) = delete;
+    zstd_dictionary & operator=(zstd_dictionary const&) = delete;
+
+    std::string const& data() const
+    {
+        return data_;
+    }
+
+    // Zero for a raw dictionary that was not trained
+    unsigned id() const
+    {
+        return ZSTD_getDictID_fromDict(data_.data(), data_.size());
+    }
+
+    ZSTD_CDict const* compression_dictionary() const
+    {
+        return cdict_;
+    }
+
+    ZSTD_DDict const* decompression_dictionary() const
+    {
+        return ddict_;
+    }
+};
+
+// Trains a dictionary of at most max_size bytes from uncompressed tiles. zstd
+// needs a sample of about a hundred times the size of the dictionary, this
+// throws when the samples are too few or too alike to learn from.
+MAPNIK_VECTOR_INLINE void zstd_train_dictionary(std::vector<std::string> const& samples,
+                                                std::string & dictionary,
+                                                std::size_t max_size=112640);
+
+MAPNIK_VECTOR_INLINE void zstd_decompress(const char * data,
+                                          std::size_t size,
+                                          std::string & output,
+                                          zstd_dictionary const& dictionary);
+
+MAPNIK_VECTOR_INLINE void zstd_compress(const char * data,
+                                        std::size_t size,
+                                        std::string & output,
+                                        zstd_dictionary const& dictionary);
+
+#endif
+
+// Compresses data with the codec of type, zstd_compression throws when the
+// library is built without zstd. no_compression copies data as it is.
+MAPNIK_VECTOR_INLINE void compress(const char * data,
+                                   std::size_t size,
+                                   std::string & output,
+                                   compression_type type,
+                                   int level=default_compression_level);
+
+// Decodes data with the codec found in its header. Returns false and leaves
+// output untouched when data is not compressed with a known codec.
+MAPNIK_VECTOR_INLINE bool decompress(const char * data,
+                                     std::size_t size,
+                                     std::string & output);
+
 } // end ns vector_tile_impl
 
 } // end ns mapnik
@@ -1,93 +1,611 @@
 // zlib
 #include <zlib.h>
 
+#if defined(MAPNIK_VECTOR_TILE_LIBDEFLATE)
+// libdeflate
+#include <libdeflate.h>
+#endif
+
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+// zstd
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
 // std
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
 
 namespace mapnik
 {
 
-namespace vector_tile_impl 
+namespace vector_tile_impl
+{
+
+namespace detail
+{
+
+/*
+  Streams and compressors kept from one call to the next. Setting up a deflate
+  stream allocates a few hundred kilobytes and zeroes its tables, which costs
+  as much as compressing a small tile, so a context is kept per thread and its
+  streams are only reset between calls.
+*/
+class compression_context
+{
+    z_stream inflate_s_;
+    z_stream deflate_s_;
+    bool inflate_init_;
+    bool deflate_init_;
+    int deflate_level_;
+    int deflate_window_bits_;
+    int deflate_strategy_;
+#if defined(MAPNIK_VECTOR_TILE_LIBDEFLATE)
+    // One compressor per level of zlib, they are allocated when first used
+    libdeflate_compressor * compressors_[Z_BEST_COMPRESSION + 1];
+    libdeflate_decompressor * decompressor_;
+#endif
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+    ZSTD_CCtx * zstd_compressor_;
+    ZSTD_DCtx * zstd_decompressor_;
+#endif
+
+    static void init_stream(z_stream & s)
+    {
+        s.zalloc = Z_NULL;
+        s.zfree = Z_NULL;
+        s.opaque = Z_NULL;
+        s.avail_in = 0;
+        s.next_in = Z_NULL;
+    }
+
+public:
+    compression_context()
+        : inflate_s_(),
+          deflate_s_(),
+          inflate_init_(false),
+          deflate_init_(false),
+          deflate_level_(0),
+          deflate_window_bits_(0),
+          deflate_strategy_(0)
+#if defined(MAPNIK_VECTOR_TILE_LIBDEFLATE)
+          , compressors_(),
+          decompressor_(nullptr)
+#endif
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+          , zstd_compressor_(nullptr),
+          zstd_decompressor_(nullptr)
+#endif
+    {}
+
+    compression_context(compression_context const&) = delete;
+    compression_context & operator=(compression_context const&) = delete;
+
+    ~compression_context()
+    {
+        if (inflate_init_)
+        {
+            inflateEnd(&inflate_s_);
+        }
+        if (deflate_init_)
+        {
+            deflateEnd(&deflate_s_);
+        }
+#if defined(MAPNIK_VECTOR_TILE_LIBDEFLATE)
+        for (auto compressor : compressors_)
+        {
+            if (compressor)
+            {
+                libdeflate_free_compressor(compressor);
+            }
+        }
+        if (decompressor_)
+        {
+            libdeflate_free_decompressor(decompressor_);
+        }
+#endif
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+        ZSTD_freeCCtx(zstd_compressor_);
+        ZSTD_freeDCtx(zstd_decompressor_);
+#endif
+    }
+
+    // Detects zlib and gzip headers, as 32 is added to the window bits
+    z_stream & inflater()
+    {
+        if (inflate_init_)
+        {
+            inflateReset(&inflate_s_);
+            return inflate_s_;
+        }
+        init_stream(inflate_s_);
+        if (inflateInit2(&inflate_s_, 32 + 15) != Z_OK)
+        {
+            throw std::runtime_error("inflate init failed");
+        }
+        inflate_init_ = true;
+        return inflate_s_;
+    }
+
+    z_stream & deflater(int level, int window_bits, int strategy)
+    {
+        if (deflate_init_)
+        {
+            if (level == deflate_level_ &&
+                window_bits == deflate_window_bits_ &&
+                strategy == deflate_strategy_)
+            {
+                deflateReset(&deflate_s_);
+                return deflate_s_;
+            }
+            deflateEnd(&deflate_s_);
+            deflate_init_ = false;
+        }
+        init_stream(deflate_s_);
+        if (deflateInit2(&deflate_s_, level, Z_DEFLATED, window_bits, 8, strategy) != Z_OK)
+        {
+            throw std::runtime_error("deflate init failed");
+        }
+        deflate_init_ = true;
+        deflate_level_ = level;
+        deflate_window_bits_ = window_bits;
+        deflate_strategy_ = strategy;
+        return deflate_s_;
+    }
+
+#if defined(MAPNIK_VECTOR_TILE_LIBDEFLATE)
+    // level must be a valid level of zlib
+    libdeflate_compressor * compressor(int level)
+    {
+        if (level == Z_DEFAULT_COMPRESSION)
+        {
+            level = 6;
+        }
+        libdeflate_compressor * & compressor = compressors_[level];
+        if (!compressor)
+        {
+            compressor = libdeflate_alloc_compressor(level);
+            if (!compressor)
+            {
+                throw std::runtime_error("libdeflate compressor allocation failed");
+            }
+        }
+        return compressor;
+    }
+
+    libdeflate_decompressor * decompressor()
+    {
+        if (!decompressor_)
+        {
+            decompressor_ = libdeflate_alloc_decompressor();
+            if (!decompressor_)
+            {
+                throw std::runtime_error("libdeflate decompressor allocation failed");
+            }
+        }
+        return decompressor_;
+    }
+#endif
+
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+    ZSTD_CCtx * zstd_compressor()
+    {
+        if (!zstd_compressor_)
+        {
+            zstd_compressor_ = ZSTD_createCCtx();
+            if (!zstd_compressor_)
+            {
+                throw std::runtime_error("zstd compression context allocation failed");
+            }
+        }
+        return zstd_compressor_;
+    }
+
+    ZSTD_DCtx * zstd_decompressor()
+    {
+        if (!zstd_decompressor_)
+        {
+            zstd_decompressor_ = ZSTD_createDCtx();
+            if (!zstd_decompressor_)
+            {
+                throw std::runtime_error("zstd decompression context allocation failed");
+            }
+        }
+        return zstd_decompressor_;
+    }
+#endif
+};
+
+MAPNIK_VECTOR_INLINE compression_context & thread_compression_context()
+{
+    static thread_local compression_context context;
+    return context;
+}
+
+// Deflate can not shrink data by more than 1032 to 1
+inline std::size_t max_inflated_size(std::size_t size)
+{
+    return size * 1032 + 1024;
+}
+
+// The ISIZE trailer of gzip holds the size of the decoded data modulo 2^32,
+// it is exact for a tile but can be anything when the data is corrupt so it
+// is only trusted up to what deflate can reach.
+inline std::size_t inflated_size_hint(const char * data, std::size_t size)
+{
+    std::size_t hint = 2 * size;
+    if (is_gzip_compressed(data, size) && size >= 18)
+    {
+        const unsigned char * trailer = reinterpret_cast<const unsigned char *>(data + size - 4);
+        std::size_t isize = static_cast<std::size_t>(trailer[0]) |
+                            static_cast<std::size_t>(trailer[1]) << 8 |
+                            static_cast<std::size_t>(trailer[2]) << 16 |
+                            static_cast<std::size_t>(trailer[3]) << 24;
+        if (isize > 0 && isize <= max_inflated_size(size))
+        {
+            hint = isize;
+        }
+    }
+    return std::max(hint, static_cast<std::size_t>(1024));
+}
+
+#if defined(MAPNIK_VECTOR_TILE_LIBDEFLATE)
+
+// One shot decoding, the output is sized from ISIZE for gzip and grown until
+// the data fits otherwise.
+inline void libdeflate_decompress(const char * data, std::size_t size, std::string & output, bool gzip)
 {
+    libdeflate_decompressor * decompressor = thread_compression_context().decompressor();
+    std::size_t capacity = inflated_size_hint(data, size);
+    while (true)
+    {
+        output.resize(capacity);
+        std::size_t length = 0;
+        libdeflate_result ret = gzip ?
+            libdeflate_gzip_decompress(decompressor, data, size, &output[0], capacity, &length) :
+            libdeflate_zlib_decompress(decompressor, data, size, &output[0], capacity, &length);
+        if (ret == LIBDEFLATE_SUCCESS)
+        {
+            output.resize(length);
+            return;
+        }
+        if (ret != LIBDEFLATE_INSUFFICIENT_SPACE || capacity > max_inflated_size(size))
+        {
+            output.clear();
+            throw std::runtime_error("invalid compressed data");
+        }
+        capacity *= 2;
+    }
+}
+
+#endif
+
+} // end ns detail
 
 // decodes both zlib and gzip
 // http://stackoverflow.com/a/1838702/2333354
-void zlib_decompress(const char * data, std::size_t size, std::string & output)
-{
-    z_stream inflate_s;
-    inflate_s.zalloc = Z_NULL;
-    inflate_s.zfree = Z_NULL;
-    inflate_s.opaque = Z_NULL;
-    inflate_s.avail_in = 0;
-    inflate_s.next_in = Z_NULL;
-    inflateInit2(&inflate_s, 32 + 15);
+MAPNIK_VECTOR_INLINE void zlib_decompress(const char * data, std::size_t size, std::string & output)
+{
+#if defined(MAPNIK_VECTOR_TILE_LIBDEFLATE)
+    if (is_gzip_compressed(data, size))
+    {
+        detail::libdeflate_decompress(data, size, output, true);
+        return;
+    }
+    if (is_zlib_compressed(data, size))
+    {
+        detail::libdeflate_decompress(data, size, output, false);
+        return;
+    }
+#endif
+    z_stream & inflate_s = detail::thread_compression_context().inflater();
     inflate_s.next_in = (Bytef *)data;
     inflate_s.avail_in = size;
-    size_t length = 0;
-    do {
-        output.resize(length + 2 * size);
-        inflate_s.avail_out = 2 * size;
-        inflate_s.next_out = (Bytef *)(output.data() + length);
-        int ret = inflate(&inflate_s, Z_FINISH);
+    std::size_t length = 0;
+    std::size_t increase = detail::inflated_size_hint(data, size);
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END)
+    {
+        increase = std::min(increase, static_cast<std::size_t>(std::numeric_limits<uInt>::max()));
+        output.resize(length + increase);
+        inflate_s.avail_out = increase;
+        inflate_s.next_out = (Bytef *)(&output[0] + length);
+        ret = inflate(&inflate_s, Z_FINISH);
         if (ret != Z_STREAM_END && ret != Z_OK && ret != Z_BUF_ERROR)
         {
-            std::string error_msg = inflate_s.msg;
-            inflateEnd(&inflate_s);
+            std::string error_msg = inflate_s.msg ? inflate_s.msg : "inflate failed";
+            output.clear();
             throw std::runtime_error(error_msg);
         }
-
-        length += (2 * size - inflate_s.avail_out);
-    } while (inflate_s.avail_out == 0);
-    inflateEnd(&inflate_s);
+        length += (increase - inflate_s.avail_out);
+        if (ret != Z_STREAM_END && inflate_s.avail_out != 0)
+        {
+            // All of the input was used before the end of the stream
+            output.clear();
+            throw std::runtime_error("truncated compressed data");
+        }
+        increase = std::max(length, increase);
+    }
     output.resize(length);
 }
 
-void zlib_decompress(std::string const& input, std::string & output)
+MAPNIK_VECTOR_INLINE void zlib_decompress(std::string const& input, std::string & output)
 {
     zlib_decompress(input.data(),input.size(),output);
 }
 
-void zlib_compress(const char * data, std::size_t size, std::string & output, bool gzip, int level, int strategy)
+MAPNIK_VECTOR_INLINE void zlib_compress(const char * data, std::size_t size, std::string & output, bool gzip, int level, int strategy)
 {
-    z_stream deflate_s;
-    deflate_s.zalloc = Z_NULL;
-    deflate_s.zfree = Z_NULL;
-    deflate_s.opaque = Z_NULL;
-    deflate_s.avail_in = 0;
-    deflate_s.next_in = Z_NULL;
+#if defined(MAPNIK_VECTOR_TILE_LIBDEFLATE)
+    // libdeflate has no strategies, the others are left to zlib which also
+    // rejects the invalid levels
+    if (strategy == Z_DEFAULT_STRATEGY && level >= Z_DEFAULT_COMPRESSION && level <= Z_BEST_COMPRESSION)
+    {
+        libdeflate_compressor * compressor = detail::thread_compression_context().compressor(level);
+        std::size_t bound = gzip ? libdeflate_gzip_compress_bound(compressor, size) :
+                                   libdeflate_zlib_compress_bound(compressor, size);
+        output.resize(bound);
+        std::size_t length = gzip ? libdeflate_gzip_compress(compressor, data, size, &output[0], bound) :
+                                    libdeflate_zlib_compress(compressor, data, size, &output[0], bound);
+        if (length == 0)
+        {
+            output.clear();
+            throw std::runtime_error("libdeflate compression failed");
+        }
+        output.resize(length);
+        return;
+    }
+#endif
     int windowsBits = 15;
     if (gzip)
     {
         windowsBits = windowsBits | 16;
     }
-    if (deflateInit2(&deflate_s, level, Z_DEFLATED, windowsBits, 8, strategy) != Z_OK)
-    {
-        throw std::runtime_error("deflate init failed");
-    }
+    z_stream & deflate_s = detail::thread_compression_context().deflater(level, windowsBits, strategy);
     deflate_s.next_in = (Bytef *)data;
     deflate_s.avail_in = size;
     size_t length = 0;
+    // The bound fits the whole output so there is a single pass unless the
+    // bound is beyond what the stream can take at once
+    std::size_t increase = deflateBound(&deflate_s, size);
     do {
-        size_t increase = size / 2 + 1024;
+        increase = std::min(increase, static_cast<std::size_t>(std::numeric_limits<uInt>::max()));
         output.resize(length + increase);
         deflate_s.avail_out = increase;
-        deflate_s.next_out = (Bytef *)(output.data() + length);
+        deflate_s.next_out = (Bytef *)(&output[0] + length);
         // From http://www.zlib.net/zlib_how.html
-        // "deflate() has a return value that can indicate errors, yet we do not check it here. 
+        // "deflate() has a return value that can indicate errors, yet we do not check it here.
         // Why not? Well, it turns out that deflate() can do no wrong here."
         // Basically only possible error is from deflateInit not working properly
         deflate(&deflate_s, Z_FINISH);
         length += (increase - deflate_s.avail_out);
     } while (deflate_s.avail_out == 0);
-    deflateEnd(&deflate_s);
     output.resize(length);
 }
 
-void zlib_compress(std::string const& input, std::string & output, bool gzip, int level, int strategy)
+MAPNIK_VECTOR_INLINE void zlib_compress(std::string const& input, std::string & output, bool gzip, int level, int strategy)
 {
     zlib_compress(input.data(),input.size(),output,gzip,level,strategy);
 }
 
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+
+namespace detail {
+
+// Dictionaries given to a context stay with it from one frame to the next,
+// so the context is reset before every frame and given ddict when not null.
+inline void zstd_decompress(const char * data, std::size_t size, std::string & output, ZSTD_DDict const* ddict)
+{
+    ZSTD_DCtx * dctx = thread_compression_context().zstd_decompressor();
+    std::size_t ret = ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+    if (!ZSTD_isError(ret) && ddict)
+    {
+        ret = ZSTD_DCtx_refDDict(dctx, ddict);
+    }
+    if (ZSTD_isError(ret))
+    {
+        throw std::runtime_error(ZSTD_getErrorName(ret));
+    }
+    unsigned long long content_size = ZSTD_getFrameContentSize(data, size);
+    if (content_size == ZSTD_CONTENTSIZE_ERROR)
+    {
+        throw std::runtime_error("invalid zstd compressed data");
+    }
+    // The size in the frame header is only trusted up to what deflate could
+    // reach, a larger one is either a corrupt header or data so repetitive
+    // that growing the output as the frame is decoded costs little.
+    if (content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size <= max_inflated_size(size))
+    {
+        output.resize(static_cast<std::size_t>(content_size));
+        std::size_t length = ZSTD_decompressDCtx(dctx, &output[0], output.size(), data, size);
+        if (ZSTD_isError(length))
+        {
+            output.clear();
+            throw std::runtime_error(ZSTD_getErrorName(length));
+        }
+        output.resize(length);
+        return;
+    }
+    // Frames written by a stream do not always carry their size
+    ZSTD_inBuffer input = { data, size, 0 };
+    std::size_t length = 0;
+    std::size_t increase = std::max(2 * size, ZSTD_DStreamOutSize());
+    while (true)
+    {
+        output.resize(length + increase);
+        ZSTD_outBuffer out = { &output[0] + length, increase, 0 };
+        std::size_t ret = ZSTD_decompressStream(dctx, &out, &input);
+        if (ZSTD_isError(ret))
+        {
+            output.clear();
+            throw std::runtime_error(ZSTD_getErrorName(ret));
+        }
+        length += out.pos;
+        if (ret == 0)
+        {
+            break;
+        }
+        if (input.pos == input.size && out.pos < out.size)
+        {
+            output.clear();
+            throw std::runtime_error("truncated zstd compressed data");
+        }
+        increase = std::max(length, increase);
+    }
+    output.resize(length);
+}
+
+} // end ns detail
+
+MAPNIK_VECTOR_INLINE void zstd_decompress(const char * data, std::size_t size, std::string & output)
+{
+    detail::zstd_decompress(data, size, output, nullptr);
+}
+
+MAPNIK_VECTOR_INLINE void zstd_compress(const char * data, std::size_t size, std::string & output, int level)
+{
+    ZSTD_CCtx * cctx = detail::thread_compression_context().zstd_compressor();
+    output.resize(ZSTD_compressBound(size));
+    std::size_t length = ZSTD_compressCCtx(cctx, &output[0], output.size(), data, size, level);
+    if (ZSTD_isError(length))
+    {
+        output.clear();
+        throw std::runtime_error(ZSTD_getErrorName(length));
+    }
+    output.resize(length);
+}
+
+MAPNIK_VECTOR_INLINE zstd_dictionary::zstd_dictionary(std::string const& data, int level)
+    : data_(data),
+      cdict_(ZSTD_createCDict(data_.data(), data_.size(), level)),
+      ddict_(ZSTD_createDDict(data_.data(), data_.size()))
+{
+    if (!cdict_ || !ddict_)
+    {
+        ZSTD_freeCDict(cdict_);
+        ZSTD_freeDDict(ddict_);
+        throw std::runtime_error("invalid zstd dictionary");
+    }
+}
+
+MAPNIK_VECTOR_INLINE zstd_dictionary::~zstd_dictionary()
+{
+    ZSTD_freeCDict(cdict_);
+    ZSTD_freeDDict(ddict_);
+}
+
+MAPNIK_VECTOR_INLINE void zstd_train_dictionary(std::vector<std::string> const& samples,
+                                                std::string & dictionary,
+                                                std::size_t max_size)
+{
+    // zdict takes the samples end to end along with their sizes
+    std::string buffer;
+    std::vector<std::size_t> sizes;
+    sizes.reserve(samples.size());
+    for (auto const& sample : samples)
+    {
+        if (sample.empty())
+        {
+            continue;
+        }
+        buffer.append(sample);
+        sizes.push_back(sample.size());
+    }
+    if (sizes.empty())
+    {
+        throw std::runtime_error("can not train a zstd dictionary without samples");
+    }
+    dictionary.resize(max_size);
+    std::size_t length = ZDICT_trainFromBuffer(&dictionary[0], dictionary.size(),
+                                               buffer.data(), sizes.data(),
+                                               static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(length))
+    {
+        dictionary.clear();
+        throw std::runtime_error(std::string("zstd dictionary training failed: ") + ZDICT_getErrorName(length));
+    }
+    dictionary.resize(length);
+}
+
+MAPNIK_VECTOR_INLINE void zstd_decompress(const char * data,
+                                          std::size_t size,
+                                          std::string & output,
+                                          zstd_dictionary const& dictionary)
+{
+    detail::zstd_decompress(data, size, output, dictionary.decompression_dictionary());
+}
+
+MAPNIK_VECTOR_INLINE void zstd_compress(const char * data,
+                                        std::size_t size,
+                                        std::string & output,
+                                        zstd_dictionary const& dictionary)
+{
+    ZSTD_CCtx * cctx = detail::thread_compression_context().zstd_compressor();
+    output.resize(ZSTD_compressBound(size));
+    std::size_t length = ZSTD_compress_usingCDict(cctx, &output[0], output.size(), data, size,
+                                                  dictionary.compression_dictionary());
+    if (ZSTD_isError(length))
+    {
+        output.clear();
+        throw std::runtime_error(ZSTD_getErrorName(length));
+    }
+    output.resize(length);
+}
+
+#endif
+
+MAPNIK_VECTOR_INLINE void compress(const char * data,
+                                   std::size_t size,
+                                   std::string & output,
+                                   compression_type type,
+                                   int level)
+{
+    switch (type)
+    {
+        case no_compression:
+            output.assign(data, size);
+            return;
+        case zlib_compression:
+        case gzip_compression:
+            zlib_compress(data, size, output, type == gzip_compression,
+                          level == default_compression_level ? Z_DEFAULT_COMPRESSION : level);
+            return;
+        case zstd_compression:
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+            zstd_compress(data, size, output,
+                          level == default_compression_level ? ZSTD_CLEVEL_DEFAULT : level);
+            return;
+#else
+            throw std::runtime_error("mapnik-vector-tile was built without zstd support");
+#endif
+    }
+    throw std::runtime_error("unknown compression type");
+}
+
+MAPNIK_VECTOR_INLINE bool decompress(const char * data,
+                                     std::size_t size,
+                                     std::string & output)
+{
+    switch (get_compression_type(data, size))
+    {
+        case zlib_compression:
+        case gzip_compression:
+            zlib_decompress(data, size, output);
+            return true;
+        case zstd_compression:
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+            zstd_decompress(data, size, output);
+            return true;
+#else
+            throw std::runtime_error("mapnik-vector-tile was built without zstd support");
+#endif
+        case no_compression:
+            break;
+    }
+    return false;
+}
+
 } // end ns vector_tile_impl
 
 } // end ns mapnik
@@ -1,13 +1,23 @@
 #pragma once
 
+// mapnik-vector-tile
+#include "vector_tile_feature_index.hpp"
+
 // mapnik
 //#include <mapnik/geometry/box2d.hpp>
 #include <mapnik/datasource.hpp>
 #include <mapnik/util/variant.hpp>
+#include <mapnik/value.hpp>
 
 // protozero
 #include <protozero/pbf_reader.hpp>
 
+// std
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace mapnik
 {
 
@@ -26,6 +36,14 @@ public:
                     std::uint64_t y,
                     std::uint64_t z,
                     bool use_tile_extent = false);
+    // For a layer in memory that the datasource does not own, such as the
+    // buffer of a tile_view, owner is kept alive as long as the datasource.
+    tile_datasource_pbf(protozero::pbf_reader const& layer,
+                    std::uint64_t x,
+                    std::uint64_t y,
+                    std::uint64_t z,
+                    std::shared_ptr<const void> owner,
+                    bool use_tile_extent = false);
     virtual ~tile_datasource_pbf();
     datasource::datasource_t type() const;
     featureset_ptr features(query const& q) const;
@@ -37,7 +55,21 @@ public:
     layer_descriptor get_descriptor() const;
     std::string const& get_name() { return name_; }
     std::uint32_t get_layer_extent() { return tile_size_; }
+    // Values of the layer as mapnik values, converted on first use and then
+    // shared by every featureset of this datasource.
+    std::vector<mapnik::value> const& get_layer_values() const;
+    // True once get_layer_values() converted the values
+    bool has_layer_values() const { return values_converted_; }
+    // When enabled a grid of the feature bounding boxes is built on the first
+    // query and used to skip the features outside of every following query.
+    // Worth it when the same layer is queried many times with small boxes.
+    void set_use_feature_index(bool use_index) { use_feature_index_ = use_index; }
+    bool get_use_feature_index() const { return use_feature_index_; }
 private:
+    feature_index const& get_feature_index() const;
+    template <typename Featureset>
+    void set_index_candidates(Featureset & fs, box2d<double> const& bbox) const;
+
     mutable mapnik::layer_descriptor desc_;
     mutable bool attributes_added_;
     mutable bool valid_layer_;
@@ -58,6 +90,13 @@ private:
     std::vector<protozero::pbf_reader> features_;
     std::vector<std::string> layer_keys_;
     layer_pbf_attr_type layer_values_;
+    mutable std::once_flag converted_values_flag_;
+    mutable std::vector<mapnik::value> converted_values_;
+    mutable std::atomic<bool> values_converted_;
+    bool use_feature_index_;
+    mutable std::once_flag index_flag_;
+    mutable std::unique_ptr<feature_index> index_;
+    std::shared_ptr<const void> owner_;
 };
 
 } // end ns vector_tile_impl
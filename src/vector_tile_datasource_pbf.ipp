@@ -11,6 +11,7 @@
 #include <mapnik/feature_layer_desc.hpp>
 #include <mapnik/geom_util.hpp>
 #include <mapnik/query.hpp>
+#include <mapnik/unicode.hpp>
 #include <mapnik/version.hpp>
 #include <mapnik/well_known_srs.hpp>
 
@@ -22,6 +23,7 @@
 
 // std
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 
@@ -51,7 +53,9 @@ tile_datasource_pbf::tile_datasource_pbf(protozero::pbf_reader const& layer,
       tile_y_(0.0),
       scale_(1.0),
       version_(1), // Version == 1 is the default because it was not required until v2 to have this field
-      type_(datasource::Vector)
+      type_(datasource::Vector),
+      values_converted_(false),
+      use_feature_index_(false)
 {
     double resolution = mapnik::EARTH_CIRCUMFERENCE/(1 << z_);
     tile_x_ = -0.5 * mapnik::EARTH_CIRCUMFERENCE + x_ * resolution;
@@ -169,8 +173,102 @@ tile_datasource_pbf::tile_datasource_pbf(protozero::pbf_reader const& layer,
     }
 }
 
+tile_datasource_pbf::tile_datasource_pbf(protozero::pbf_reader const& layer,
+                                         std::uint64_t x,
+                                         std::uint64_t y,
+                                         std::uint64_t z,
+                                         std::shared_ptr<const void> owner,
+                                         bool use_tile_extent)
+    : tile_datasource_pbf(layer, x, y, z, use_tile_extent)
+{
+    owner_ = std::move(owner);
+}
+
 tile_datasource_pbf::~tile_datasource_pbf() {}
 
+namespace detail
+{
+
+struct pbf_attr_to_value
+{
+    mapnik::transcoder const& tr_;
+
+    explicit pbf_attr_to_value(mapnik::transcoder const& tr)
+        : tr_(tr) {}
+
+    mapnik::value operator() (std::string const& val) const
+    {
+        return mapnik::value(tr_.transcode(val.data(), val.length()));
+    }
+
+    mapnik::value operator() (bool const& val) const
+    {
+        return mapnik::value(static_cast<mapnik::value_bool>(val));
+    }
+
+    mapnik::value operator() (int64_t const& val) const
+    {
+        return mapnik::value(static_cast<mapnik::value_integer>(val));
+    }
+
+    mapnik::value operator() (uint64_t const& val) const
+    {
+        return mapnik::value(static_cast<mapnik::value_integer>(val));
+    }
+
+    mapnik::value operator() (double const& val) const
+    {
+        return mapnik::value(static_cast<mapnik::value_double>(val));
+    }
+
+    mapnik::value operator() (float const& val) const
+    {
+        return mapnik::value(static_cast<mapnik::value_double>(val));
+    }
+};
+
+} // end ns detail
+
+std::vector<mapnik::value> const& tile_datasource_pbf::get_layer_values() const
+{
+    // Featuresets may be created from several threads at once
+    std::call_once(converted_values_flag_, [this]() {
+        mapnik::transcoder tr("utf-8");
+        detail::pbf_attr_to_value converter(tr);
+        converted_values_.reserve(layer_values_.size());
+        for (auto const& val : layer_values_)
+        {
+            converted_values_.push_back(mapnik::util::apply_visitor(converter, val));
+        }
+        values_converted_ = true;
+    });
+    return converted_values_;
+}
+
+feature_index const& tile_datasource_pbf::get_feature_index() const
+{
+    std::call_once(index_flag_, [this]() {
+        index_.reset(new feature_index(features_, tile_size_, version_));
+    });
+    return *index_;
+}
+
+template <typename Featureset>
+void tile_datasource_pbf::set_index_candidates(Featureset & fs, box2d<double> const& bbox) const
+{
+    if (!use_feature_index_)
+    {
+        return;
+    }
+    // Inverse of the transform applied to the decoded geometries, padded by a
+    // tile unit so rounding never drops a feature touching the query edge
+    double x0 = (bbox.minx() - tile_x_) * scale_ - 1.0;
+    double x1 = (bbox.maxx() - tile_x_) * scale_ + 1.0;
+    double y0 = (tile_y_ - bbox.maxy()) * scale_ - 1.0;
+    double y1 = (tile_y_ - bbox.miny()) * scale_ + 1.0;
+    fs.set_candidates(get_feature_index().query(box2d<double>(x0, y0, x1, y1)));
+}
+
 datasource::datasource_t tile_datasource_pbf::type() const
 {
     return type_;
@@ -189,8 +287,13 @@ featureset_ptr tile_datasource_pbf::features(query const& q) const
         return featureset_ptr();
     }
     mapnik::filter_in_box filter(q.get_bbox());
-    return std::make_shared<tile_featureset_pbf<mapnik::filter_in_box> >
-        (filter, get_tile_extent(), q.get_unbuffered_bbox(), q.property_names(), features_, tile_x_, tile_y_, scale_, layer_keys_, layer_values_, version_);
+    // Values are only converted once a query asks for attributes
+    static const std::vector<mapnik::value> no_values;
+    std::vector<mapnik::value> const& values = q.property_names().empty() ? no_values : get_layer_values();
+    auto fs = std::make_shared<tile_featureset_pbf<mapnik::filter_in_box> >
+        (filter, get_tile_extent(), q.get_unbuffered_bbox(), q.property_names(), features_, tile_x_, tile_y_, scale_, layer_keys_, values, layer_values_.size(), version_);
+    set_index_candidates(*fs, q.get_bbox());
+    return fs;
 }
 
 featureset_ptr tile_datasource_pbf::features_at_point(coord2d const& pt, double tol) const
@@ -211,8 +314,12 @@ featureset_ptr tile_datasource_pbf::features_at_point(coord2d const& pt, double
     {
         names.insert(key);
     }
-    return std::make_shared<tile_featureset_pbf<filter_at_point> >
-        (filter, get_tile_extent(), get_tile_extent(), names, features_, tile_x_, tile_y_, scale_, layer_keys_, layer_values_, version_);
+    static const std::vector<mapnik::value> no_values;
+    std::vector<mapnik::value> const& values = names.empty() ? no_values : get_layer_values();
+    auto fs = std::make_shared<tile_featureset_pbf<filter_at_point> >
+        (filter, get_tile_extent(), get_tile_extent(), names, features_, tile_x_, tile_y_, scale_, layer_keys_, values, layer_values_.size(), version_);
+    set_index_candidates(*fs, filter.box_);
+    return fs;
 }
 
 void tile_datasource_pbf::set_envelope(box2d<double> const& bbox)
@@ -289,12 +289,14 @@ inline void consider(Range const& vec,
 
 } // end ns detail
 
+// included is scratch space, passing the same vector for every call avoids reallocating it
 template <typename Range, typename OutputIterator>
 inline void douglas_peucker(Range const& range,
                             OutputIterator out,
-                            double max_distance)
+                            double max_distance,
+                            std::vector<bool> & included)
 {
-    std::vector<bool> included(range.size());
+    included.assign(range.size(), false);
 
     // Include first and last point of line,
     // they are always part of the line
@@ -323,6 +325,15 @@ inline void douglas_peucker(Range const& range,
     }
 }
 
+template <typename Range, typename OutputIterator>
+inline void douglas_peucker(Range const& range,
+                            OutputIterator out,
+                            double max_distance)
+{
+    std::vector<bool> included;
+    douglas_peucker(range, out, max_distance, included);
+}
+
 } // end ns vector_tile_impl
 
 } // end ns mapnik
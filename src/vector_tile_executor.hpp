@@ -0,0 +1,325 @@
+#ifndef __MAPNIK_VECTOR_TILE_EXECUTOR_H__
+#define __MAPNIK_VECTOR_TILE_EXECUTOR_H__
+
+// mapnik
+#include <mapnik/util/noncopyable.hpp>
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+/*
+  An executor runs tasks submitted by the processor. It is meant
+  to be created once and shared by every processor and every tile,
+  so that no threads are created while tiles are being encoded.
+*/
+
+class executor
+{
+public:
+    using task_type = std::function<void()>;
+
+    virtual ~executor() {}
+
+    // Queue a task, it will be run by one of the executor's threads
+    // or by a thread waiting in try_run_one.
+    virtual void submit(task_type task) = 0;
+
+    // Run one queued task on the calling thread. Returns false if
+    // there was nothing to run. Threads waiting for their own tasks
+    // call this so that nested waits can not starve the executor.
+    virtual bool try_run_one() = 0;
+};
+
+/*
+  Fixed size pool where each worker owns a queue. Tasks submitted from
+  a worker go to its own queue and are taken back in LIFO order, idle
+  workers steal the oldest task from the other queues.
+*/
+
+class work_stealing_executor : public executor, private mapnik::util::noncopyable
+{
+private:
+    struct worker_queue
+    {
+        std::mutex mutex;
+        std::deque<task_type> tasks;
+    };
+
+    struct worker_id
+    {
+        work_stealing_executor const* owner;
+        std::size_t index;
+    };
+
+    std::vector<std::unique_ptr<worker_queue> > queues_;
+    std::vector<std::thread> threads_;
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    std::atomic<std::size_t> queued_;
+    std::atomic<std::size_t> next_queue_;
+    bool stop_;
+
+    static worker_id & current_worker()
+    {
+        static thread_local worker_id id = { nullptr, 0 };
+        return id;
+    }
+
+    bool pop_own(std::size_t index, task_type & task)
+    {
+        worker_queue & q = *queues_[index];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty())
+        {
+            return false;
+        }
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(std::size_t start, task_type & task)
+    {
+        std::size_t count = queues_.size();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            worker_queue & q = *queues_[(start + i) % count];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty())
+            {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool take(task_type & task)
+    {
+        worker_id const& id = current_worker();
+        bool found = false;
+        if (id.owner == this)
+        {
+            found = pop_own(id.index, task) || steal(id.index + 1, task);
+        }
+        else
+        {
+            found = steal(next_queue_.load(std::memory_order_relaxed), task);
+        }
+        if (found)
+        {
+            --queued_;
+        }
+        return found;
+    }
+
+    void run_worker(std::size_t index)
+    {
+        worker_id & id = current_worker();
+        id.owner = this;
+        id.index = index;
+        task_type task;
+        while (true)
+        {
+            if (take(task))
+            {
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleep_cv_.wait(lock, [this] { return stop_ || queued_.load() > 0; });
+            if (stop_ && queued_.load() == 0)
+            {
+                return;
+            }
+        }
+    }
+
+public:
+    explicit work_stealing_executor(std::size_t thread_count = std::thread::hardware_concurrency())
+        : queues_(),
+          threads_(),
+          sleep_mutex_(),
+          sleep_cv_(),
+          queued_(0),
+          next_queue_(0),
+          stop_(false)
+    {
+        thread_count = std::max<std::size_t>(thread_count, 1);
+        queues_.reserve(thread_count);
+        for (std::size_t i = 0; i < thread_count; ++i)
+        {
+            queues_.emplace_back(new worker_queue());
+        }
+        threads_.reserve(thread_count);
+        for (std::size_t i = 0; i < thread_count; ++i)
+        {
+            threads_.emplace_back(&work_stealing_executor::run_worker, this, i);
+        }
+    }
+
+    ~work_stealing_executor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_ = true;
+        }
+        sleep_cv_.notify_all();
+        for (auto & t : threads_)
+        {
+            t.join();
+        }
+    }
+
+    std::size_t size() const
+    {
+        return threads_.size();
+    }
+
+    void submit(task_type task)
+    {
+        worker_id const& id = current_worker();
+        std::size_t index = (id.owner == this) ? id.index : (next_queue_++ % queues_.size());
+        {
+            // Counted under the sleep mutex so a worker can not miss the wake up,
+            // and before the push so a thief never takes an uncounted task.
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            ++queued_;
+        }
+        {
+            worker_queue & q = *queues_[index];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.tasks.push_back(std::move(task));
+        }
+        sleep_cv_.notify_one();
+    }
+
+    bool try_run_one()
+    {
+        task_type task;
+        if (!take(task))
+        {
+            return false;
+        }
+        task();
+        return true;
+    }
+};
+
+/*
+  Tracks a set of tasks submitted to an executor. wait() returns once
+  all of them have finished and rethrows the first exception thrown by
+  any of them. While waiting, the calling thread runs queued tasks and
+  sleeps when there are none until one of the group's tasks finishes.
+*/
+
+class task_group : private mapnik::util::noncopyable
+{
+private:
+    executor & exec_;
+    std::atomic<std::size_t> pending_;
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+    // Tasks finish under done_mutex_, done() is only tested while holding it
+    // so a wake up can not be missed and the group outlives the last notify.
+    std::mutex done_mutex_;
+    std::condition_variable done_cv_;
+    std::size_t finished_;
+
+    void drain()
+    {
+        wait_until([this] { return pending_.load() == 0; });
+    }
+
+public:
+    explicit task_group(executor & exec)
+        : exec_(exec),
+          pending_(0),
+          error_mutex_(),
+          error_(),
+          done_mutex_(),
+          done_cv_(),
+          finished_(0) {}
+
+    ~task_group()
+    {
+        // Tasks reference this group, never let it go away under them
+        drain();
+    }
+
+    void run(executor::task_type task)
+    {
+        ++pending_;
+        exec_.submit([this, task]() {
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex_);
+                if (!error_)
+                {
+                    error_ = std::current_exception();
+                }
+            }
+            std::lock_guard<std::mutex> lock(done_mutex_);
+            ++finished_;
+            --pending_;
+            done_cv_.notify_all();
+        });
+    }
+
+    // Returns once done() is true, done() must only change when a task of
+    // the group finishes. Queued tasks are run in the meantime.
+    template <typename Predicate>
+    void wait_until(Predicate done)
+    {
+        std::unique_lock<std::mutex> lock(done_mutex_);
+        while (!done())
+        {
+            lock.unlock();
+            bool ran = exec_.try_run_one();
+            lock.lock();
+            if (!ran && !done())
+            {
+                std::size_t seen = finished_;
+                done_cv_.wait(lock, [this, seen] { return finished_ != seen; });
+            }
+        }
+    }
+
+    void wait()
+    {
+        drain();
+        if (error_)
+        {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
+
+#endif // __MAPNIK_VECTOR_TILE_EXECUTOR_H__
@@ -0,0 +1,2 @@
+#include "vector_tile_feature_index.hpp"
+#include "vector_tile_feature_index.ipp"
@@ -0,0 +1,86 @@
+#ifndef __MAPNIK_VECTOR_TILE_FEATURE_INDEX_H__
+#define __MAPNIK_VECTOR_TILE_FEATURE_INDEX_H__
+
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+
+// mapnik
+#include <mapnik/geometry/box2d.hpp>
+
+// mapbox
+#include <mapbox/geometry/box.hpp>
+
+// protozero
+#include <protozero/pbf_reader.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+/*
+  Grid of the bounding boxes of the features of a layer, in tile coordinates.
+  The grid covers the layer extent, features in the buffer around it are
+  put in the border cells. Features whose bounding box can not be computed
+  from their geometry, rasters for example, are returned by every query.
+  Features of a version 1 layer with an invalid geometry are returned by none,
+  as the featureset skips them too.
+*/
+
+class feature_index
+{
+public:
+    using box_type = mapbox::geometry::box<std::int64_t>;
+
+    MAPNIK_VECTOR_INLINE feature_index(std::vector<protozero::pbf_reader> const& features,
+                                       std::uint32_t extent,
+                                       std::uint32_t version = 2);
+
+    // Positions in the layer, in increasing order, of the features that may
+    // intersect the box given in tile coordinates.
+    MAPNIK_VECTOR_INLINE std::vector<std::uint32_t> query(mapnik::box2d<double> const& box) const;
+
+    std::size_t size() const
+    {
+        return boxes_.size();
+    }
+
+private:
+    std::size_t cell_index(double value) const
+    {
+        if (!(value > 0.0))
+        {
+            return 0;
+        }
+        double cell = value / cell_size_;
+        if (cell >= static_cast<double>(cells_per_side_))
+        {
+            return cells_per_side_ - 1;
+        }
+        return static_cast<std::size_t>(cell);
+    }
+
+    double cell_size_;
+    std::size_t cells_per_side_;
+    std::vector<box_type> boxes_;
+    std::vector<bool> has_box_;
+    std::vector<std::uint32_t> always_;
+    // Features of cell c are cell_features_[cell_offsets_[c] .. cell_offsets_[c + 1]]
+    std::vector<std::uint32_t> cell_offsets_;
+    std::vector<std::uint32_t> cell_features_;
+};
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
+
+#if !defined(MAPNIK_VECTOR_TILE_LIBRARY)
+#include "vector_tile_feature_index.ipp"
+#endif
+
+#endif // __MAPNIK_VECTOR_TILE_FEATURE_INDEX_H__
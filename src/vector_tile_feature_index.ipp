@@ -0,0 +1,169 @@
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+#include "vector_tile_geometry_decoder.hpp"
+
+// protozero
+#include <protozero/pbf_reader.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <exception>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+MAPNIK_VECTOR_INLINE feature_index::feature_index(std::vector<protozero::pbf_reader> const& features,
+                                                  std::uint32_t extent,
+                                                  std::uint32_t version)
+    : cell_size_(1.0),
+      cells_per_side_(1),
+      boxes_(),
+      has_box_(features.size(), false),
+      always_(),
+      cell_offsets_(),
+      cell_features_()
+{
+    // About two features per cell, for a layer with evenly spread features
+    double side = std::ceil(std::sqrt(static_cast<double>(features.size()) / 2.0));
+    cells_per_side_ = static_cast<std::size_t>(std::min(std::max(side, 1.0), 64.0));
+    cell_size_ = static_cast<double>(extent > 0 ? extent : 4096) / static_cast<double>(cells_per_side_);
+
+    boxes_.reserve(features.size());
+    for (std::size_t i = 0; i < features.size(); ++i)
+    {
+        boxes_.emplace_back(box_type::point_type(0, 0), box_type::point_type(0, 0));
+        protozero::pbf_reader f = features[i];
+        bool has_geometry = false;
+        bool has_raster = false;
+        GeometryPBF::pbf_itr geom_itr;
+        while (f.next())
+        {
+            if (f.tag() == Feature_Encoding::GEOMETRY)
+            {
+                geom_itr = f.get_packed_uint32();
+                has_geometry = true;
+            }
+            else
+            {
+                has_raster = has_raster || f.tag() == Feature_Encoding::RASTER;
+                f.skip();
+            }
+        }
+        if (!has_geometry || has_raster)
+        {
+            always_.push_back(static_cast<std::uint32_t>(i));
+            continue;
+        }
+        bool has_box = false;
+        try
+        {
+            has_box = decode_geometry_bbox(geom_itr, boxes_[i]);
+        }
+        catch (std::exception const&)
+        {
+            if (version != 1)
+            {
+                throw;
+            }
+            // For v1 the feature is skipped when read, keep its box empty
+            boxes_[i] = box_type(box_type::point_type(0, 0), box_type::point_type(0, 0));
+            continue;
+        }
+        if (has_box)
+        {
+            has_box_[i] = true;
+        }
+        else
+        {
+            always_.push_back(static_cast<std::uint32_t>(i));
+        }
+    }
+
+    // Count then fill, so the grid is stored in two flat arrays
+    std::size_t num_cells = cells_per_side_ * cells_per_side_;
+    cell_offsets_.assign(num_cells + 1, 0);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        std::vector<std::uint32_t> fill;
+        if (pass == 1)
+        {
+            for (std::size_t c = 0; c < num_cells; ++c)
+            {
+                cell_offsets_[c + 1] += cell_offsets_[c];
+            }
+            cell_features_.resize(cell_offsets_[num_cells]);
+            fill.assign(cell_offsets_.begin(), cell_offsets_.end() - 1);
+        }
+        for (std::size_t i = 0; i < boxes_.size(); ++i)
+        {
+            if (!has_box_[i])
+            {
+                continue;
+            }
+            box_type const& b = boxes_[i];
+            std::size_t col0 = cell_index(static_cast<double>(b.min.x));
+            std::size_t col1 = cell_index(static_cast<double>(b.max.x));
+            std::size_t row0 = cell_index(static_cast<double>(b.min.y));
+            std::size_t row1 = cell_index(static_cast<double>(b.max.y));
+            for (std::size_t row = row0; row <= row1; ++row)
+            {
+                for (std::size_t col = col0; col <= col1; ++col)
+                {
+                    std::size_t c = row * cells_per_side_ + col;
+                    if (pass == 0)
+                    {
+                        ++cell_offsets_[c + 1];
+                    }
+                    else
+                    {
+                        cell_features_[fill[c]++] = static_cast<std::uint32_t>(i);
+                    }
+                }
+            }
+        }
+    }
+}
+
+MAPNIK_VECTOR_INLINE std::vector<std::uint32_t> feature_index::query(mapnik::box2d<double> const& box) const
+{
+    std::vector<std::uint32_t> result(always_);
+    if (!box.valid())
+    {
+        return result;
+    }
+    std::size_t col0 = cell_index(box.minx());
+    std::size_t col1 = cell_index(box.maxx());
+    std::size_t row0 = cell_index(box.miny());
+    std::size_t row1 = cell_index(box.maxy());
+    for (std::size_t row = row0; row <= row1; ++row)
+    {
+        for (std::size_t col = col0; col <= col1; ++col)
+        {
+            std::size_t c = row * cells_per_side_ + col;
+            for (std::size_t k = cell_offsets_[c]; k < cell_offsets_[c + 1]; ++k)
+            {
+                std::uint32_t i = cell_features_[k];
+                box_type const& b = boxes_[i];
+                if (static_cast<double>(b.max.x) >= box.minx() &&
+                    static_cast<double>(b.min.x) <= box.maxx() &&
+                    static_cast<double>(b.max.y) >= box.miny() &&
+                    static_cast<double>(b.min.y) <= box.maxy())
+                {
+                    result.push_back(i);
+                }
+            }
+        }
+    }
+    // Features spanning several cells were added once per cell
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
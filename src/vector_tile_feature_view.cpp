@@ -0,0 +1,2 @@
+#include "vector_tile_feature_view.hpp"
+#include "vector_tile_feature_view.ipp"
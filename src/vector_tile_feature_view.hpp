@@ -0,0 +1,257 @@
+#ifndef __MAPNIK_VECTOR_TILE_FEATURE_VIEW_H__
+#define __MAPNIK_VECTOR_TILE_FEATURE_VIEW_H__
+
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+#include "vector_tile_geometry_decoder.hpp"
+
+// mapnik
+#include <mapnik/util/variant.hpp>
+
+// protozero
+#include <protozero/data_view.hpp>
+#include <protozero/pbf_reader.hpp>
+
+// std
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+// A layer value as stored in the tile, strings point into the tile buffer
+using tile_value_view = mapnik::util::variant<protozero::data_view, float, double, std::int64_t, std::uint64_t, bool>;
+
+class feature_view;
+
+/*
+  Read only view of an encoded layer. The keys, values and features of the
+  layer are indexed once when the view is created, nothing is copied out of
+  the tile buffer, which must outlive the view and its features. Features
+  are parsed on demand and do not allocate, which makes this the cheapest
+  way to look at attributes and geometries when mapnik features are not
+  needed, for example to hit test or to count features.
+*/
+
+class layer_view
+{
+public:
+    class const_iterator;
+
+    MAPNIK_VECTOR_INLINE explicit layer_view(protozero::pbf_reader layer);
+
+    protozero::data_view const& name() const
+    {
+        return name_;
+    }
+
+    std::uint32_t extent() const
+    {
+        return extent_;
+    }
+
+    std::uint32_t version() const
+    {
+        return version_;
+    }
+
+    std::size_t keys_size() const
+    {
+        return keys_.size();
+    }
+
+    protozero::data_view const& key(std::size_t index) const
+    {
+        return keys_.at(index);
+    }
+
+    std::size_t values_size() const
+    {
+        return values_.size();
+    }
+
+    tile_value_view const& value(std::size_t index) const
+    {
+        return values_.at(index);
+    }
+
+    std::size_t size() const
+    {
+        return features_.size();
+    }
+
+    bool empty() const
+    {
+        return features_.empty();
+    }
+
+    MAPNIK_VECTOR_INLINE feature_view feature(std::size_t index) const;
+
+    MAPNIK_VECTOR_INLINE const_iterator begin() const;
+
+    MAPNIK_VECTOR_INLINE const_iterator end() const;
+
+private:
+    protozero::data_view name_;
+    std::uint32_t extent_;
+    std::uint32_t version_;
+    std::vector<protozero::data_view> keys_;
+    std::vector<tile_value_view> values_;
+    std::vector<protozero::data_view> features_;
+};
+
+class feature_view
+{
+public:
+    MAPNIK_VECTOR_INLINE feature_view(layer_view const& layer, protozero::data_view const& feature);
+
+    bool has_id() const
+    {
+        return has_id_;
+    }
+
+    std::uint64_t id() const
+    {
+        return id_;
+    }
+
+    // Geometry_Type, or UNKNOWN when the feature does not set one
+    std::int32_t type() const
+    {
+        return type_;
+    }
+
+    bool has_geometry() const
+    {
+        return has_geometry_;
+    }
+
+    // A new cursor over the encoded geometry every time it is called
+    GeometryPBF geometry() const
+    {
+        return GeometryPBF(geometry_);
+    }
+
+    bool has_raster() const
+    {
+        return has_raster_;
+    }
+
+    protozero::data_view const& raster() const
+    {
+        return raster_;
+    }
+
+    // Calls func(protozero::data_view const& key, tile_value_view const& value) for
+    // every tag of the feature in the order they are encoded, nothing is decoded
+    // beyond the tag indexes. Tags with indexes missing from a version 1 layer are
+    // skipped, in a version 2 layer they are an error.
+    template <typename Func>
+    void for_each_tag(Func && func) const
+    {
+        for (auto itr = tags_.begin(); itr != tags_.end();)
+        {
+            std::size_t key_index = *(itr++);
+            if (itr == tags_.end())
+            {
+                throw std::runtime_error("Vector Tile has a feature with an odd number of tags, therefore the tile is invalid.");
+            }
+            std::size_t value_index = *(itr++);
+            if (key_index < layer_->keys_size() && value_index < layer_->values_size())
+            {
+                func(layer_->key(key_index), layer_->value(value_index));
+            }
+            else if (layer_->version() == 2)
+            {
+                throw std::runtime_error("Vector Tile has a feature with repeated attributes with an invalid key or value as it does not appear in the layer. This is invalid according to the Mapbox Vector Tile Specification Version 2");
+            }
+        }
+    }
+
+    // Value of the tag with the given key or nullptr when the feature does not have it
+    tile_value_view const* get(std::string const& key) const
+    {
+        tile_value_view const* result = nullptr;
+        for_each_tag([&](protozero::data_view const& k, tile_value_view const& v) {
+            if (!result && k.size() == key.size() && std::memcmp(k.data(), key.data(), key.size()) == 0)
+            {
+                result = &v;
+            }
+        });
+        return result;
+    }
+
+private:
+    layer_view const* layer_;
+    protozero::iterator_range<protozero::pbf_reader::const_uint32_iterator> tags_;
+    GeometryPBF::pbf_itr geometry_;
+    protozero::data_view raster_;
+    std::uint64_t id_;
+    std::int32_t type_;
+    bool has_id_;
+    bool has_geometry_;
+    bool has_raster_;
+};
+
+class layer_view::const_iterator
+{
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = feature_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = feature_view const*;
+    using reference = feature_view;
+
+    const_iterator(layer_view const& layer, std::size_t index)
+        : layer_(&layer),
+          index_(index) {}
+
+    feature_view operator*() const
+    {
+        return layer_->feature(index_);
+    }
+
+    const_iterator & operator++()
+    {
+        ++index_;
+        return *this;
+    }
+
+    const_iterator operator++(int)
+    {
+        const_iterator tmp(*this);
+        ++index_;
+        return tmp;
+    }
+
+    bool operator==(const_iterator const& rhs) const
+    {
+        return layer_ == rhs.layer_ && index_ == rhs.index_;
+    }
+
+    bool operator!=(const_iterator const& rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+private:
+    layer_view const* layer_;
+    std::size_t index_;
+};
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
+
+#if !defined(MAPNIK_VECTOR_TILE_LIBRARY)
+#include "vector_tile_feature_view.ipp"
+#endif
+
+#endif // __MAPNIK_VECTOR_TILE_FEATURE_VIEW_H__
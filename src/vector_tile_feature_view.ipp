@@ -0,0 +1,182 @@
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+
+// protozero
+#include <protozero/pbf_reader.hpp>
+
+// std
+#include <stdexcept>
+#include <string>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+MAPNIK_VECTOR_INLINE layer_view::layer_view(protozero::pbf_reader layer)
+    : name_(),
+      extent_(4096), // default for version 1
+      version_(1), // Version == 1 is the default because it was not required until v2 to have this field
+      keys_(),
+      values_(),
+      features_()
+{
+    bool has_name = false;
+    bool has_extent = false;
+    while (layer.next())
+    {
+        switch (layer.tag())
+        {
+            case Layer_Encoding::NAME:
+                name_ = layer.get_view();
+                has_name = true;
+                break;
+            case Layer_Encoding::FEATURES:
+                features_.push_back(layer.get_view());
+                break;
+            case Layer_Encoding::KEYS:
+                keys_.push_back(layer.get_view());
+                break;
+            case Layer_Encoding::VALUES:
+            {
+                protozero::pbf_reader val_msg = layer.get_message();
+                while (val_msg.next())
+                {
+                    switch (val_msg.tag())
+                    {
+                        case Value_Encoding::STRING:
+                            values_.emplace_back(val_msg.get_view());
+                            break;
+                        case Value_Encoding::FLOAT:
+                            values_.emplace_back(val_msg.get_float());
+                            break;
+                        case Value_Encoding::DOUBLE:
+                            values_.emplace_back(val_msg.get_double());
+                            break;
+                        case Value_Encoding::INT:
+                            values_.emplace_back(val_msg.get_int64());
+                            break;
+                        case Value_Encoding::UINT:
+                            values_.emplace_back(val_msg.get_uint64());
+                            break;
+                        case Value_Encoding::SINT:
+                            values_.emplace_back(val_msg.get_sint64());
+                            break;
+                        case Value_Encoding::BOOL:
+                            values_.emplace_back(val_msg.get_bool());
+                            break;
+                        default:
+                            throw std::runtime_error("unknown Value type " + std::to_string(val_msg.tag()) + " in layer.values");
+                    }
+                }
+                break;
+            }
+            case Layer_Encoding::EXTENT:
+                extent_ = layer.get_uint32();
+                if (extent_ == 0)
+                {
+                    throw std::runtime_error("Zero layer extent");
+                }
+                has_extent = true;
+                break;
+            case Layer_Encoding::VERSION:
+                version_ = layer.get_uint32();
+                break;
+            default:
+                throw std::runtime_error("unknown field type " + std::to_string(layer.tag()) + " in layer");
+        }
+    }
+    if (!has_name)
+    {
+        throw std::runtime_error("The required name field is missing in a vector tile layer.");
+    }
+    if (version_ == 2 && !has_extent)
+    {
+        throw std::runtime_error("The required extent field is missing in the layer " + std::string(name_.data(), name_.size()) + ". Tile does not comply with Version 2 of the Mapbox Vector Tile Specification.");
+    }
+}
+
+MAPNIK_VECTOR_INLINE feature_view layer_view::feature(std::size_t index) const
+{
+    return feature_view(*this, features_.at(index));
+}
+
+MAPNIK_VECTOR_INLINE layer_view::const_iterator layer_view::begin() const
+{
+    return const_iterator(*this, 0);
+}
+
+MAPNIK_VECTOR_INLINE layer_view::const_iterator layer_view::end() const
+{
+    return const_iterator(*this, features_.size());
+}
+
+MAPNIK_VECTOR_INLINE feature_view::feature_view(layer_view const& layer, protozero::data_view const& feature)
+    : layer_(&layer),
+      tags_(),
+      geometry_(),
+      raster_(),
+      id_(0),
+      type_(Geometry_Type::UNKNOWN),
+      has_id_(false),
+      has_geometry_(false),
+      has_raster_(false)
+{
+    protozero::pbf_reader f(feature);
+    while (f.next())
+    {
+        switch (f.tag())
+        {
+            case Feature_Encoding::ID:
+                id_ = f.get_uint64();
+                has_id_ = true;
+                break;
+            case Feature_Encoding::TAGS:
+                tags_ = f.get_packed_uint32();
+                break;
+            case Feature_Encoding::TYPE:
+                type_ = f.get_enum();
+                switch (type_)
+                {
+                    case Geometry_Type::POINT:
+                    case Geometry_Type::LINESTRING:
+                    case Geometry_Type::POLYGON:
+                        break;
+                    default:
+                        throw std::runtime_error("Vector tile has an unknown geometry type " + std::to_string(type_) + " in feature");
+                }
+                break;
+            case Feature_Encoding::GEOMETRY:
+                if (has_raster_)
+                {
+                    throw std::runtime_error("Vector Tile has a feature with a geometry and a raster, it must have only one of them");
+                }
+                if (has_geometry_)
+                {
+                    throw std::runtime_error("Vector Tile has a feature with multiple geometry fields, it must have only one of them");
+                }
+                has_geometry_ = true;
+                geometry_ = f.get_packed_uint32();
+                break;
+            case Feature_Encoding::RASTER:
+                if (has_geometry_)
+                {
+                    throw std::runtime_error("Vector Tile has a feature with a geometry and a raster, it must have only one of them");
+                }
+                if (has_raster_)
+                {
+                    throw std::runtime_error("Vector Tile has a feature with multiple raster fields, it must have only one of them");
+                }
+                has_raster_ = true;
+                raster_ = f.get_view();
+                break;
+            default:
+                throw std::runtime_error("Vector Tile contains unknown field type " + std::to_string(f.tag()) +" in feature");
+        }
+    }
+}
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
@@ -9,10 +9,14 @@
 #include <mapnik/featureset.hpp>
 #include <mapnik/unicode.hpp>
 #include <mapnik/util/variant.hpp>
+#include <mapnik/value.hpp>
 #include <mapnik/view_transform.hpp>
 
 // std
+#include <cstdint>
 #include <set>
+#include <utility>
+#include <vector>
 
 namespace mapnik
 {
@@ -27,6 +31,8 @@ template <typename Filter>
 class tile_featureset_pbf : public Featureset
 {
 public:
+    // layer_values is only read when attribute_names matches a key and may be
+    // left empty otherwise, num_values is the number of values of the layer.
     tile_featureset_pbf(Filter const& filter,
                     mapnik::box2d<double> const& tile_extent,
                     mapnik::box2d<double> const& unbuffered_query,
@@ -36,20 +42,34 @@ public:
                     double tile_y,
                     double scale,
                     std::vector<std::string> const& layer_keys,
-                    layer_pbf_attr_type const& layer_values,
+                    std::vector<mapnik::value> const& layer_values,
+                    std::size_t num_values,
                     unsigned version);
 
     virtual ~tile_featureset_pbf() {}
 
     feature_ptr next();
 
+    // Restricts the featureset to the features at these positions in the layer,
+    // which must be in increasing order. Feature ids still default to the position.
+    void set_candidates(std::vector<std::uint32_t> && candidates)
+    {
+        candidates_ = std::move(candidates);
+        use_candidates_ = true;
+    }
+
 private:
+    using tag_range_type = protozero::iterator_range<protozero::pbf_reader::const_uint32_iterator>;
+
+    void check_tags(tag_range_type const& tags) const;
+    void put_attributes(mapnik::feature_impl & feature, tag_range_type const& tags);
+
     Filter filter_;
     mapnik::box2d<double> tile_extent_;
     mapnik::box2d<double> unbuffered_query_;
     std::vector<protozero::pbf_reader> const& features_;
     std::vector<std::string> const& layer_keys_;
-    layer_pbf_attr_type const& layer_values_;
+    std::vector<mapnik::value> const& layer_values_;
     std::size_t num_keys_;
     std::size_t num_values_;
     double tile_x_;
@@ -57,8 +77,17 @@ private:
     double scale_;
     unsigned itr_;
     unsigned version_;
-    mapnik::transcoder tr_;
     mapnik::context_ptr ctx_;
+    // Keys of the layer that were asked for by the query
+    std::vector<bool> requested_keys_;
+    std::size_t requested_keys_count_;
+    std::vector<std::uint32_t> candidates_;
+    bool use_candidates_;
+    // False when the query covers the whole tile, the bounding box of a feature
+    // then rarely rejects it and computing it is only overhead.
+    bool cull_features_;
+    // Unpacked geometry of the current feature, kept to reuse its memory
+    std::vector<std::uint32_t> geometry_buffer_;
 };
 
 } // end ns vector_tile_impl
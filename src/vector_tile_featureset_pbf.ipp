@@ -33,7 +33,8 @@ tile_featureset_pbf<Filter>::tile_featureset_pbf(Filter const& filter,
                                                  double tile_y,
                                                  double scale,
                                                  std::vector<std::string> const& layer_keys,
-                                                 layer_pbf_attr_type const& layer_values,
+                                                 std::vector<mapnik::value> const& layer_values,
+                                                 std::size_t num_values,
                                                  unsigned version)
         : filter_(filter),
           tile_extent_(tile_extent),
@@ -42,88 +43,93 @@ tile_featureset_pbf<Filter>::tile_featureset_pbf(Filter const& filter,
           layer_keys_(layer_keys),
           layer_values_(layer_values),
           num_keys_(layer_keys_.size()),
-          num_values_(layer_values_.size()),
+          num_values_(num_values),
           tile_x_(tile_x),
           tile_y_(tile_y),
           scale_(scale),
           itr_(0),
           version_(version),
-          tr_("utf-8"),
-          ctx_(std::make_shared<mapnik::context_type>())
+          ctx_(std::make_shared<mapnik::context_type>()),
+          requested_keys_(num_keys_, false),
+          requested_keys_count_(0),
+          candidates_(),
+          use_candidates_(false),
+          cull_features_(!filter_.box_.contains(tile_extent_)),
+          geometry_buffer_()
 {
     std::set<std::string>::const_iterator pos = attribute_names.begin();
     std::set<std::string>::const_iterator end = attribute_names.end();
     for ( ;pos !=end; ++pos)
     {
-        for (auto const& key : layer_keys_)
+        bool found = false;
+        for (std::size_t i = 0; i < num_keys_; ++i)
         {
-            if (key == *pos)
+            if (layer_keys_[i] == *pos)
             {
-                ctx_->push(*pos);
-                break;
+                if (!found)
+                {
+                    ctx_->push(*pos);
+                    found = true;
+                }
+                requested_keys_[i] = true;
+                ++requested_keys_count_;
             }
         }
     }
 }
 
-struct value_visitor
+template <typename Filter>
+void tile_featureset_pbf<Filter>::check_tags(tag_range_type const& tags) const
 {
-    mapnik::transcoder & tr_;
-    mapnik::feature_ptr & feature_;
-    std::string const& name_;
-
-    value_visitor(mapnik::transcoder & tr,
-                  mapnik::feature_ptr & feature,
-                  std::string const& name)
-        : tr_(tr),
-          feature_(feature),
-          name_(name) {}
-
-    void operator() (std::string const& val)
-    {
-        feature_->put(name_, tr_.transcode(val.data(), val.length()));
-    }
-
-    void operator() (bool const& val)
-    {
-        feature_->put(name_, static_cast<mapnik::value_bool>(val));
-    }
-
-    void operator() (int64_t const& val)
+    std::size_t count = 0;
+    for (auto _i = tags.begin(); _i != tags.end(); ++_i, ++count)
     {
-        feature_->put(name_, static_cast<mapnik::value_integer>(val));
-    }
-
-    void operator() (uint64_t const& val)
-    {
-        feature_->put(name_, static_cast<mapnik::value_integer>(val));
+        if (version_ == 2
+            && *_i >= ((count % 2 == 0) ? num_keys_ : num_values_))
+        {
+            throw std::runtime_error("Vector Tile has a feature with repeated attributes with an invalid key or value as it does not appear in the layer. This is invalid according to the Mapbox Vector Tile Specification Version 2");
+        }
     }
-
-    void operator() (double const& val)
+    if (count % 2 != 0)
     {
-        feature_->put(name_, static_cast<mapnik::value_double>(val));
+        throw std::runtime_error("Vector Tile has a feature with an odd number of tags, therefore the tile is invalid.");
     }
+}
 
-    void operator() (float const& val)
+template <typename Filter>
+void tile_featureset_pbf<Filter>::put_attributes(mapnik::feature_impl & feature, tag_range_type const& tags)
+{
+    // The tags were already checked by check_tags
+    for (auto _i = tags.begin(); _i != tags.end();)
     {
-        feature_->put(name_, static_cast<mapnik::value_double>(val));
+        std::size_t key_name = *(_i++);
+        std::size_t key_value = *(_i++);
+        if (key_name < num_keys_
+            && key_value < num_values_
+            && requested_keys_[key_name])
+        {
+            feature.put(layer_keys_[key_name], layer_values_[key_value]);
+        }
     }
-};
+}
 
 template <typename Filter>
 feature_ptr tile_featureset_pbf<Filter>::next()
 {
-    while ( itr_ < features_.size() )
+    std::size_t const end = use_candidates_ ? candidates_.size() : features_.size();
+    while ( itr_ < end )
     {
-        protozero::pbf_reader f = features_.at(itr_);
+        std::size_t const index = use_candidates_ ? candidates_[itr_] : itr_;
+        protozero::pbf_reader f = features_.at(index);
         // TODO: auto-increment feature id counter here
-        mapnik::feature_ptr feature = mapnik::feature_factory::create(ctx_,itr_);
+        mapnik::value_integer feature_id = static_cast<mapnik::value_integer>(index);
 
         ++itr_;
         int32_t geometry_type = 0; // vector_tile::Tile_GeomType_UNKNOWN
         bool has_geometry = false;
         bool has_geometry_type = false;
-        GeometryPBF::pbf_itr geom_itr;
+        protozero::data_view geom_view;
+        tag_range_type tags;
         bool has_raster = false;
         std::unique_ptr<mapnik::image_reader> reader;
         while (f.next())
@@ -131,36 +137,14 @@ feature_ptr tile_featureset_pbf<Filter>::next()
             switch(f.tag())
             {
                 case 1:
-                    feature->set_id(f.get_uint64());
+                    feature_id = static_cast<mapnik::value_integer>(f.get_uint64());
                     break;
                 case 2:
-                    {
-                        auto tag_iterator = f.get_packed_uint32();
-                        for (auto _i = tag_iterator.begin(); _i != tag_iterator.end();)
-                        {
-                            std::size_t key_name = *(_i++);
-                            if (_i == tag_iterator.end())
-                            {
-                                throw std::runtime_error("Vector Tile has a feature with an odd number of tags, therefore the tile is invalid.");
-                            }
-                            std::size_t key_value = *(_i++);
-                            if (key_name < num_keys_
-                                && key_value < num_values_)
-                            {
-                                std::string const& name = layer_keys_.at(key_name);
-                                if (feature->has_key(name))
-                                {
-                                    pbf_attr_value_type val = layer_values_.at(key_value);
-                                    value_visitor vv(tr_, feature, name);
-                                    mapnik::util::apply_visitor(vv, val);
-                                }
-                            }
-                            else if (version_ == 2)
-                            {
-                                throw std::runtime_error("Vector Tile has a feature with repeated attributes with an invalid key or value as it does not appear in the layer. This is invalid according to the Mapbox Vector Tile Specification Version 2");
-                            }
-                        }
-                    }
+                    // The tags are checked for every feature read, whatever the
+                    // query, but attributes are only put once the feature is
+                    // known to be returned
+                    tags = f.get_packed_uint32();
+                    check_tags(tags);
                     break;
                 case 3:
                     has_geometry_type = true;
@@ -200,13 +184,49 @@ feature_ptr tile_featureset_pbf<Filter>::next()
                         throw std::runtime_error("Vector Tile has a feature with multiple geometry fields, it must have only one of them");
                     }
                     has_geometry = true;
-                    geom_itr = f.get_packed_uint32();
+                    geom_view = f.get_view();
                     break;
                 default:
                     throw std::runtime_error("Vector Tile contains unknown field type " + std::to_string(f.tag()) +" in feature");
 
             }
         }
+        if (has_geometry && has_geometry_type && !has_raster)
+        {
+            // The command stream is unpacked once into a buffer shared by all features
+            try
+            {
+                decode_packed_uint32(geom_view, geometry_buffer_);
+            }
+            catch (std::exception const&)
+            {
+                if (version_ != 1)
+                {
+                    throw;
+                }
+                // For v1 any invalid geometry errors lets just skip the feature
+                continue;
+            }
+            // Reject features outside of the query from their bounding box alone,
+            // before anything is allocated for them. Malformed geometries are left
+            // to decode_geometry so they are reported the same way as before. When
+            // the query covers the tile, decode_geometry alone drops the features
+            // that only lie in the buffer of the tile outside of the query.
+            mapbox::geometry::box<std::int64_t> bbox(mapbox::geometry::point<std::int64_t>(0, 0),
+                                                     mapbox::geometry::point<std::int64_t>(0, 0));
+            if (cull_features_ && decode_geometry_bbox(geometry_buffer_, bbox))
+            {
+                mapnik::box2d<double> envelope(tile_x_ + static_cast<double>(bbox.min.x) / scale_,
+                                               tile_y_ - static_cast<double>(bbox.max.y) / scale_,
+                                               tile_x_ + static_cast<double>(bbox.max.x) / scale_,
+                                               tile_y_ - static_cast<double>(bbox.min.y) / scale_);
+                if (!filter_.pass(envelope))
+                {
+                    continue;
+                }
+            }
+        }
+        mapnik::feature_ptr feature = mapnik::feature_factory::create(ctx_, feature_id);
         if (has_raster)
         {
             if (reader.get())
@@ -254,6 +274,7 @@ feature_ptr tile_featureset_pbf<Filter>::next()
                     }
                 }
             }
+            put_attributes(*feature, tags);
             return feature;
         }
         else if (has_geometry)
@@ -271,7 +292,7 @@ feature_ptr tile_featureset_pbf<Filter>::next()
             }
             if (version_ != 1)
             {
-                mapnik::vector_tile_impl::GeometryPBF geoms(geom_itr);
+                mapnik::vector_tile_impl::GeometryPBF geoms(geometry_buffer_);
                 mapnik::geometry::geometry<double> geom = decode_geometry<double>(geoms, geometry_type, version_, tile_x_, tile_y_, scale_, -1.0 * scale_, filter_.box_);
                 if (geom.is<mapnik::geometry::geometry_empty>())
                 {
@@ -286,13 +307,14 @@ feature_ptr tile_featureset_pbf<Filter>::next()
                 }
                 #endif
                 feature->set_geometry(std::move(geom));
+                put_attributes(*feature, tags);
                 return feature;
             }
             else
             {
                 try
                 {
-                    mapnik::vector_tile_impl::GeometryPBF geoms(geom_itr);
+                    mapnik::vector_tile_impl::GeometryPBF geoms(geometry_buffer_);
                     mapnik::geometry::geometry<double> geom = decode_geometry<double>(geoms, geometry_type, version_, tile_x_, tile_y_, scale_, -1.0 * scale_, filter_.box_);
                     if (geom.is<mapnik::geometry::geometry_empty>())
                     {
@@ -313,6 +335,7 @@ feature_ptr tile_featureset_pbf<Filter>::next()
                     // For v1 any invalid geometry errors lets just skip the feature
                     continue;
                 }
+                put_attributes(*feature, tags);
                 return feature;
             }
         }
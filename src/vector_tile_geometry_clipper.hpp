@@ -8,12 +8,11 @@
 #include <mapbox/geometry/wagyu/quick_clip.hpp>
 #include <mapbox/geometry/wagyu/wagyu.hpp>
 
-// boost
-#pragma GCC diagnostic push
-#include <mapnik/warning_ignore.hpp>
-#include <boost/geometry/algorithms/intersection.hpp>
-#include <boost/geometry/algorithms/unique.hpp>
-#pragma GCC diagnostic pop
+// std
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <vector>
 
 namespace mapnik
 {
@@ -75,6 +74,149 @@ mapbox::geometry::linear_ring<T> box_to_ring(mapbox::geometry::box<T> const& box
     return ring; // RVO
 }
 
+template <typename T>
+void remove_repeated_points(mapbox::geometry::line_string<T> & line)
+{
+    line.erase(std::unique(line.begin(), line.end()), line.end());
+}
+
+template <typename T>
+mapbox::geometry::box<T> points_envelope(std::vector<mapbox::geometry::point<T>> const& points)
+{
+    mapbox::geometry::box<T> bbox(points.front(), points.front());
+    for (auto const& pt : points)
+    {
+        bbox.min.x = std::min(bbox.min.x, pt.x);
+        bbox.min.y = std::min(bbox.min.y, pt.y);
+        bbox.max.x = std::max(bbox.max.x, pt.x);
+        bbox.max.y = std::max(bbox.max.y, pt.y);
+    }
+    return bbox;
+}
+
+template <typename T>
+bool box_within(mapbox::geometry::box<T> const& inner, mapbox::geometry::box<T> const& outer)
+{
+    return inner.min.x >= outer.min.x && inner.max.x <= outer.max.x &&
+           inner.min.y >= outer.min.y && inner.max.y <= outer.max.y;
+}
+
+template <typename T>
+bool box_disjoint(mapbox::geometry::box<T> const& a, mapbox::geometry::box<T> const& b)
+{
+    return a.max.x < b.min.x || a.min.x > b.max.x || a.max.y < b.min.y || a.min.y > b.max.y;
+}
+
+// Liang-Barsky clipping of the segment a-b, the ends of the part inside the
+// box are written to p and q. Sets exits when the segment leaves the box
+// before reaching b.
+template <typename T>
+bool clip_segment(mapbox::geometry::point<T> const& a,
+                  mapbox::geometry::point<T> const& b,
+                  mapbox::geometry::box<T> const& box,
+                  mapbox::geometry::point<T> & p,
+                  mapbox::geometry::point<T> & q,
+                  bool & exits)
+{
+    double dx = static_cast<double>(b.x - a.x);
+    double dy = static_cast<double>(b.y - a.y);
+    double t0 = 0.0;
+    double t1 = 1.0;
+    // The segment is inside the edge where denom * t <= num
+    auto edge = [&t0, &t1](double denom, double num) {
+        if (denom == 0.0)
+        {
+            return num >= 0.0;
+        }
+        double t = num / denom;
+        if (denom > 0.0)
+        {
+            if (t < t0)
+            {
+                return false;
+            }
+            t1 = std::min(t1, t);
+        }
+        else
+        {
+            if (t > t1)
+            {
+                return false;
+            }
+            t0 = std::max(t0, t);
+        }
+        return true;
+    };
+    if (!edge(-dx, static_cast<double>(a.x - box.min.x)) ||
+        !edge(dx, static_cast<double>(box.max.x - a.x)) ||
+        !edge(-dy, static_cast<double>(a.y - box.min.y)) ||
+        !edge(dy, static_cast<double>(box.max.y - a.y)))
+    {
+        return false;
+    }
+    p = a;
+    if (t0 > 0.0)
+    {
+        p.x = a.x + static_cast<T>(std::llround(t0 * dx));
+        p.y = a.y + static_cast<T>(std::llround(t0 * dy));
+    }
+    q = b;
+    exits = t1 < 1.0;
+    if (exits)
+    {
+        q.x = a.x + static_cast<T>(std::llround(t1 * dx));
+        q.y = a.y + static_cast<T>(std::llround(t1 * dy));
+    }
+    return true;
+}
+
+// Appends to result the parts of line inside the box, in order. A new part
+// starts every time the line enters the box again.
+template <typename T>
+void clip_line(mapbox::geometry::line_string<T> const& line,
+               mapbox::geometry::box<T> const& box,
+               mapbox::geometry::multi_line_string<T> & result)
+{
+    bool open = false;
+    mapbox::geometry::point<T> p;
+    mapbox::geometry::point<T> q;
+    for (std::size_t i = 1; i < line.size(); ++i)
+    {
+        bool exits = false;
+        if (!clip_segment(line[i - 1], line[i], box, p, q, exits))
+        {
+            open = false;
+            continue;
+        }
+        if (!open || result.back().back() != p)
+        {
+            // A part made of a single point is replaced by the next one
+            if (result.empty() || result.back().size() > 1)
+            {
+                result.emplace_back();
+            }
+            else
+            {
+                result.back().clear();
+            }
+            result.back().push_back(p);
+            open = true;
+        }
+        if (result.back().back() != q)
+        {
+            result.back().push_back(q);
+        }
+        if (exits)
+        {
+            open = false;
+        }
+    }
+    if (!result.empty() && result.back().size() < 2)
+    {
+        result.pop_back();
+    }
+}
+
 } // end ns detail
 
 template <typename NextProcessor>
@@ -88,6 +230,11 @@ private:
     bool multi_polygon_union_;
     polygon_fill_type fill_type_;
     bool process_all_rings_;
+    bool trusted_input_;
+    // Reused for every geometry, the clipper is meant to live for a whole layer
+    mapbox::geometry::multi_line_string<std::int64_t> lines_;
+    mapbox::geometry::multi_polygon<std::int64_t> mp_;
+    mapbox::geometry::multi_polygon<std::int64_t> tmp_mp_;
 public:
     geometry_clipper(mapbox::geometry::box<std::int64_t> const& tile_clipping_extent,
                      double area_threshold,
@@ -95,6 +242,7 @@ public:
                      bool multi_polygon_union,
                      polygon_fill_type fill_type,
                      bool process_all_rings,
+                     bool trusted_input,
                      NextProcessor & next) :
               next_(next),
               tile_clipping_extent_(tile_clipping_extent),
@@ -102,10 +250,76 @@ public:
               strictly_simple_(strictly_simple),
               multi_polygon_union_(multi_polygon_union),
               fill_type_(fill_type),
-              process_all_rings_(process_all_rings)
+              process_all_rings_(process_all_rings),
+              trusted_input_(trusted_input),
+              lines_(),
+              mp_(),
+              tmp_mp_()
+    {
+    }
+
+private:
+    // Valid polygons, as promised by trusted input, that are entirely inside the
+    // clipping extent would come out of wagyu unchanged but for orientation and
+    // the removal of small rings, so only that is done for them.
+    bool is_trusted_interior(mapbox::geometry::polygon<std::int64_t> const& poly) const
+    {
+        return trusted_input_ &&
+               !poly.empty() &&
+               poly.front().size() >= 3 &&
+               detail::box_within(detail::points_envelope(poly.front()), tile_clipping_extent_);
+    }
+
+    void close_ring(mapbox::geometry::linear_ring<std::int64_t> & ring) const
     {
+        if (ring.front() != ring.back())
+        {
+            ring.push_back(ring.front());
+        }
+    }
+
+    // Returns false when the exterior ring is too small to be kept
+    bool fix_trusted_interior(mapbox::geometry::polygon<std::int64_t> & poly) const
+    {
+        auto & exterior = poly.front();
+        double area = detail::area(exterior);
+        if ((std::abs(area) < area_threshold_) && !process_all_rings_)
+        {
+            return false;
+        }
+        if (area < 0)
+        {
+            std::reverse(exterior.begin(), exterior.end());
+        }
+        close_ring(exterior);
+        auto kept = std::next(poly.begin());
+        for (auto ring = std::next(poly.begin()); ring != poly.end(); ++ring)
+        {
+            if (ring->size() < 3)
+            {
+                continue;
+            }
+            double ring_area = detail::area(*ring);
+            if (std::abs(ring_area) < area_threshold_)
+            {
+                continue;
+            }
+            if (ring_area > 0)
+            {
+                std::reverse(ring->begin(), ring->end());
+            }
+            close_ring(*ring);
+            if (kept != ring)
+            {
+                kept->swap(*ring);
+            }
+            ++kept;
+        }
+        poly.erase(kept, poly.end());
+        return true;
     }
 
+public:
     void operator() (mapbox::geometry::point<std::int64_t> & geom)
     {
         next_(geom);
@@ -129,14 +343,24 @@ public:
 
     void operator() (mapbox::geometry::line_string<std::int64_t> & geom)
     {
-        boost::geometry::unique(geom);
+        detail::remove_repeated_points(geom);
         if (geom.size() < 2)
         {
             return;
         }
-        mapbox::geometry::multi_line_string<int64_t> result;
-        auto clip_box = detail::box_to_ring(tile_clipping_extent_);
-        boost::geometry::intersection(clip_box, geom, result);
+        auto bbox = detail::points_envelope(geom);
+        if (detail::box_within(bbox, tile_clipping_extent_))
+        {
+            next_(geom);
+            return;
+        }
+        if (detail::box_disjoint(bbox, tile_clipping_extent_))
+        {
+            return;
+        }
+        mapbox::geometry::multi_line_string<int64_t> & result = lines_;
+        result.clear();
+        detail::clip_line(geom, tile_clipping_extent_, result);
         if (result.empty())
         {
             return;
@@ -151,16 +375,39 @@ public:
             return;
         }
 
-        auto clip_box = detail::box_to_ring(tile_clipping_extent_);
-        boost::geometry::unique(geom);
-        mapbox::geometry::multi_line_string<int64_t> results;
+        bool all_within = true;
+        for (auto & line : geom)
+        {
+            detail::remove_repeated_points(line);
+            if (line.size() < 2)
+            {
+                all_within = false;
+                continue;
+            }
+            all_within = all_within && detail::box_within(detail::points_envelope(line), tile_clipping_extent_);
+        }
+        if (all_within)
+        {
+            next_(geom);
+            return;
+        }
+        mapbox::geometry::multi_line_string<int64_t> & results = lines_;
+        results.clear();
         for (auto const& line : geom)
         {
             if (line.size() < 2)
             {
                continue;
             }
-            boost::geometry::intersection(clip_box, line, results);
+            auto bbox = detail::points_envelope(line);
+            if (detail::box_within(bbox, tile_clipping_extent_))
+            {
+                results.push_back(line);
+            }
+            else if (!detail::box_disjoint(bbox, tile_clipping_extent_))
+            {
+                detail::clip_line(line, tile_clipping_extent_, results);
+            }
         }
         if (results.empty())
         {
@@ -176,6 +423,22 @@ public:
             return;
         }
 
+        if (is_trusted_interior(geom))
+        {
+            if (!fix_trusted_interior(geom))
+            {
+                return;
+            }
+            mapbox::geometry::multi_polygon<std::int64_t> & mp = mp_;
+            mp.clear();
+            mp.emplace_back();
+            mp.back().swap(geom);
+            next_(mp);
+            // Hand the rings back to the caller so their memory is reused
+            geom.swap(mp.back());
+            return;
+        }
+
         mapbox::geometry::wagyu::wagyu<std::int64_t> clipper;
         bool first = true;
         for (auto & ring : geom) {
@@ -223,7 +486,8 @@ public:
             }
         }
 
-        mapbox::geometry::multi_polygon<std::int64_t> mp;
+        mapbox::geometry::multi_polygon<std::int64_t> & mp = mp_;
+        mp.clear();
 
         clipper.execute(mapbox::geometry::wagyu::clip_type_union,
                         mp,
@@ -244,8 +508,24 @@ public:
             return;
         }
 
-        mapbox::geometry::multi_polygon<std::int64_t> mp;
-        if (multi_polygon_union_)
+        mapbox::geometry::multi_polygon<std::int64_t> & mp = mp_;
+        mp.clear();
+        // Polygons of a valid multi polygon do not overlap, so when they are all
+        // inside the extent there is nothing to union either.
+        if (std::all_of(geom.begin(), geom.end(), [this](mapbox::geometry::polygon<std::int64_t> const& poly) {
+                return is_trusted_interior(poly);
+            }))
+        {
+            for (auto & poly : geom)
+            {
+                if (fix_trusted_interior(poly))
+                {
+                    mp.emplace_back();
+                    mp.back().swap(poly);
+                }
+            }
+        }
+        else if (multi_polygon_union_)
         {
             mapbox::geometry::wagyu::wagyu<std::int64_t> clipper;
             for (auto & poly : geom)
@@ -305,7 +585,8 @@ public:
             for (auto & poly : geom)
             {
                 mapbox::geometry::wagyu::wagyu<std::int64_t> clipper;
-                mapbox::geometry::multi_polygon<std::int64_t> tmp_mp;
+                mapbox::geometry::multi_polygon<std::int64_t> & tmp_mp = tmp_mp_;
+                tmp_mp.clear();
                 bool first = true;
                 for (auto & ring : poly) {
                     if (ring.size() < 3)
@@ -354,7 +635,7 @@ public:
                                 tmp_mp,
                                 detail::get_wagyu_fill_type(fill_type_),
                                 mapbox::geometry::wagyu::fill_type_even_odd);
-                mp.insert(mp.end(), tmp_mp.begin(), tmp_mp.end());
+                mp.insert(mp.end(), std::make_move_iterator(tmp_mp.begin()), std::make_move_iterator(tmp_mp.end()));
             }
         }
 
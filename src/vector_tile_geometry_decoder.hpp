@@ -17,6 +17,7 @@
 #include <algorithm>
 #include <cmath>
 #include <stdexcept>
+#include <vector>
 
 namespace mapnik
 {
@@ -35,6 +36,14 @@ public:
 
     explicit GeometryPBF(pbf_itr const& geo_iterator);
 
+    // Unpacks the whole packed geometry field at once into buffer, which is reused
+    // from one geometry to the next and must outlive this object.
+    GeometryPBF(protozero::data_view const& data, std::vector<std::uint32_t> & buffer);
+
+    // Reads a geometry already unpacked by decode_packed_uint32, values must
+    // outlive this object.
+    explicit GeometryPBF(std::vector<std::uint32_t> const& values);
+
     enum command : uint8_t
     {
         end = 0,
@@ -53,8 +62,43 @@ public:
     command ring_next(value_type & rx, value_type & ry, bool skip_lineto_zero);
 
 private:
+    bool has_next() const
+    {
+        return values_ ? pos_ < size_ : geo_itr_ != geo_end_itr_;
+    }
+
+    std::uint32_t next_value()
+    {
+        if (values_)
+        {
+            return values_[pos_++];
+        }
+        return static_cast<std::uint32_t>(*geo_itr_++);
+    }
+
+    void next_delta(std::int32_t & dx, std::int32_t & dy)
+    {
+        if (values_ ? size_ - pos_ < 2 : geo_itr_ == geo_end_itr_)
+        {
+            throw std::runtime_error("Vector Tile has a geometry command that is not followed by enough parameters");
+        }
+        dx = protozero::decode_zigzag32(next_value());
+        if (!has_next())
+        {
+            throw std::runtime_error("Vector Tile has a geometry command that is not followed by enough parameters");
+        }
+        dy = protozero::decode_zigzag32(next_value());
+    }
+
+    // Used when constructed from a pbf_itr, the varints are then decoded as
+    // they are read and nothing is copied.
     iterator_type geo_itr_;
     iterator_type geo_end_itr_;
+    // Used when constructed from unpacked values, null otherwise. Positions
+    // are indexes so that copies of this object stay valid.
+    std::uint32_t const* values_;
+    std::size_t pos_;
+    std::size_t size_;
     value_type x, y;
     value_type ox, oy;
     uint32_t length;
@@ -84,6 +128,26 @@ MAPNIK_VECTOR_INLINE mapnik::geometry::geometry<value_type> decode_geometry(Geom
                                                                             double scale_x,
                                                                             double scale_y);
 
+// Unpacks a packed uint32 field into values, replacing their previous content.
+MAPNIK_VECTOR_INLINE void decode_packed_uint32(protozero::data_view const& data, std::vector<std::uint32_t> & values);
+
+// Computes the bounding box, in tile coordinates, of an encoded geometry by only
+// accumulating the command stream, no geometry is built. Returns false when the
+// geometry has no vertices or its command stream is malformed.
+MAPNIK_VECTOR_INLINE bool decode_geometry_bbox(GeometryPBF::pbf_itr const& geo_iterator,
+                                               mapbox::geometry::box<std::int64_t> & bbox);
+
+// Same as above and also counts the vertices and the parts, points of a multi
+// point, lines or rings, of the geometry. Useful to size buffers before decoding.
+MAPNIK_VECTOR_INLINE bool decode_geometry_bbox(GeometryPBF::pbf_itr const& geo_iterator,
+                                               mapbox::geometry::box<std::int64_t> & bbox,
+                                               std::size_t & num_vertices,
+                                               std::size_t & num_parts);
+
+// Same as above over a geometry already unpacked by decode_packed_uint32
+MAPNIK_VECTOR_INLINE bool decode_geometry_bbox(std::vector<std::uint32_t> const& values,
+                                               mapbox::geometry::box<std::int64_t> & bbox);
+
 } // end ns vector_tile_impl
 
 } // end ns mapnik
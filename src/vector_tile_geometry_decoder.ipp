@@ -1,4 +1,5 @@
 //protozero
+#include <protozero/exception.hpp>
 #include <protozero/pbf_reader.hpp>
 
 //mapnik
@@ -8,9 +9,15 @@
 #include <mapnik/debug.hpp>
 #endif
 
+#ifdef SSE_MATH
+// simd
+#include <emmintrin.h>
+#endif
+
 //std
 #include <algorithm>
 #include <cmath>
+#include <limits>
 #include <stdexcept>
 
 namespace mapnik
@@ -567,9 +574,122 @@ void decode_polygon(mapnik::geometry::geometry<geom_value_type> & geom,
 
 } // end ns detail
 
+namespace detail
+{
+
+// Decodes one varint, truncated to 32 bits like protozero does for packed uint32 fields,
+// and fails with the same exceptions as protozero on a broken one
+inline char const* decode_varint32(char const* itr, char const* end, std::uint32_t & value)
+{
+    std::uint64_t result = 0;
+    unsigned shift = 0;
+    while (itr != end)
+    {
+        std::uint8_t byte = static_cast<std::uint8_t>(*itr++);
+        result |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            value = static_cast<std::uint32_t>(result);
+            return itr;
+        }
+        shift += 7;
+        if (shift > 63)
+        {
+            throw protozero::varint_too_long_exception();
+        }
+    }
+    throw protozero::end_of_buffer_exception();
+}
+
+} // end ns detail
+
+MAPNIK_VECTOR_INLINE void decode_packed_uint32(protozero::data_view const& data, std::vector<std::uint32_t> & values)
+{
+    values.clear();
+    // Every varint is at least one byte long
+    values.reserve(data.size());
+    char const* itr = data.data();
+    char const* end = itr + data.size();
+    #ifdef SSE_MATH
+    // Most command streams are short deltas that fit in a single byte, sixteen
+    // of them can be checked at once by looking at the continuation bits.
+    while (end - itr >= 16)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(itr));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(chunk));
+        if (mask == 0)
+        {
+            for (std::size_t i = 0; i < 16; ++i)
+            {
+                values.push_back(static_cast<std::uint8_t>(itr[i]));
+            }
+            itr += 16;
+            continue;
+        }
+        // Copy the single byte varints in front of the first long one
+        while ((mask & 1u) == 0)
+        {
+            values.push_back(static_cast<std::uint8_t>(*itr++));
+            mask >>= 1;
+        }
+        std::uint32_t value;
+        itr = detail::decode_varint32(itr, end, value);
+        values.push_back(value);
+    }
+    #endif
+    while (itr != end)
+    {
+        std::uint32_t value;
+        itr = detail::decode_varint32(itr, end, value);
+        values.push_back(value);
+    }
+}
+
 GeometryPBF::GeometryPBF(pbf_itr const& geo_iterator)
     : geo_itr_(geo_iterator.begin()),
       geo_end_itr_(geo_iterator.end()),
+      values_(nullptr),
+      pos_(0),
+      size_(0),
+      x(0),
+      y(0),
+      ox(0),
+      oy(0),
+      length(0),
+      cmd(move_to)
+{
+    #if defined(DEBUG)
+    already_had_error = false;
+    #endif
+}
+
+GeometryPBF::GeometryPBF(protozero::data_view const& data, std::vector<std::uint32_t> & buffer)
+    : geo_itr_(),
+      geo_end_itr_(),
+      values_(nullptr),
+      pos_(0),
+      size_(0),
+      x(0),
+      y(0),
+      ox(0),
+      oy(0),
+      length(0),
+      cmd(move_to)
+{
+    decode_packed_uint32(data, buffer);
+    values_ = buffer.data();
+    size_ = buffer.size();
+    #if defined(DEBUG)
+    already_had_error = false;
+    #endif
+}
+
+GeometryPBF::GeometryPBF(std::vector<std::uint32_t> const& values)
+    : geo_itr_(),
+      geo_end_itr_(),
+      values_(values.data()),
+      pos_(0),
+      size_(values.size()),
       x(0),
       y(0),
       ox(0),
@@ -586,9 +706,9 @@ typename GeometryPBF::command GeometryPBF::point_next(value_type & rx, value_typ
 {
     if (length == 0)
     {
-        if (geo_itr_ != geo_end_itr_)
+        if (has_next())
         {
-            uint32_t cmd_length = static_cast<uint32_t>(*geo_itr_++);
+            uint32_t cmd_length = next_value();
             cmd = cmd_length & 0x7;
             length = cmd_length >> 3;
             if (cmd == move_to)
@@ -621,13 +741,9 @@ typename GeometryPBF::command GeometryPBF::point_next(value_type & rx, value_typ
     }
 
     --length;
-    // It is possible for the next to lines to throw because we can not check the length
-    // of the buffer to ensure that it is long enough.
-    // If an exception occurs it will likely be a end_of_buffer_exception with the text:
-    // "end of buffer exception"
-    // While this error message is not verbose a try catch here would slow down processing.
-    int32_t dx = protozero::decode_zigzag32(static_cast<uint32_t>(*geo_itr_++));
-    int32_t dy = protozero::decode_zigzag32(static_cast<uint32_t>(*geo_itr_++));
+    int32_t dx;
+    int32_t dy;
+    next_delta(dx, dy);
     detail::move_cursor(x, y, dx, dy);
     rx = x;
     ry = y;
@@ -640,9 +756,9 @@ typename GeometryPBF::command GeometryPBF::line_next(value_type & rx,
 {
     if (length == 0)
     {
-        if (geo_itr_ != geo_end_itr_)
+        if (has_next())
         {
-            uint32_t cmd_length = static_cast<uint32_t>(*geo_itr_++);
+            uint32_t cmd_length = next_value();
             cmd = cmd_length & 0x7;
             length = cmd_length >> 3;
             if (cmd == move_to)
@@ -652,13 +768,9 @@ typename GeometryPBF::command GeometryPBF::line_next(value_type & rx,
                     throw std::runtime_error("Vector Tile has LINESTRING with a MOVETO command that is given more then one pair of parameters or not enough parameters are provided");
                 }
                 --length;
-                // It is possible for the next to lines to throw because we can not check the length
-                // of the buffer to ensure that it is long enough.
-                // If an exception occurs it will likely be a end_of_buffer_exception with the text:
-                // "end of buffer exception"
-                // While this error message is not verbose a try catch here would slow down processing.
-                int32_t dx = protozero::decode_zigzag32(static_cast<uint32_t>(*geo_itr_++));
-                int32_t dy = protozero::decode_zigzag32(static_cast<uint32_t>(*geo_itr_++));
+                int32_t dx;
+                int32_t dy;
+                next_delta(dx, dy);
                 detail::move_cursor(x, y, dx, dy);
                 rx = x;
                 ry = y;
@@ -690,13 +802,9 @@ typename GeometryPBF::command GeometryPBF::line_next(value_type & rx,
     }
 
     --length;
-    // It is possible for the next to lines to throw because we can not check the length
-    // of the buffer to ensure that it is long enough.
-    // If an exception occurs it will likely be a end_of_buffer_exception with the text:
-    // "end of buffer exception"
-    // While this error message is not verbose a try catch here would slow down processing.
-    int32_t dx = protozero::decode_zigzag32(static_cast<uint32_t>(*geo_itr_++));
-    int32_t dy = protozero::decode_zigzag32(static_cast<uint32_t>(*geo_itr_++));
+    int32_t dx;
+    int32_t dy;
+    next_delta(dx, dy);
     if (skip_lineto_zero && dx == 0 && dy == 0)
     {
         // We are going to skip this vertex as the point doesn't move call line_next again
@@ -714,9 +822,9 @@ typename GeometryPBF::command GeometryPBF::ring_next(value_type & rx,
 {
     if (length == 0)
     {
-        if (geo_itr_ != geo_end_itr_)
+        if (has_next())
         {
-            uint32_t cmd_length = static_cast<uint32_t>(*geo_itr_++);
+            uint32_t cmd_length = next_value();
             cmd = cmd_length & 0x7;
             length = cmd_length >> 3;
             if (cmd == move_to)
@@ -726,13 +834,9 @@ typename GeometryPBF::command GeometryPBF::ring_next(value_type & rx,
                     throw std::runtime_error("Vector Tile has POLYGON with a MOVETO command that is given more then one pair of parameters or not enough parameters are provided");
                 }
                 --length;
-                // It is possible for the next two lines to throw because we can not check the length
-                // of the buffer to ensure that it is long enough.
-                // If an exception occurs it will likely be a end_of_buffer_exception with the text:
-                // "end of buffer exception"
-                // While this error message is not verbose a try catch here would slow down processing.
-                int32_t dx = protozero::decode_zigzag32(static_cast<uint32_t>(*geo_itr_++));
-                int32_t dy = protozero::decode_zigzag32(static_cast<uint32_t>(*geo_itr_++));
+                int32_t dx;
+                int32_t dy;
+                next_delta(dx, dy);
                 detail::move_cursor(x, y, dx, dy);
                 rx = x;
                 ry = y;
@@ -769,13 +873,9 @@ typename GeometryPBF::command GeometryPBF::ring_next(value_type & rx,
     }
 
     --length;
-    // It is possible for the next to lines to throw because we can not check the length
-    // of the buffer to ensure that it is long enough.
-    // If an exception occurs it will likely be a end_of_buffer_exception with the text:
-    // "end of buffer exception"
-    // While this error message is not verbose a try catch here would slow down processing.
-    int32_t dx = protozero::decode_zigzag32(static_cast<uint32_t>(*geo_itr_++));
-    int32_t dy = protozero::decode_zigzag32(static_cast<uint32_t>(*geo_itr_++));
+    int32_t dx;
+    int32_t dy;
+    next_delta(dx, dy);
     if (skip_lineto_zero && dx == 0 && dy == 0)
     {
         // We are going to skip this vertex as the point doesn't move call ring_next again
@@ -843,6 +943,100 @@ MAPNIK_VECTOR_INLINE mapnik::geometry::geometry<value_type> decode_geometry(Geom
     return decode_geometry<value_type>(paths, geom_type, version, tile_x, tile_y, scale_x, scale_y, bbox);
 }
 
+namespace detail
+{
+
+template <typename Iterator>
+bool decode_geometry_bbox(Iterator itr,
+                          Iterator end,
+                          mapbox::geometry::box<std::int64_t> & bbox,
+                          std::size_t & num_vertices,
+                          std::size_t & num_parts)
+{
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+    // Start from an inverted box so the loop below has no first vertex branch
+    std::int64_t min_x = std::numeric_limits<std::int64_t>::max();
+    std::int64_t min_y = std::numeric_limits<std::int64_t>::max();
+    std::int64_t max_x = std::numeric_limits<std::int64_t>::min();
+    std::int64_t max_y = std::numeric_limits<std::int64_t>::min();
+    num_vertices = 0;
+    num_parts = 0;
+    while (itr != end)
+    {
+        std::uint32_t cmd_length = static_cast<std::uint32_t>(*itr++);
+        std::uint32_t cmd = cmd_length & 0x7;
+        std::uint32_t length = cmd_length >> 3;
+        if (cmd == GeometryPBF::close)
+        {
+            continue;
+        }
+        if (cmd == GeometryPBF::move_to)
+        {
+            // Every point of a multi point move_to starts a new part
+            num_parts += length;
+        }
+        else if (cmd != GeometryPBF::line_to)
+        {
+            return false;
+        }
+        num_vertices += length;
+        for (; length > 0; --length)
+        {
+            if (itr == end)
+            {
+                return false;
+            }
+            std::int32_t dx = protozero::decode_zigzag32(static_cast<std::uint32_t>(*itr++));
+            if (itr == end)
+            {
+                return false;
+            }
+            std::int32_t dy = protozero::decode_zigzag32(static_cast<std::uint32_t>(*itr++));
+            detail::move_cursor(x, y, dx, dy);
+            min_x = std::min(min_x, x);
+            max_x = std::max(max_x, x);
+            min_y = std::min(min_y, y);
+            max_y = std::max(max_y, y);
+        }
+    }
+    if (num_vertices == 0)
+    {
+        return false;
+    }
+    bbox.min.x = min_x;
+    bbox.min.y = min_y;
+    bbox.max.x = max_x;
+    bbox.max.y = max_y;
+    return true;
+}
+
+} // end ns detail
+
+MAPNIK_VECTOR_INLINE bool decode_geometry_bbox(GeometryPBF::pbf_itr const& geo_iterator,
+                                               mapbox::geometry::box<std::int64_t> & bbox,
+                                               std::size_t & num_vertices,
+                                               std::size_t & num_parts)
+{
+    return detail::decode_geometry_bbox(geo_iterator.begin(), geo_iterator.end(), bbox, num_vertices, num_parts);
+}
+
+MAPNIK_VECTOR_INLINE bool decode_geometry_bbox(std::vector<std::uint32_t> const& values,
+                                               mapbox::geometry::box<std::int64_t> & bbox)
+{
+    std::size_t num_vertices;
+    std::size_t num_parts;
+    return detail::decode_geometry_bbox(values.begin(), values.end(), bbox, num_vertices, num_parts);
+}
+
+MAPNIK_VECTOR_INLINE bool decode_geometry_bbox(GeometryPBF::pbf_itr const& geo_iterator,
+                                               mapbox::geometry::box<std::int64_t> & bbox)
+{
+    std::size_t num_vertices;
+    std::size_t num_parts;
+    return decode_geometry_bbox(geo_iterator, bbox, num_vertices, num_parts);
+}
+
 } // end ns vector_tile_impl
 
 } // end ns mapnik
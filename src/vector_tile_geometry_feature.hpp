@@ -13,6 +13,9 @@
 // Mapbox
 #include <mapbox/geometry/geometry.hpp>
 
+// std
+#include <vector>
+
 
 namespace mapnik
 {
@@ -35,13 +38,22 @@ inline void raster_to_feature(std::string const& buffer,
 
 struct geometry_to_feature_pbf_visitor
 {
-    mapnik::feature_impl const& mapnik_feature_;
+    mapnik::feature_impl const* mapnik_feature_;
     layer_builder_pbf & builder_;
+    std::vector<std::uint32_t> feature_tags_;
 
     geometry_to_feature_pbf_visitor(mapnik::feature_impl const& mapnik_feature,
                                     layer_builder_pbf & builder)
-        : mapnik_feature_(mapnik_feature),
-          builder_(builder) {}
+        : mapnik_feature_(&mapnik_feature),
+          builder_(builder),
+          feature_tags_() {}
+
+    // Points the visitor at the next feature so that one visitor, and the
+    // buffers of the processors in front of it, can be used for a whole layer.
+    void set_feature(mapnik::feature_impl const& mapnik_feature)
+    {
+        mapnik_feature_ = &mapnik_feature;
+    }
 
     template <typename T>
     void operator() (T const& geom)
@@ -49,15 +61,15 @@ struct geometry_to_feature_pbf_visitor
         std::int32_t x = 0;
         std::int32_t y = 0;
         bool success = false;
-        std::vector<std::uint32_t> feature_tags;
-        protozero::pbf_writer layer_writer = builder_.add_feature(mapnik_feature_, feature_tags);
+        feature_tags_.clear();
+        protozero::pbf_writer layer_writer = builder_.add_feature(*mapnik_feature_, feature_tags_);
         {
             protozero::pbf_writer feature_writer(layer_writer, Layer_Encoding::FEATURES);
             success = encode_geometry_pbf(geom, feature_writer, x, y);
             if (success)
             {
-                feature_writer.add_uint64(Feature_Encoding::ID, static_cast<std::uint64_t>(mapnik_feature_.id()));
-                feature_writer.add_packed_uint32(Feature_Encoding::TAGS, feature_tags.begin(), feature_tags.end());
+                feature_writer.add_uint64(Feature_Encoding::ID, static_cast<std::uint64_t>(mapnik_feature_->id()));
+                feature_writer.add_packed_uint32(Feature_Encoding::TAGS, feature_tags_.begin(), feature_tags_.end());
                 builder_.make_not_empty();
             }
             else
@@ -0,0 +1,98 @@
+#ifndef __MAPNIK_VECTOR_TILE_GEOMETRY_POOL_H__
+#define __MAPNIK_VECTOR_TILE_GEOMETRY_POOL_H__
+
+// mapbox
+#include <mapbox/geometry/geometry.hpp>
+
+// std
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+/*
+  Keeps the point buffers of geometries that are no longer needed so that
+  the next geometries built by a visitor reuse their memory instead of
+  allocating again. Line strings and linear rings share the same buffers.
+  Everything is freed when the pool is destroyed, at the end of a layer.
+*/
+
+template <typename T>
+class point_buffer_pool
+{
+public:
+    using point_type = mapbox::geometry::point<T>;
+    using buffer_type = std::vector<point_type>;
+
+private:
+    // Beyond this the buffers of one huge feature would be kept for the whole layer
+    static constexpr std::size_t max_spare_buffers = 1024;
+    std::vector<buffer_type> spare_;
+
+public:
+    point_buffer_pool()
+        : spare_() {}
+
+    template <typename Container>
+    Container acquire(std::size_t size_hint = 0)
+    {
+        Container c;
+        if (!spare_.empty())
+        {
+            c.swap(spare_.back());
+            spare_.pop_back();
+        }
+        c.reserve(size_hint);
+        return c;
+    }
+
+    void release(buffer_type & buffer)
+    {
+        if (buffer.capacity() == 0 || spare_.size() >= max_spare_buffers)
+        {
+            return;
+        }
+        spare_.emplace_back();
+        spare_.back().swap(buffer);
+        spare_.back().clear();
+    }
+
+    void release(mapbox::geometry::multi_line_string<T> & geom)
+    {
+        for (auto & line : geom)
+        {
+            release(line);
+        }
+        geom.clear();
+    }
+
+    void release(mapbox::geometry::polygon<T> & geom)
+    {
+        for (auto & ring : geom)
+        {
+            release(ring);
+        }
+        geom.clear();
+    }
+
+    void release(mapbox::geometry::multi_polygon<T> & geom)
+    {
+        for (auto & poly : geom)
+        {
+            release(poly);
+        }
+        geom.clear();
+    }
+};
+
+template <typename T>
+constexpr std::size_t point_buffer_pool<T>::max_spare_buffers;
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
+
+#endif // __MAPNIK_VECTOR_TILE_GEOMETRY_POOL_H__
@@ -4,6 +4,7 @@
 // mapnik-vector-tile
 #include "vector_tile_config.hpp"
 #include "vector_tile_douglas_peucker.hpp"
+#include "vector_tile_geometry_pool.hpp"
 
 // mapbox
 #include <mapbox/geometry/geometry.hpp>
@@ -20,7 +21,13 @@ struct geometry_simplifier
     geometry_simplifier(unsigned simplify_distance,
                         NextProcessor & next)
         : next_(next),
-          simplify_distance_(simplify_distance) {}
+          simplify_distance_(simplify_distance),
+          pool_(),
+          line_(),
+          multi_line_(),
+          polygon_(),
+          multi_polygon_(),
+          included_() {}
 
     void operator() (mapbox::geometry::point<std::int64_t> & geom)
     {
@@ -40,70 +47,40 @@ struct geometry_simplifier
         }
         else
         {
-            mapbox::geometry::line_string<std::int64_t> simplified;
-            douglas_peucker(geom, std::back_inserter(simplified), simplify_distance_);
+            mapbox::geometry::line_string<std::int64_t> & simplified = line_;
+            simplified.clear();
+            douglas_peucker(geom, std::back_inserter(simplified), simplify_distance_, included_);
             next_(simplified);
         }
     }
 
     void operator() (mapbox::geometry::multi_line_string<std::int64_t> & geom)
     {
-        mapbox::geometry::multi_line_string<std::int64_t> simplified;
+        mapbox::geometry::multi_line_string<std::int64_t> & simplified = multi_line_;
+        pool_.release(simplified);
         for (auto const & g : geom)
         {
-            if (g.size() <= 2)
-            {
-                simplified.push_back(g);
-            }
-            else
-            {
-                mapbox::geometry::line_string<std::int64_t> simplified_line;
-                douglas_peucker(g, std::back_inserter(simplified_line), simplify_distance_);
-                simplified.push_back(simplified_line);
-            }
+            simplified.push_back(simplify_ring<mapbox::geometry::line_string<std::int64_t>>(g, 2));
         }
         next_(simplified);
     }
 
     void operator() (mapbox::geometry::polygon<std::int64_t> & geom)
     {
-        mapbox::geometry::polygon<std::int64_t> simplified;
-        for (auto const & g : geom)
-        {
-            if (g.size() <= 4)
-            {
-                simplified.push_back(g);
-            }
-            else
-            {
-                mapbox::geometry::linear_ring<std::int64_t> simplified_ring;
-                douglas_peucker(g, std::back_inserter(simplified_ring), simplify_distance_);
-                simplified.push_back(simplified_ring);
-            }
-        }
+        mapbox::geometry::polygon<std::int64_t> & simplified = polygon_;
+        pool_.release(simplified);
+        simplify_polygon(geom, simplified);
         next_(simplified);
     }
 
     void operator() (mapbox::geometry::multi_polygon<std::int64_t> & multi_geom)
     {
-        mapbox::geometry::multi_polygon<std::int64_t> simplified_multi;
+        mapbox::geometry::multi_polygon<std::int64_t> & simplified_multi = multi_polygon_;
+        pool_.release(simplified_multi);
         for (auto const & geom : multi_geom)
         {
-            mapbox::geometry::polygon<std::int64_t> simplified;
-            for (auto const & g : geom)
-            {
-                if (g.size() <= 4)
-                {
-                    simplified.push_back(g);
-                }
-                else
-                {
-                    mapbox::geometry::linear_ring<std::int64_t> simplified_ring;
-                    douglas_peucker(g, std::back_inserter(simplified_ring), simplify_distance_);
-                    simplified.push_back(simplified_ring);
-                }
-            }
-            simplified_multi.push_back(simplified);
+            simplified_multi.emplace_back();
+            simplify_polygon(geom, simplified_multi.back());
         }
         next_(simplified_multi);
     }
@@ -115,9 +92,41 @@ struct geometry_simplifier
             mapnik::util::apply_visitor((*this), g);
         }
     }
-        
+
+    // Simplified copy of a ring or line in a buffer from the pool, rings of
+    // min_size points or less are copied as they are.
+    template <typename Ring, typename InputRing>
+    Ring simplify_ring(InputRing const& g, std::size_t min_size)
+    {
+        Ring simplified_ring = pool_.template acquire<Ring>();
+        if (g.size() <= min_size)
+        {
+            simplified_ring.assign(g.begin(), g.end());
+        }
+        else
+        {
+            douglas_peucker(g, std::back_inserter(simplified_ring), simplify_distance_, included_);
+        }
+        return simplified_ring;
+    }
+
+    void simplify_polygon(mapbox::geometry::polygon<std::int64_t> const& geom,
+                          mapbox::geometry::polygon<std::int64_t> & simplified)
+    {
+        for (auto const & g : geom)
+        {
+            simplified.push_back(simplify_ring<mapbox::geometry::linear_ring<std::int64_t>>(g, 4));
+        }
+    }
+
     NextProcessor & next_;
     double simplify_distance_;
+    point_buffer_pool<std::int64_t> pool_;
+    mapbox::geometry::line_string<std::int64_t> line_;
+    mapbox::geometry::multi_line_string<std::int64_t> multi_line_;
+    mapbox::geometry::polygon<std::int64_t> polygon_;
+    mapbox::geometry::multi_polygon<std::int64_t> multi_polygon_;
+    std::vector<bool> included_;
 };
 
 } // end ns vector_tile_impl
@@ -0,0 +1,446 @@
+#ifndef __MAPNIK_VECTOR_TILE_GEOMETRY_SLICER_H__
+#define __MAPNIK_VECTOR_TILE_GEOMETRY_SLICER_H__
+
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+#include "vector_tile_geometry_clipper.hpp"
+
+// mapbox
+#include <mapbox/geometry/geometry.hpp>
+#include <mapbox/geometry/wagyu/quick_clip.hpp>
+
+// std
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+namespace detail
+{
+
+template <typename T>
+void expand_box(mapbox::geometry::box<T> & box, mapbox::geometry::box<T> const& other)
+{
+    box.min.x = std::min(box.min.x, other.min.x);
+    box.min.y = std::min(box.min.y, other.min.y);
+    box.max.x = std::max(box.max.x, other.max.x);
+    box.max.y = std::max(box.max.y, other.max.y);
+}
+
+// Envelopes of whole geometries, empty parts are skipped and a geometry with
+// no points at all has an inverted box that is disjoint from any other.
+template <typename T>
+mapbox::geometry::box<T> empty_envelope()
+{
+    return mapbox::geometry::box<T>(mapbox::geometry::point<T>(std::numeric_limits<T>::max(), std::numeric_limits<T>::max()),
+                                    mapbox::geometry::point<T>(std::numeric_limits<T>::lowest(), std::numeric_limits<T>::lowest()));
+}
+
+template <typename T>
+void expand_envelope(mapbox::geometry::box<T> & box, std::vector<mapbox::geometry::point<T>> const& points)
+{
+    if (!points.empty())
+    {
+        expand_box(box, points_envelope(points));
+    }
+}
+
+template <typename T>
+mapbox::geometry::box<T> geometry_envelope(mapbox::geometry::multi_point<T> const& geom)
+{
+    mapbox::geometry::box<T> box = empty_envelope<T>();
+    expand_envelope(box, geom);
+    return box;
+}
+
+template <typename T>
+mapbox::geometry::box<T> geometry_envelope(mapbox::geometry::line_string<T> const& geom)
+{
+    mapbox::geometry::box<T> box = empty_envelope<T>();
+    expand_envelope(box, geom);
+    return box;
+}
+
+template <typename T>
+mapbox::geometry::box<T> geometry_envelope(mapbox::geometry::multi_line_string<T> const& geom)
+{
+    mapbox::geometry::box<T> box = empty_envelope<T>();
+    for (auto const& line : geom)
+    {
+        expand_envelope(box, line);
+    }
+    return box;
+}
+
+template <typename T>
+mapbox::geometry::box<T> geometry_envelope(mapbox::geometry::polygon<T> const& geom)
+{
+    mapbox::geometry::box<T> box = empty_envelope<T>();
+    for (auto const& ring : geom)
+    {
+        expand_envelope(box, ring);
+    }
+    return box;
+}
+
+template <typename T>
+mapbox::geometry::box<T> geometry_envelope(mapbox::geometry::multi_polygon<T> const& geom)
+{
+    mapbox::geometry::box<T> box = empty_envelope<T>();
+    for (auto const& poly : geom)
+    {
+        for (auto const& ring : poly)
+        {
+            expand_envelope(box, ring);
+        }
+    }
+    return box;
+}
+
+// Clipping between the levels of the slicer. Rings are only cut with
+// quick_clip, the geometries are fixed by the clipper of every tile.
+
+template <typename T>
+void slice_clip(mapbox::geometry::multi_point<T> const& geom,
+                mapbox::geometry::box<T> const& box,
+                mapbox::geometry::multi_point<T> & result)
+{
+    for (auto const& pt : geom)
+    {
+        if (pt.x >= box.min.x && pt.x <= box.max.x && pt.y >= box.min.y && pt.y <= box.max.y)
+        {
+            result.push_back(pt);
+        }
+    }
+}
+
+template <typename T>
+void slice_clip(mapbox::geometry::line_string<T> const& geom,
+                mapbox::geometry::box<T> const& box,
+                mapbox::geometry::multi_line_string<T> & result)
+{
+    clip_line(geom, box, result);
+}
+
+template <typename T>
+void slice_clip(mapbox::geometry::multi_line_string<T> const& geom,
+                mapbox::geometry::box<T> const& box,
+                mapbox::geometry::multi_line_string<T> & result)
+{
+    for (auto const& line : geom)
+    {
+        if (line.size() > 1)
+        {
+            clip_line(line, box, result);
+        }
+    }
+}
+
+// An exterior ring cut away entirely is left empty when holes remain, so that
+// the clipper of the tile treats the polygon as it would have the whole one.
+template <typename T>
+void slice_clip(mapbox::geometry::polygon<T> const& geom,
+                mapbox::geometry::box<T> const& box,
+                mapbox::geometry::polygon<T> & result)
+{
+    for (auto const& ring : geom)
+    {
+        auto new_ring = mapbox::geometry::wagyu::quick_clip::quick_lr_clip(ring, box);
+        if (!new_ring.empty() || result.empty())
+        {
+            result.push_back(std::move(new_ring));
+        }
+    }
+    if (result.size() == 1 && result.front().empty())
+    {
+        result.clear();
+    }
+}
+
+template <typename T>
+void slice_clip(mapbox::geometry::multi_polygon<T> const& geom,
+                mapbox::geometry::box<T> const& box,
+                mapbox::geometry::multi_polygon<T> & result)
+{
+    for (auto const& poly : geom)
+    {
+        if (poly.empty())
+        {
+            continue;
+        }
+        result.emplace_back();
+        slice_clip(poly, box, result.back());
+        if (result.back().empty())
+        {
+            result.pop_back();
+        }
+    }
+}
+
+template <typename T>
+void translate(mapbox::geometry::point<T> & pt, T dx, T dy)
+{
+    pt.x -= dx;
+    pt.y -= dy;
+}
+
+template <typename Points, typename T>
+void translate(Points & points, T dx, T dy)
+{
+    for (auto & pt : points)
+    {
+        translate(pt, dx, dy);
+    }
+}
+
+template <typename T>
+void translate(mapbox::geometry::multi_line_string<T> & geom, T dx, T dy)
+{
+    for (auto & line : geom)
+    {
+        translate(line, dx, dy);
+    }
+}
+
+template <typename T>
+void translate(mapbox::geometry::polygon<T> & geom, T dx, T dy)
+{
+    for (auto & ring : geom)
+    {
+        translate(ring, dx, dy);
+    }
+}
+
+template <typename T>
+void translate(mapbox::geometry::multi_polygon<T> & geom, T dx, T dy)
+{
+    for (auto & poly : geom)
+    {
+        translate(poly, dx, dy);
+    }
+}
+
+} // end ns detail
+
+/*
+  Cuts geometries given in the coordinates of a grid of tiles into the tiles
+  they touch. The grid is split in two along its longer side, the geometry is
+  clipped to each half and the halves are split again until a single tile is
+  left, where the piece is moved to the coordinates of the tile and given to
+  its processor. A geometry crossing a few tiles of a large grid is so only
+  ever clipped against the few boxes around it.
+*/
+
+template <typename NextProcessor>
+class geometry_slicer
+{
+public:
+    using box_type = mapbox::geometry::box<std::int64_t>;
+
+private:
+    struct region
+    {
+        std::size_t min_col;
+        std::size_t min_row;
+        std::size_t max_col;
+        std::size_t max_row;
+    };
+
+    std::size_t cols_;
+    std::size_t rows_;
+    std::int64_t tile_size_;
+    std::vector<NextProcessor*> const& tiles_;
+    std::vector<box_type> const& boxes_;
+
+public:
+    // tiles holds the processor of every tile in row major order, tiles with a
+    // null processor are skipped. boxes holds the clipping extent of every tile
+    // in the coordinates of the grid.
+    geometry_slicer(std::size_t cols,
+                    std::size_t rows,
+                    std::int64_t tile_size,
+                    std::vector<NextProcessor*> const& tiles,
+                    std::vector<box_type> const& boxes)
+        : cols_(cols),
+          rows_(rows),
+          tile_size_(tile_size),
+          tiles_(tiles),
+          boxes_(boxes) {}
+
+    void operator() (mapbox::geometry::point<std::int64_t> & geom)
+    {
+        for (std::size_t index = 0; index < tiles_.size(); ++index)
+        {
+            box_type const& box = boxes_[index];
+            if (tiles_[index] &&
+                geom.x >= box.min.x && geom.x <= box.max.x &&
+                geom.y >= box.min.y && geom.y <= box.max.y)
+            {
+                mapbox::geometry::point<std::int64_t> pt(geom);
+                detail::translate(pt, offset_x(index), offset_y(index));
+                (*tiles_[index])(pt);
+            }
+        }
+    }
+
+    void operator() (mapbox::geometry::multi_point<std::int64_t> & geom)
+    {
+        start(geom);
+    }
+
+    void operator() (mapbox::geometry::line_string<std::int64_t> & geom)
+    {
+        start(geom);
+    }
+
+    void operator() (mapbox::geometry::multi_line_string<std::int64_t> & geom)
+    {
+        start(geom);
+    }
+
+    void operator() (mapbox::geometry::polygon<std::int64_t> & geom)
+    {
+        start(geom);
+    }
+
+    void operator() (mapbox::geometry::multi_polygon<std::int64_t> & geom)
+    {
+        start(geom);
+    }
+
+    void operator() (mapbox::geometry::geometry_collection<std::int64_t> & geom)
+    {
+        for (auto & g : geom)
+        {
+            mapbox::util::apply_visitor((*this), g);
+        }
+    }
+
+private:
+    std::int64_t offset_x(std::size_t index) const
+    {
+        return static_cast<std::int64_t>(index % cols_) * tile_size_;
+    }
+
+    std::int64_t offset_y(std::size_t index) const
+    {
+        return static_cast<std::int64_t>(index / cols_) * tile_size_;
+    }
+
+    box_type region_box(region const& r) const
+    {
+        box_type box = boxes_[r.min_row * cols_ + r.min_col];
+        detail::expand_box(box, boxes_[r.max_row * cols_ + r.max_col]);
+        return box;
+    }
+
+    static bool is_empty(mapbox::geometry::polygon<std::int64_t> const& geom)
+    {
+        return std::all_of(geom.begin(), geom.end(), [](mapbox::geometry::linear_ring<std::int64_t> const& ring) {
+            return ring.empty();
+        });
+    }
+
+    template <typename Geometry>
+    static bool is_empty(Geometry const& geom)
+    {
+        return geom.empty();
+    }
+
+    static bool is_empty(mapbox::geometry::multi_line_string<std::int64_t> const& geom)
+    {
+        return std::all_of(geom.begin(), geom.end(), [](mapbox::geometry::line_string<std::int64_t> const& line) {
+            return line.empty();
+        });
+    }
+
+    template <typename Geometry>
+    void start(Geometry & geom)
+    {
+        if (is_empty(geom))
+        {
+            return;
+        }
+        slice(geom, region { 0, 0, cols_ - 1, rows_ - 1 });
+    }
+
+    template <typename Geometry>
+    void slice(Geometry const& geom, region const& r)
+    {
+        if (r.min_col == r.max_col && r.min_row == r.max_row)
+        {
+            std::size_t index = r.min_row * cols_ + r.min_col;
+            if (tiles_[index])
+            {
+                Geometry piece(geom);
+                detail::translate(piece, offset_x(index), offset_y(index));
+                (*tiles_[index])(piece);
+            }
+            return;
+        }
+        region first(r);
+        region second(r);
+        if (r.max_col - r.min_col >= r.max_row - r.min_row)
+        {
+            first.max_col = r.min_col + (r.max_col - r.min_col) / 2;
+            second.min_col = first.max_col + 1;
+        }
+        else
+        {
+            first.max_row = r.min_row + (r.max_row - r.min_row) / 2;
+            second.min_row = first.max_row + 1;
+        }
+        box_type bbox = detail::geometry_envelope(geom);
+        slice_part(geom, bbox, first);
+        slice_part(geom, bbox, second);
+    }
+
+    template <typename Geometry>
+    void slice_part(Geometry const& geom, box_type const& bbox, region const& r)
+    {
+        box_type box = region_box(r);
+        if (detail::box_disjoint(bbox, box))
+        {
+            return;
+        }
+        if (detail::box_within(bbox, box))
+        {
+            slice(geom, r);
+            return;
+        }
+        clip_and_slice(geom, box, r);
+    }
+
+    template <typename Geometry>
+    void clip_and_slice(Geometry const& geom, box_type const& box, region const& r)
+    {
+        Geometry clipped;
+        detail::slice_clip(geom, box, clipped);
+        if (!is_empty(clipped))
+        {
+            slice(clipped, r);
+        }
+    }
+
+    void clip_and_slice(mapbox::geometry::line_string<std::int64_t> const& geom, box_type const& box, region const& r)
+    {
+        mapbox::geometry::multi_line_string<std::int64_t> clipped;
+        detail::slice_clip(geom, box, clipped);
+        if (!is_empty(clipped))
+        {
+            slice(clipped, r);
+        }
+    }
+};
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
+
+#endif // __MAPNIK_VECTOR_TILE_GEOMETRY_SLICER_H__
@@ -3,6 +3,7 @@
 
 // mapnik-vector-tile
 #include "vector_tile_config.hpp"
+#include "vector_tile_map_plan.hpp"
 
 // mapnik
 #include <mapnik/geometry/box2d.hpp>
@@ -17,12 +18,15 @@
 #include <mapnik/view_transform.hpp>
 
 // protozero
+#include <protozero/data_view.hpp>
 #include <protozero/pbf_writer.hpp>
 
 // std
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace mapnik
 {
@@ -93,6 +97,17 @@ struct layer_builder_pbf
         layer_writer.add_uint32(Layer_Encoding::EXTENT, extent);
     }
 
+    // Builds a fragment: features, keys and values only, without the layer
+    // header, so that it can later be merged into a complete layer.
+    explicit layer_builder_pbf(std::string & _layer_buffer)
+        : keys(),
+          values(),
+          layer_buffer(_layer_buffer),
+          empty(true),
+          painted(false)
+    {
+    }
+
     void make_painted()
     {
         painted = true;
@@ -103,8 +118,27 @@ struct layer_builder_pbf
         empty = false;
     }
 
+    // Index of a key or value in the layer, writing it to the layer when it is new.
+    MAPNIK_VECTOR_INLINE std::uint32_t add_key(std::string const& name);
+
+    MAPNIK_VECTOR_INLINE std::uint32_t add_value(mapnik::value const& val);
+
+    // Same as above but writes the already encoded Value message when val is new.
+    MAPNIK_VECTOR_INLINE std::uint32_t add_value(mapnik::value const& val,
+                                                 protozero::data_view const& encoded);
+
     MAPNIK_VECTOR_INLINE protozero::pbf_writer add_feature(mapnik::feature_impl const& mapnik_feature,
                                                            std::vector<std::uint32_t> & feature_tags);
+
+    // Appends the features of a fragment, remapping its tags to the keys and values
+    // of this layer. Merging fragments in the order their features were read writes
+    // the same bytes as encoding all of those features into this builder directly,
+    // no matter how many threads built the fragments.
+    MAPNIK_VECTOR_INLINE void merge(layer_builder_pbf const& fragment);
+
+    // Appends the features of an encoded Layer message in the same way. Its name,
+    // version and extent are ignored, they must match those of this layer.
+    MAPNIK_VECTOR_INLINE void merge(protozero::data_view const& layer_data);
 };
 
 class tile_layer
@@ -112,9 +146,7 @@ class tile_layer
 private:
     bool valid_;
     mapnik::datasource_ptr ds_;
-    mapnik::projection target_proj_;
-    mapnik::projection source_proj_;
-    mapnik::proj_transform prj_trans_;
+    std::shared_ptr<layer_projections const> projections_;
     std::string buffer_;
     std::string name_;
     std::uint32_t layer_extent_;
@@ -135,18 +167,17 @@ public:
                double scale_denom,
                int offset_x,
                int offset_y,
-               mapnik::attributes const& vars)
+               mapnik::attributes const& vars,
+               layer_plan const* plan = nullptr)
         : valid_(true),
           ds_(lay.datasource()),
-          target_proj_(map.srs(), true),
-          source_proj_(lay.srs(), true),
-          prj_trans_(target_proj_, source_proj_),
+          projections_(plan ? plan->projections() : std::make_shared<layer_projections>(map.srs(), lay.srs())),
           buffer_(),
           name_(lay.name()),
           layer_extent_(calc_extent(tile_size)),
           target_buffered_extent_(calc_target_buffered_extent(tile_extent_bbox, buffer_size, lay, map)),
           source_buffered_extent_(calc_source_buffered_extent(lay)),
-          query_(calc_query(scale_factor, scale_denom, tile_extent_bbox, lay, vars)),
+          query_(calc_query(scale_factor, scale_denom, tile_extent_bbox, lay, vars, plan)),
           view_trans_(layer_extent_, layer_extent_, tile_extent_bbox, offset_x, offset_y),
           empty_(true),
           painted_(false)
@@ -157,9 +188,7 @@ public:
     tile_layer(tile_layer && rhs)
         : valid_(std::move(rhs.valid_)),
           ds_(std::move(rhs.ds_)),
-          target_proj_(std::move(rhs.target_proj_)),
-          source_proj_(std::move(rhs.source_proj_)),
-          prj_trans_(target_proj_, source_proj_),
+          projections_(std::move(rhs.projections_)),
           buffer_(std::move(rhs.buffer_)),
           name_(std::move(rhs.name_)),
           layer_extent_(std::move(rhs.layer_extent_)),
@@ -247,7 +276,7 @@ public:
     mapnik::box2d<double> calc_source_buffered_extent(mapnik::layer const& lay)
     {
         mapnik::box2d<double> new_extent(target_buffered_extent_);
-        if (!prj_trans_.forward(new_extent, PROJ_ENVELOPE_POINTS))
+        if (!get_proj_transform().forward(new_extent, PROJ_ENVELOPE_POINTS))
         {
             if (!ds_ || ds_->type() != datasource::Vector)
             {
@@ -266,13 +295,15 @@ public:
                              double scale_denom,
                              mapnik::box2d<double> const& tile_extent_bbox,
                              mapnik::layer const& lay,
-                             mapnik::attributes const& vars)
+                             mapnik::attributes const& vars,
+                             layer_plan const* plan)
     {
+        mapnik::proj_transform const& prj_trans = get_proj_transform();
         // Adjust the scale denominator if required
         if (scale_denom <= 0.0)
         {
             double scale = tile_extent_bbox.width() / VT_LEGACY_IMAGE_SIZE;
-            scale_denom = mapnik::scale_denominator(scale, target_proj_.is_geographic());
+            scale_denom = mapnik::scale_denominator(scale, projections_->target.is_geographic());
         }
         scale_denom *= scale_factor;
         if (!lay.visible(scale_denom))
@@ -290,16 +321,16 @@ public:
             query_extent.clip(source_buffered_extent_);
         }
         // if no intersection and projections are also equal, early return
-        else if (prj_trans_.equal())
+        else if (prj_trans.equal())
         {
             valid_ = false;
         }
         // next try intersection of layer extent back projected into map srs
-        else if (prj_trans_.backward(query_extent, PROJ_ENVELOPE_POINTS) && target_buffered_extent_.intersects(query_extent))
+        else if (prj_trans.backward(query_extent, PROJ_ENVELOPE_POINTS) && target_buffered_extent_.intersects(query_extent))
         {
             query_extent.clip(target_buffered_extent_);
             // forward project layer extent back into native projection
-            if (!prj_trans_.forward(query_extent, PROJ_ENVELOPE_POINTS))
+            if (!prj_trans.forward(query_extent, PROJ_ENVELOPE_POINTS))
             {
                 throw std::runtime_error("vector_tile_processor: query extent did not reproject back to source projection");
             }
@@ -309,9 +340,9 @@ public:
             // if no intersection then nothing to do for layer
             valid_ = false;
         }
-        if (!prj_trans_.equal())
+        if (!prj_trans.equal())
         {
-            if (!prj_trans_.forward(unbuffered_query_extent, PROJ_ENVELOPE_POINTS))
+            if (!prj_trans.forward(unbuffered_query_extent, PROJ_ENVELOPE_POINTS))
             {
                 if (!ds_ || ds_->type() != datasource::Vector)
                 {
@@ -330,7 +361,14 @@ public:
 
         mapnik::query::resolution_type res(qw, qh);
         mapnik::query q(query_extent, res, scale_denom, unbuffered_query_extent);
-        if (ds_)
+        if (plan)
+        {
+            for (std::string const& name : plan->property_names())
+            {
+                q.add_property_name(name);
+            }
+        }
+        else if (ds_)
         {
             mapnik::layer_descriptor lay_desc = ds_->get_descriptor();
             for (mapnik::attribute_descriptor const& desc : lay_desc.get_descriptors())
@@ -364,7 +402,12 @@ public:
 
     mapnik::proj_transform const& get_proj_transform() const
     {
-        return prj_trans_;
+        return projections_->transform;
+    }
+
+    layer_projections const& get_projections() const
+    {
+        return *projections_;
     }
 
     mapnik::box2d<double> const& get_source_buffered_extent() const
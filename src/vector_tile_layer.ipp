@@ -5,11 +5,15 @@
 #include <mapnik/unicode.hpp>
 
 // protozero
+#include <protozero/pbf_reader.hpp>
 #include <protozero/pbf_writer.hpp>
 
 // std
 #include <map>
+#include <stdexcept>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace mapnik
 {
@@ -64,13 +68,181 @@ private:
     protozero::pbf_writer & value_;
 };
 
+inline mapnik::value decode_value(protozero::pbf_reader value_msg, mapnik::transcoder const& tr)
+{
+    mapnik::value val;
+    while (value_msg.next())
+    {
+        switch (value_msg.tag())
+        {
+            case Value_Encoding::STRING:
+            {
+                protozero::data_view str = value_msg.get_view();
+                val = tr.transcode(str.data(), str.size());
+                break;
+            }
+            case Value_Encoding::FLOAT:
+                val = static_cast<mapnik::value_double>(value_msg.get_float());
+                break;
+            case Value_Encoding::DOUBLE:
+                val = static_cast<mapnik::value_double>(value_msg.get_double());
+                break;
+            case Value_Encoding::INT:
+                val = static_cast<mapnik::value_integer>(value_msg.get_int64());
+                break;
+            case Value_Encoding::UINT:
+                val = static_cast<mapnik::value_integer>(value_msg.get_uint64());
+                break;
+            case Value_Encoding::SINT:
+                val = static_cast<mapnik::value_integer>(value_msg.get_sint64());
+                break;
+            case Value_Encoding::BOOL:
+                val = static_cast<mapnik::value_bool>(value_msg.get_bool());
+                break;
+            default:
+                throw std::runtime_error("unknown Value type " + std::to_string(value_msg.tag()) + " in layer.values");
+        }
+    }
+    return val;
+}
+
+// Copies the features of an encoded layer into the builder. KeyIndex and ValueIndex
+// map the position of a key or value in the encoded layer, and its encoded bytes, to
+// its index in the builder. Geometries are copied without being decoded, only the
+// tags of the features are rewritten. Returns the number of features copied.
+template <typename KeyIndex, typename ValueIndex>
+std::size_t merge_layer(layer_builder_pbf & builder,
+                        protozero::data_view const& layer_data,
+                        KeyIndex && key_index,
+                        ValueIndex && value_index)
+{
+    std::vector<std::uint32_t> key_map;
+    std::vector<std::uint32_t> value_map;
+    std::vector<std::uint32_t> feature_tags;
+    std::size_t count = 0;
+
+    protozero::pbf_writer layer_writer(builder.layer_buffer);
+    protozero::pbf_reader layer_reader(layer_data);
+    while (layer_reader.next())
+    {
+        switch (layer_reader.tag())
+        {
+            case Layer_Encoding::KEYS:
+                key_map.push_back(key_index(key_map.size(), layer_reader.get_view()));
+                break;
+            case Layer_Encoding::VALUES:
+                value_map.push_back(value_index(value_map.size(), layer_reader.get_view()));
+                break;
+            case Layer_Encoding::FEATURES:
+            {
+                protozero::pbf_reader feature_reader = layer_reader.get_message();
+                protozero::pbf_writer feature_writer(layer_writer, Layer_Encoding::FEATURES);
+                while (feature_reader.next())
+                {
+                    switch (feature_reader.tag())
+                    {
+                        case Feature_Encoding::ID:
+                            feature_writer.add_uint64(Feature_Encoding::ID, feature_reader.get_uint64());
+                            break;
+                        case Feature_Encoding::TAGS:
+                        {
+                            feature_tags.clear();
+                            bool is_key = true;
+                            for (std::uint32_t tag : feature_reader.get_packed_uint32())
+                            {
+                                std::vector<std::uint32_t> const& tag_map = is_key ? key_map : value_map;
+                                if (tag >= tag_map.size())
+                                {
+                                    throw std::runtime_error("Vector Tile has a feature with an invalid tag index, can not merge it");
+                                }
+                                feature_tags.push_back(tag_map[tag]);
+                                is_key = !is_key;
+                            }
+                            feature_writer.add_packed_uint32(Feature_Encoding::TAGS, feature_tags.begin(), feature_tags.end());
+                            break;
+                        }
+                        case Feature_Encoding::TYPE:
+                            feature_writer.add_enum(Feature_Encoding::TYPE, feature_reader.get_enum());
+                            break;
+                        case Feature_Encoding::GEOMETRY:
+                        case Feature_Encoding::RASTER:
+                        {
+                            // packed geometries are length delimited on the wire, copy them as is
+                            protozero::pbf_tag_type tag = feature_reader.tag();
+                            feature_writer.add_bytes(tag, feature_reader.get_view());
+                            break;
+                        }
+                        default:
+                            feature_reader.skip();
+                            break;
+                    }
+                }
+                ++count;
+                break;
+            }
+            default:
+                layer_reader.skip();
+                break;
+        }
+    }
+    return count;
+}
+
 } // end ns detail
 
+MAPNIK_VECTOR_INLINE std::uint32_t layer_builder_pbf::add_key(std::string const& name)
+{
+    keys_container::const_iterator key_itr = keys.find(name);
+    if (key_itr != keys.end())
+    {
+        return key_itr->second;
+    }
+    // The key doesn't exist yet in the dictionary.
+    protozero::pbf_writer layer_writer(layer_buffer);
+    layer_writer.add_string(Layer_Encoding::KEYS, name);
+    std::uint32_t index = keys.size();
+    keys.emplace(name, index);
+    return index;
+}
+
+MAPNIK_VECTOR_INLINE std::uint32_t layer_builder_pbf::add_value(mapnik::value const& val)
+{
+    values_container::const_iterator val_itr = values.find(val);
+    if (val_itr != values.end())
+    {
+        return val_itr->second;
+    }
+    // The value doesn't exist yet in the dictionary.
+    {
+        protozero::pbf_writer layer_writer(layer_buffer);
+        protozero::pbf_writer value_writer(layer_writer, Layer_Encoding::VALUES);
+        detail::to_tile_value_pbf visitor(value_writer);
+        mapnik::util::apply_visitor(visitor, val);
+    }
+    std::uint32_t index = values.size();
+    values.emplace(val, index);
+    return index;
+}
+
+MAPNIK_VECTOR_INLINE std::uint32_t layer_builder_pbf::add_value(mapnik::value const& val,
+                                                                protozero::data_view const& encoded)
+{
+    values_container::const_iterator val_itr = values.find(val);
+    if (val_itr != values.end())
+    {
+        return val_itr->second;
+    }
+    protozero::pbf_writer layer_writer(layer_buffer);
+    layer_writer.add_message(Layer_Encoding::VALUES, encoded);
+    std::uint32_t index = values.size();
+    values.emplace(val, index);
+    return index;
+}
+
 MAPNIK_VECTOR_INLINE protozero::pbf_writer layer_builder_pbf::add_feature(mapnik::feature_impl const& mapnik_feature,
                                                                           std::vector<std::uint32_t> & feature_tags)
 
 {
-    protozero::pbf_writer layer_writer(layer_buffer);
     // Feature id should be unique from mapnik so we should comply with
     // the following wording of the specification:
     // "the value of the (feature) id SHOULD be unique among the features of the parent layer."
@@ -89,42 +261,65 @@ MAPNIK_VECTOR_INLINE protozero::pbf_writer layer_builder_pbf::add_feature(mapnik
         mapnik::value const& val = std::get<1>(*itr);
         if (!val.is_null())
         {
-            // Insert the key index
-            keys_container::const_iterator key_itr = keys.find(name);
-            if (key_itr == keys.end())
-            {
-                // The key doesn't exist yet in the dictionary.
-                layer_writer.add_string(Layer_Encoding::KEYS, name);
-                size_t index = keys.size();
-                keys.emplace(name, index);
-                feature_tags.push_back(index);
-            }
-            else
-            {
-                feature_tags.push_back(key_itr->second);
-            }
-
-            // Insert the value index
-            values_container::const_iterator val_itr = values.find(val);
-            if (val_itr == values.end())
-            {
-                // The value doesn't exist yet in the dictionary.
-                {
-                    protozero::pbf_writer value_writer(layer_writer, Layer_Encoding::VALUES);
-                    detail::to_tile_value_pbf visitor(value_writer);
-                    mapnik::util::apply_visitor(visitor, val);
-                }
-                size_t index = values.size();
-                values.emplace(val, index);
-                feature_tags.push_back(index);
-            }
-            else
-            {
-                feature_tags.push_back(val_itr->second);
-            }
+            feature_tags.push_back(add_key(name));
+            feature_tags.push_back(add_value(val));
         }
     }
-    return layer_writer;
+    return protozero::pbf_writer(layer_buffer);
+}
+
+MAPNIK_VECTOR_INLINE void layer_builder_pbf::merge(layer_builder_pbf const& fragment)
+{
+    // Dictionary entries of the fragment by index
+    std::vector<std::string const*> fragment_keys(fragment.keys.size(), nullptr);
+    for (auto const& key : fragment.keys)
+    {
+        fragment_keys[key.second] = &key.first;
+    }
+    std::vector<mapnik::value const*> fragment_values(fragment.values.size(), nullptr);
+    for (auto const& val : fragment.values)
+    {
+        fragment_values[val.second] = &val.first;
+    }
+
+    // Keys and values of a fragment are written right before the first feature
+    // using them, just like in a layer. Any key or value new to this layer is
+    // therefore new to the fragment too and gets written at the same position
+    // it would have had if the features had been added here.
+    detail::merge_layer(*this,
+                        protozero::data_view(fragment.layer_buffer.data(), fragment.layer_buffer.size()),
+                        [&](std::size_t index, protozero::data_view const&) {
+                            return add_key(*fragment_keys.at(index));
+                        },
+                        [&](std::size_t index, protozero::data_view const& encoded) {
+                            return add_value(*fragment_values.at(index), encoded);
+                        });
+    if (!fragment.empty)
+    {
+        empty = false;
+    }
+    if (fragment.painted)
+    {
+        painted = true;
+    }
+}
+
+MAPNIK_VECTOR_INLINE void layer_builder_pbf::merge(protozero::data_view const& layer_data)
+{
+    mapnik::transcoder tr("utf-8");
+    std::size_t count = detail::merge_layer(*this,
+                                            layer_data,
+                                            [&](std::size_t, protozero::data_view const& key) {
+                                                return add_key(std::string(key.data(), key.size()));
+                                            },
+                                            [&](std::size_t, protozero::data_view const& encoded) {
+                                                return add_value(detail::decode_value(protozero::pbf_reader(encoded), tr), encoded);
+                                            });
+    if (count > 0)
+    {
+        empty = false;
+        painted = true;
+    }
 }
 
 } // end ns vector_tile_impl
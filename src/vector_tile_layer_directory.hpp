@@ -0,0 +1,153 @@
+#ifndef __MAPNIK_VECTOR_TILE_LAYER_DIRECTORY_H__
+#define __MAPNIK_VECTOR_TILE_LAYER_DIRECTORY_H__
+
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+
+// protozero
+#include <protozero/data_view.hpp>
+#include <protozero/exception.hpp>
+#include <protozero/pbf_reader.hpp>
+
+// std
+#include <exception>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+/*
+  Where every layer of an encoded tile starts and how long it is, in the order
+  of the tile, along with the index of each name. Offsets are kept rather than
+  pointers so that the buffer of a tile can grow as layers are appended. A
+  layer is then found and read without walking the tile.
+*/
+
+class layer_directory
+{
+public:
+    struct entry
+    {
+        std::size_t offset;
+        std::size_t size;
+    };
+
+private:
+    std::vector<entry> entries_;
+    std::unordered_map<std::string, std::size_t> index_;
+    // The first layer whose names could not all be read and why
+    std::size_t first_corrupt_;
+    std::exception_ptr corrupt_error_;
+
+public:
+    layer_directory()
+        : entries_(),
+          index_(),
+          first_corrupt_(0),
+          corrupt_error_() {}
+
+    // A later layer with the name of an earlier one is not found by name,
+    // as when the tile is walked from the start.
+    void add(std::string const& name, std::size_t offset, std::size_t size)
+    {
+        index_.emplace(name, entries_.size());
+        entries_.push_back(entry { offset, size });
+    }
+
+    // For a layer with every name in names. When error is set the layer is
+    // corrupt, names then holds those read before it, and looking up a name
+    // that a walk of the tile would not find before this layer throws error.
+    void add(std::vector<std::string> const& names,
+             std::size_t offset,
+             std::size_t size,
+             std::exception_ptr error = nullptr)
+    {
+        for (auto const& name : names)
+        {
+            index_.emplace(name, entries_.size());
+        }
+        if (error && !corrupt_error_)
+        {
+            first_corrupt_ = entries_.size();
+            corrupt_error_ = error;
+        }
+        entries_.push_back(entry { offset, size });
+    }
+
+    std::size_t size() const
+    {
+        return entries_.size();
+    }
+
+    bool empty() const
+    {
+        return entries_.empty();
+    }
+
+    void clear()
+    {
+        entries_.clear();
+        index_.clear();
+        first_corrupt_ = 0;
+        corrupt_error_ = nullptr;
+    }
+
+    // Index of the layer named name, or size() when there is none. Throws the
+    // error of a corrupt layer found before it, as reading the tile would.
+    std::size_t find(std::string const& name) const
+    {
+        std::size_t index = entries_.size();
+        auto itr = index_.find(name);
+        if (itr != index_.end())
+        {
+            index = itr->second;
+        }
+        if (corrupt_error_ && first_corrupt_ < index)
+        {
+            std::rethrow_exception(corrupt_error_);
+        }
+        return index;
+    }
+
+    entry const& operator[](std::size_t index) const
+    {
+        return entries_[index];
+    }
+
+    // The layer at index of the tile whose buffer starts at data
+    protozero::data_view view(const char * data, std::size_t index) const
+    {
+        entry const& e = entries_[index];
+        return protozero::data_view(data + e.offset, e.size);
+    }
+};
+
+// Reads every name of an encoded layer into names. Returns the exception that
+// stopped the reading when the layer is corrupt, null otherwise.
+inline std::exception_ptr read_layer_names(protozero::data_view const& layer, std::vector<std::string> & names)
+{
+    try
+    {
+        protozero::pbf_reader layer_msg(layer);
+        while (layer_msg.next(Layer_Encoding::NAME))
+        {
+            names.push_back(layer_msg.get_string());
+        }
+    }
+    catch (protozero::exception const&)
+    {
+        return std::current_exception();
+    }
+    return nullptr;
+}
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
+
+#endif // __MAPNIK_VECTOR_TILE_LAYER_DIRECTORY_H__
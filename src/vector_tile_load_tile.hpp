@@ -5,8 +5,12 @@
 #include "vector_tile_config.hpp"
 #include "vector_tile_compression.hpp"
 #include "vector_tile_tile.hpp"
-#include "vector_tile_datasource_pbf.hpp"
 #include "vector_tile_is_valid.hpp"
+#include "vector_tile_merc_tile.hpp"
+#include "vector_tile_retile.hpp"
+// No longer used here since layers are upgraded by upgrade_layer, kept for
+// one release for the code that relies on them being included by this header
+#include "vector_tile_datasource_pbf.hpp"
 #include "vector_tile_processor.hpp"
 
 // mapnik
@@ -52,9 +56,8 @@ inline std::pair<std::string,std::uint32_t> get_layer_name_and_version(protozero
 
 inline void merge_from_buffer(merc_tile & t, const char * data, std::size_t size, bool validate = false, bool upgrade = false)
 {
-    using ds_ptr = std::shared_ptr<mapnik::vector_tile_impl::tile_datasource_pbf>;
     protozero::pbf_reader tile_msg(data, size);
-    std::vector<ds_ptr> ds_vec;
+    std::string upgraded_buffer;
     while (tile_msg.next())
     {
         switch (tile_msg.tag())
@@ -92,14 +95,15 @@ inline void merge_from_buffer(merc_tile & t, const char * data, std::size_t size
                     }
                     if (upgrade && version == 1)
                     {
-                            // v1 tiles will be converted to v2
-                            protozero::pbf_reader layer_msg(layer_view);
-                            ds_vec.push_back(std::make_shared<mapnik::vector_tile_impl::tile_datasource_pbf>(
-                                        layer_msg,
-                                        t.x(),
-                                        t.y(),
-                                        t.z(),
-                                        true));
+                        // v1 tiles will be converted to v2
+                        if (upgrade_layer(layer_view, t.tile_size(), upgraded_buffer))
+                        {
+                            t.append_layer_buffer(upgraded_buffer.data(), upgraded_buffer.size(), layer_name);
+                        }
+                        else
+                        {
+                            t.add_empty_layer(layer_name);
+                        }
                     }
                     else
                     {
@@ -112,37 +116,13 @@ inline void merge_from_buffer(merc_tile & t, const char * data, std::size_t size
                 break;
         }
     }
-    if (ds_vec.empty())
-    {
-        return;
-    }
-    // Convert v1 tiles to v2
-    std::int32_t prev_buffer_size = t.buffer_size();
-    t.buffer_size(4096); // very large buffer so we don't miss any buffered points
-    mapnik::Map map(t.tile_size(), t.tile_size(), "epsg:3857");
-    for (auto const& ds : ds_vec)
-    {
-        ds->set_envelope(t.get_buffered_extent());
-        mapnik::layer lyr(ds->get_name(), "epsg:3857");
-        lyr.set_datasource(ds);
-        map.add_layer(std::move(lyr));
-    }
-    mapnik::vector_tile_impl::processor ren(map);
-    ren.set_multi_polygon_union(true);
-    ren.set_fill_type(mapnik::vector_tile_impl::even_odd_fill);
-    ren.set_process_all_rings(true);
-    //ren.set_simplify_distance(4.0);
-    ren.update_tile(t);
-    t.buffer_size(prev_buffer_size);
 }
 
 inline void merge_from_compressed_buffer(merc_tile & t, const char * data, std::size_t size, bool validate = false, bool upgrade = false)
 {
-    if (mapnik::vector_tile_impl::is_gzip_compressed(data,size) ||
-        mapnik::vector_tile_impl::is_zlib_compressed(data,size))
+    std::string decompressed;
+    if (mapnik::vector_tile_impl::decompress(data, size, decompressed))
     {
-        std::string decompressed;
-        mapnik::vector_tile_impl::zlib_decompress(data, size, decompressed);
         return merge_from_buffer(t, decompressed.data(), decompressed.size(), validate, upgrade);
     }
     else
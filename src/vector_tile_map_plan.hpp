@@ -0,0 +1,158 @@
+#ifndef __MAPNIK_VECTOR_TILE_MAP_PLAN_H__
+#define __MAPNIK_VECTOR_TILE_MAP_PLAN_H__
+
+// mapnik
+#include <mapnik/datasource.hpp>
+#include <mapnik/feature_layer_desc.hpp>
+#include <mapnik/layer.hpp>
+#include <mapnik/map.hpp>
+#include <mapnik/projection.hpp>
+#include <mapnik/proj_transform.hpp>
+#include <mapnik/util/noncopyable.hpp>
+#include <mapnik/well_known_srs.hpp>
+
+// std
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+// The projections of a layer and the transform between them. The transform
+// refers to the projections, so this is never copied or moved once built.
+struct layer_projections : private mapnik::util::noncopyable
+{
+    mapnik::projection target;
+    mapnik::projection source;
+    mapnik::proj_transform transform;
+    // True when the data is in geographic wgs84 and the map in spherical mercator,
+    // which is projected in closed form by vector_tile_strategy_lonlat_merc.
+    bool lonlat_to_merc;
+
+    layer_projections(std::string const& target_srs, std::string const& source_srs)
+        : target(target_srs, true),
+          source(source_srs, true),
+          transform(target, source),
+          lonlat_to_merc(!transform.equal() &&
+                         mapnik::is_well_known_srs(target_srs) &&
+                         mapnik::is_well_known_srs(source_srs) &&
+                         source.is_geographic() &&
+                         !target.is_geographic()) {}
+};
+
+/*
+  Everything about a layer of a map that does not depend on the tile being
+  encoded. A plan is immutable once built and can be used by any number of
+  threads at the same time.
+*/
+
+class layer_plan : private mapnik::util::noncopyable
+{
+private:
+    std::string name_;
+    std::string srs_;
+    std::string target_srs_;
+    // Held so the datasource the property names were read from can not be
+    // freed and another one allocated at the same address
+    mapnik::datasource_ptr ds_;
+    std::vector<std::string> property_names_;
+    std::shared_ptr<layer_projections const> shared_projections_;
+
+public:
+    layer_plan(mapnik::Map const& map, mapnik::layer const& lay)
+        : name_(lay.name()),
+          srs_(lay.srs()),
+          target_srs_(map.srs()),
+          ds_(lay.datasource()),
+          property_names_(),
+          shared_projections_()
+    {
+        if (ds_)
+        {
+            for (mapnik::attribute_descriptor const& desc : ds_->get_descriptor().get_descriptors())
+            {
+                property_names_.push_back(desc.get_name());
+            }
+        }
+        // Transforms that go through PROJ can not be used by several threads at
+        // once, only identical and built in mercator/wgs84 transforms are shared.
+        if (target_srs_ == srs_ ||
+            (mapnik::is_well_known_srs(target_srs_) && mapnik::is_well_known_srs(srs_)))
+        {
+            shared_projections_ = std::make_shared<layer_projections>(target_srs_, srs_);
+        }
+    }
+
+    std::string const& name() const
+    {
+        return name_;
+    }
+
+    std::string const& srs() const
+    {
+        return srs_;
+    }
+
+    // True when the plan was built for this layer of this map
+    bool matches(mapnik::Map const& map, mapnik::layer const& lay) const
+    {
+        return name_ == lay.name() &&
+               srs_ == lay.srs() &&
+               target_srs_ == map.srs() &&
+               ds_ == lay.datasource();
+    }
+
+    // Attribute names of the datasource, read from its descriptor once
+    std::vector<std::string> const& property_names() const
+    {
+        return property_names_;
+    }
+
+    // Projections for one tile of this layer, they are only created when they
+    // can not be shared.
+    std::shared_ptr<layer_projections const> projections() const
+    {
+        if (shared_projections_)
+        {
+            return shared_projections_;
+        }
+        return std::make_shared<layer_projections>(target_srs_, srs_);
+    }
+};
+
+class map_plan : private mapnik::util::noncopyable
+{
+private:
+    std::vector<std::unique_ptr<layer_plan const> > layers_;
+
+public:
+    explicit map_plan(mapnik::Map const& map)
+        : layers_()
+    {
+        layers_.reserve(map.layers().size());
+        for (mapnik::layer const& lay : map.layers())
+        {
+            layers_.emplace_back(new layer_plan(map, lay));
+        }
+    }
+
+    std::size_t size() const
+    {
+        return layers_.size();
+    }
+
+    layer_plan const& layer(std::size_t index) const
+    {
+        return *layers_.at(index);
+    }
+};
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
+
+#endif // __MAPNIK_VECTOR_TILE_MAP_PLAN_H__
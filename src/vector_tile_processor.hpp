@@ -12,11 +12,16 @@
 
 // mapnik-vector-tile
 #include "vector_tile_config.hpp"
+#include "vector_tile_executor.hpp"
+#include "vector_tile_map_plan.hpp"
 #include "vector_tile_tile.hpp"
+#include "vector_tile_tile_sink.hpp"
 #include "vector_tile_merc_tile.hpp"
 
 // std
 #include <future>
+#include <memory>
+#include <vector>
 
 namespace mapnik
 {
@@ -46,9 +51,17 @@ private:
     bool strictly_simple_;
     bool multi_polygon_union_;
     bool process_all_rings_;
+    bool trusted_input_;
+    double reprojection_error_;
+    bool slice_features_;
     std::launch threading_mode_;
+    std::shared_ptr<executor> executor_;
+    std::size_t feature_chunk_size_;
+    std::shared_ptr<map_plan const> plan_;
     mapnik::attributes vars_;
 
+    MAPNIK_VECTOR_INLINE layer_plan const* get_layer_plan(std::size_t index) const;
+
 public:
     processor(mapnik::Map const& map, mapnik::attributes const& vars = mapnik::attributes())
         : m_(map),
@@ -61,7 +74,13 @@ public:
           strictly_simple_(true),
           multi_polygon_union_(false),
           process_all_rings_(false),
+          trusted_input_(false),
+          reprojection_error_(0.0),
+          slice_features_(false),
           threading_mode_(std::launch::deferred),
+          executor_(),
+          feature_chunk_size_(1024),
+          plan_(),
           vars_(vars) {}
 
     MAPNIK_VECTOR_INLINE void update_tile(tile & t,
@@ -69,6 +88,18 @@ public:
                                           int offset_x = 0,
                                           int offset_y = 0);
 
+    // Encodes the layers of the map that sink does not have yet for the tile
+    // of extent and gives each to sink once it and the layers before it are
+    // done, while the layers after it may still be encoded by the executor
+    // or the threading mode.
+    MAPNIK_VECTOR_INLINE void update_tile(tile_sink & sink,
+                                          mapnik::box2d<double> const& extent,
+                                          std::uint32_t tile_size = 4096,
+                                          std::int32_t buffer_size = 0,
+                                          double scale_denom = 0.0,
+                                          int offset_x = 0,
+                                          int offset_y = 0);
+
     merc_tile create_tile(std::uint64_t x,
                           std::uint64_t y,
                           std::uint64_t z,
@@ -95,6 +126,22 @@ public:
         return t;
     }
 
+    // Creates every tile of zoom z in the inclusive range [min_x, max_x] x [min_y, max_y].
+    // Each vector layer is queried once for the whole range and its features are
+    // binned to the tiles they touch before being encoded, so seeding a metatile
+    // does not read the same datasource rows once per tile. Tiles are returned
+    // in row major order.
+    MAPNIK_VECTOR_INLINE std::vector<merc_tile> create_tiles(std::uint64_t min_x,
+                                                             std::uint64_t min_y,
+                                                             std::uint64_t max_x,
+                                                             std::uint64_t max_y,
+                                                             std::uint64_t z,
+                                                             std::uint32_t tile_size = 4096,
+                                                             std::int32_t buffer_size = 0,
+                                                             double scale_denom = 0.0,
+                                                             int offset_x = 0,
+                                                             int offset_y = 0);
+
     void set_simplify_distance(double dist)
     {
         simplify_distance_ = dist;
@@ -135,6 +182,47 @@ public:
         return process_all_rings_;
     }
 
+    // Promises that every polygon of the datasources is valid, which lets the
+    // polygons entirely inside the tile skip the clipping and fixing by wagyu.
+    // Invalid polygons given with this set are encoded as they are.
+    void set_trusted_input(bool value)
+    {
+        trusted_input_ = value;
+    }
+
+    bool get_trusted_input() const
+    {
+        return trusted_input_;
+    }
+
+    // Largest error, in tile units, allowed when reprojecting layers through
+    // an interpolated grid instead of PROJ for every vertex. The default of 0
+    // reprojects exactly, errors well under 0.5 are hidden by the rounding to
+    // the integer coordinates of the tile.
+    void set_reprojection_error(double value)
+    {
+        reprojection_error_ = value;
+    }
+
+    double get_reprojection_error() const
+    {
+        return reprojection_error_;
+    }
+
+    // With this set create_tiles transforms every feature once for all of the
+    // tiles and cuts it into the tiles it touches, instead of transforming and
+    // clipping it again for each of them. The layers of the tiles are then
+    // encoded one after the other instead of by the executor.
+    void set_slice_features(bool value)
+    {
+        slice_features_ = value;
+    }
+
+    bool get_slice_features() const
+    {
+        return slice_features_;
+    }
+
     void set_multi_polygon_union(bool value)
     {
         multi_polygon_union_ = value;
@@ -200,6 +288,51 @@ public:
         return threading_mode_;
     }
 
+    // When an executor is set it is used instead of the threading mode: layers
+    // are encoded as tasks on the executor and large vector layers are split
+    // further in chunks of features encoded in parallel.
+    void set_executor(std::shared_ptr<executor> const& exec)
+    {
+        executor_ = exec;
+    }
+
+    std::shared_ptr<executor> const& get_executor() const
+    {
+        return executor_;
+    }
+
+    // Number of features per chunk when a layer is split on the executor,
+    // zero disables the splitting of layers.
+    void set_feature_chunk_size(std::size_t value)
+    {
+        feature_chunk_size_ = value;
+    }
+
+    std::size_t get_feature_chunk_size() const
+    {
+        return feature_chunk_size_;
+    }
+
+    // Builds the plan of the map once, so that the projections, transforms and
+    // attribute names of its layers are no longer recreated for every tile. The
+    // map must not gain or lose layers, nor change their datasources afterwards.
+    // A plan can also be built once and shared by the processors of several
+    // threads with set_plan.
+    void compile()
+    {
+        plan_ = std::make_shared<map_plan const>(m_);
+    }
+
+    void set_plan(std::shared_ptr<map_plan const> const& plan)
+    {
+        plan_ = plan;
+    }
+
+    std::shared_ptr<map_plan const> const& get_plan() const
+    {
+        return plan_;
+    }
+
 };
 
 } // end ns vector_tile_impl
@@ -1,10 +1,13 @@
 // mapnik-vector-tile
+#include "vector_tile_executor.hpp"
 #include "vector_tile_geometry_clipper.hpp"
 #include "vector_tile_geometry_feature.hpp"
 #include "vector_tile_geometry_simplifier.hpp"
+#include "vector_tile_geometry_slicer.hpp"
 #include "vector_tile_raster_clipper.hpp"
 #include "vector_tile_strategy.hpp"
 #include "vector_tile_tile.hpp"
+#include "vector_tile_tile_sink.hpp"
 #include "vector_tile_layer.hpp"
 
 // mapnik
@@ -14,6 +17,9 @@
 #include <mapnik/image_scaling.hpp>
 #include <mapnik/layer.hpp>
 #include <mapnik/map.hpp>
+#include <mapnik/projection.hpp>
+#include <mapnik/query.hpp>
+#include <mapnik/scale_denominator.hpp>
 #include <mapnik/version.hpp>
 #include <mapnik/attribute.hpp>
 
@@ -27,7 +33,14 @@
 #include <boost/optional.hpp>
 
 // std
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
 #include <future>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
 namespace mapnik
 {
@@ -38,142 +51,513 @@ namespace vector_tile_impl
 namespace detail
 {
 
-inline void create_geom_layer(tile_layer & layer,
+// Featureset over features that were already queried from a datasource,
+// used to feed binned features of a metatile query into the encoding chain.
+class binned_featureset : public mapnik::Featureset
+{
+private:
+    std::vector<mapnik::feature_ptr> const& features_;
+    std::vector<mapnik::feature_ptr>::const_iterator itr_;
+
+public:
+    explicit binned_featureset(std::vector<mapnik::feature_ptr> const& features)
+        : features_(features),
+          itr_(features_.begin()) {}
+
+    virtual ~binned_featureset() {}
+
+    mapnik::feature_ptr next()
+    {
+        if (itr_ == features_.end())
+        {
+            return mapnik::feature_ptr();
+        }
+        return *itr_++;
+    }
+};
+
+// Buffered extent of the layer in tile coordinates
+inline mapbox::geometry::box<std::int64_t> get_tile_clipping_extent(tile_layer const& layer)
+{
+    mapnik::vector_tile_impl::vector_tile_strategy vs(layer.get_view_transform());
+    mapnik::box2d<double> const& buffered_extent = layer.get_target_buffered_extent();
+    const mapbox::geometry::point<double> p1_min(buffered_extent.minx(), buffered_extent.miny());
+    const mapbox::geometry::point<double> p1_max(buffered_extent.maxx(), buffered_extent.maxy());
+    const mapbox::geometry::point<std::int64_t> p2_min = mapnik::geometry::transform<std::int64_t>(p1_min, vs);
+    const mapbox::geometry::point<std::int64_t> p2_max = mapnik::geometry::transform<std::int64_t>(p1_max, vs);
+    const double minx = std::min(p2_min.x, p2_max.x);
+    const double maxx = std::max(p2_min.x, p2_max.x);
+    const double miny = std::min(p2_min.y, p2_max.y);
+    const double maxy = std::max(p2_min.y, p2_max.y);
+    return mapbox::geometry::box<std::int64_t>(mapbox::geometry::point<std::int64_t>(minx, miny),
+                                               mapbox::geometry::point<std::int64_t>(maxx, maxy));
+}
+
+// Runs the features through the processing chain of the given strategy. The
+// chain is built once for all the features, so that the geometry buffers of its
+// processors are reused from one feature to the next.
+template <typename Strategy>
+inline void encode_features_with(Strategy const& strategy,
+                                 mapnik::box2d<double> const& buffered_extent,
+                                 mapbox::geometry::box<std::int64_t> const& tile_clipping_extent,
+                                 layer_builder_pbf & builder,
+                                 mapnik::featureset_ptr const& features,
+                                 mapnik::feature_ptr feature,
+                                 double simplify_distance,
+                                 double area_threshold,
+                                 polygon_fill_type fill_type,
+                                 bool strictly_simple,
+                                 bool multi_polygon_union,
+                                 bool process_all_rings,
+                                 bool trusted_input)
+{
+    using encoding_process = mapnik::vector_tile_impl::geometry_to_feature_pbf_visitor;
+    using clipping_process = mapnik::vector_tile_impl::geometry_clipper<encoding_process>;
+
+    encoding_process encoder(*feature, builder);
+    clipping_process clipper(tile_clipping_extent,
+                             area_threshold,
+                             strictly_simple,
+                             multi_polygon_union,
+                             fill_type,
+                             process_all_rings,
+                             trusted_input,
+                             encoder);
+    if (simplify_distance > 0)
+    {
+        using simplifier_process = mapnik::vector_tile_impl::geometry_simplifier<clipping_process>;
+        using transform_type = mapnik::vector_tile_impl::transform_visitor<Strategy, simplifier_process>;
+        simplifier_process simplifier(simplify_distance, clipper);
+        transform_type transformer(strategy, buffered_extent, simplifier);
+        while (feature)
+        {
+            encoder.set_feature(*feature);
+            mapnik::util::apply_visitor(transformer, feature->get_geometry());
+            feature = features->next();
+        }
+    }
+    else
+    {
+        using transform_type = mapnik::vector_tile_impl::transform_visitor<Strategy, clipping_process>;
+        transform_type transformer(strategy, buffered_extent, clipper);
+        while (feature)
+        {
+            encoder.set_feature(*feature);
+            mapnik::util::apply_visitor(transformer, feature->get_geometry());
+            feature = features->next();
+        }
+    }
+}
+
+inline void encode_features(tile_layer const& layer,
+                            layer_builder_pbf & builder,
+                            mapnik::featureset_ptr features,
+                            double simplify_distance,
+                            double area_threshold,
+                            polygon_fill_type fill_type,
+                            bool strictly_simple,
+                            bool multi_polygon_union,
+                            bool process_all_rings,
+                            bool trusted_input,
+                            double reprojection_error)
+{
+    if (!features)
+    {
+        return;
+    }
+
+    mapnik::feature_ptr feature = features->next();
+
+    if (!feature)
+    {
+        return;
+    }
+
+    mapnik::vector_tile_impl::vector_tile_strategy vs(layer.get_view_transform());
+    mapnik::box2d<double> const& buffered_extent = layer.get_target_buffered_extent();
+    const mapbox::geometry::box<std::int64_t> tile_clipping_extent = get_tile_clipping_extent(layer);
+
+    if (layer.get_proj_transform().equal())
+    {
+        encode_features_with(vs,
+                             buffered_extent,
+                             tile_clipping_extent,
+                             builder,
+                             features,
+                             std::move(feature),
+                             simplify_distance,
+                             area_threshold,
+                             fill_type,
+                             strictly_simple,
+                             multi_polygon_union,
+                             process_all_rings,
+                             trusted_input);
+    }
+    else if (layer.get_projections().lonlat_to_merc)
+    {
+        mapnik::vector_tile_impl::vector_tile_strategy_lonlat_merc vs2(layer.get_view_transform());
+        encode_features_with(vs2,
+                             layer.get_source_buffered_extent(),
+                             tile_clipping_extent,
+                             builder,
+                             features,
+                             std::move(feature),
+                             simplify_distance,
+                             area_threshold,
+                             fill_type,
+                             strictly_simple,
+                             multi_polygon_union,
+                             process_all_rings,
+                             trusted_input);
+    }
+    else
+    {
+        // Left empty when no error is allowed, the grid is otherwise built
+        // for the layer when its first point is reprojected, and points
+        // outside of it are reprojected exactly.
+        reprojection_grid grid(layer.get_proj_transform(),
+                               layer.get_view_transform(),
+                               layer.get_source_buffered_extent(),
+                               reprojection_error);
+        mapnik::vector_tile_impl::vector_tile_strategy_proj vs2(layer.get_proj_transform(),
+                                                                layer.get_view_transform(),
+                                                                &grid);
+        encode_features_with(vs2,
+                             layer.get_source_buffered_extent(),
+                             tile_clipping_extent,
+                             builder,
+                             features,
+                             std::move(feature),
+                             simplify_distance,
+                             area_threshold,
+                             fill_type,
+                             strictly_simple,
+                             multi_polygon_union,
+                             process_all_rings,
+                             trusted_input);
+    }
+}
+
+inline void encode_geom_layer(tile_layer & layer,
+                              mapnik::featureset_ptr features,
                               double simplify_distance,
                               double area_threshold,
                               polygon_fill_type fill_type,
                               bool strictly_simple,
                               bool multi_polygon_union,
-                              bool process_all_rings)
+                              bool process_all_rings,
+                              bool trusted_input,
+                              double reprojection_error)
 {
     layer_builder_pbf builder(layer.name(), layer.layer_extent(), layer.get_data());
+    encode_features(layer,
+                    builder,
+                    features,
+                    simplify_distance,
+                    area_threshold,
+                    fill_type,
+                    strictly_simple,
+                    multi_polygon_union,
+                    process_all_rings,
+                    trusted_input,
+                    reprojection_error);
+    layer.build(builder);
+}
 
-    // query for the features
-    mapnik::featureset_ptr features = layer.get_features();
-
-    if (!features)
+// Splits the features of a layer in chunks of chunk_size features, encodes every
+// chunk into its own fragment on the executor and merges the fragments back in
+// order, so the layer is the same as the one built by encode_geom_layer.
+inline void encode_geom_layer_chunked(tile_layer & layer,
+                                      mapnik::featureset_ptr features,
+                                      executor & exec,
+                                      std::size_t chunk_size,
+                                      double simplify_distance,
+                                      double area_threshold,
+                                      polygon_fill_type fill_type,
+                                      bool strictly_simple,
+                                      bool multi_polygon_union,
+                                      bool process_all_rings,
+                                      bool trusted_input,
+                                      double reprojection_error)
+{
+    // Reprojection goes through PROJ which can not be shared between threads,
+    // only the closed form wgs84 to mercator strategy can run in chunks.
+    if (chunk_size == 0 || !features ||
+        !(layer.get_proj_transform().equal() || layer.get_projections().lonlat_to_merc))
     {
+        encode_geom_layer(layer,
+                          features,
+                          simplify_distance,
+                          area_threshold,
+                          fill_type,
+                          strictly_simple,
+                          multi_polygon_union,
+                          process_all_rings,
+                          trusted_input,
+                          reprojection_error);
         return;
     }
 
+    // deques so that running tasks keep valid references while more chunks are read
+    std::deque<std::vector<mapnik::feature_ptr> > chunks;
+    std::deque<std::string> fragment_buffers;
+    std::deque<layer_builder_pbf> fragments;
+    task_group group(exec);
+
     mapnik::feature_ptr feature = features->next();
+    while (feature)
+    {
+        chunks.emplace_back();
+        std::vector<mapnik::feature_ptr> & chunk = chunks.back();
+        chunk.reserve(chunk_size);
+        while (feature && chunk.size() < chunk_size)
+        {
+            chunk.push_back(std::move(feature));
+            feature = features->next();
+        }
+        if (!feature && chunks.size() == 1)
+        {
+            // Not worth splitting
+            encode_geom_layer(layer,
+                              std::make_shared<binned_featureset>(chunk),
+                              simplify_distance,
+                              area_threshold,
+                              fill_type,
+                              strictly_simple,
+                              multi_polygon_union,
+                              process_all_rings,
+                              trusted_input,
+                              reprojection_error);
+            return;
+        }
+        fragment_buffers.emplace_back();
+        fragments.emplace_back(fragment_buffers.back());
+        layer_builder_pbf & fragment = fragments.back();
+        tile_layer const& layer_ref = layer;
+        group.run([&layer_ref, &fragment, &chunk, simplify_distance, area_threshold, fill_type,
+                   strictly_simple, multi_polygon_union, process_all_rings, trusted_input,
+                   reprojection_error]() {
+            encode_features(layer_ref,
+                            fragment,
+                            std::make_shared<binned_featureset>(chunk),
+                            simplify_distance,
+                            area_threshold,
+                            fill_type,
+                            strictly_simple,
+                            multi_polygon_union,
+                            process_all_rings,
+                            trusted_input,
+                            reprojection_error);
+        });
+    }
+    group.wait();
 
-    if (!feature)
+    layer_builder_pbf builder(layer.name(), layer.layer_extent(), layer.get_data());
+    for (auto const& fragment : fragments)
     {
-        return;
+        builder.merge(fragment);
     }
+    layer.build(builder);
+}
 
+inline void create_geom_layer(tile_layer & layer,
+                              double simplify_distance,
+                              double area_threshold,
+                              polygon_fill_type fill_type,
+                              bool strictly_simple,
+                              bool multi_polygon_union,
+                              bool process_all_rings,
+                              bool trusted_input,
+                              double reprojection_error)
+{
+    // query for the features
+    encode_geom_layer(layer,
+                      layer.get_features(),
+                      simplify_distance,
+                      area_threshold,
+                      fill_type,
+                      strictly_simple,
+                      multi_polygon_union,
+                      process_all_rings,
+                      trusted_input,
+                      reprojection_error);
+}
+
+// Encodes features into the layers of a grid of tiles given in row major order.
+// Every feature is transformed once, by a strategy whose view covers the whole
+// grid, and cut into the tiles it touches by a geometry_slicer.
+template <typename Strategy>
+inline void slice_features_with(Strategy const& strategy,
+                                mapnik::box2d<double> const& buffered_extent,
+                                std::vector<tile_layer> const& layers,
+                                std::vector<layer_builder_pbf*> const& builders,
+                                std::size_t cols,
+                                std::size_t rows,
+                                std::int64_t tile_size,
+                                mapnik::featureset_ptr const& features,
+                                mapnik::feature_ptr feature,
+                                double simplify_distance,
+                                double area_threshold,
+                                polygon_fill_type fill_type,
+                                bool strictly_simple,
+                                bool multi_polygon_union,
+                                bool process_all_rings,
+                                bool trusted_input)
+{
     using encoding_process = mapnik::vector_tile_impl::geometry_to_feature_pbf_visitor;
     using clipping_process = mapnik::vector_tile_impl::geometry_clipper<encoding_process>;
+    using slicing_process = mapnik::vector_tile_impl::geometry_slicer<clipping_process>;
 
-    mapnik::vector_tile_impl::vector_tile_strategy vs(layer.get_view_transform());
-    mapnik::box2d<double> const& buffered_extent = layer.get_target_buffered_extent();
-    const mapbox::geometry::point<double> p1_min(buffered_extent.minx(), buffered_extent.miny());
-    const mapbox::geometry::point<double> p1_max(buffered_extent.maxx(), buffered_extent.maxy());
-    const mapbox::geometry::point<std::int64_t> p2_min = mapnik::geometry::transform<std::int64_t>(p1_min, vs);
-    const mapbox::geometry::point<std::int64_t> p2_max = mapnik::geometry::transform<std::int64_t>(p1_max, vs);
-    const double minx = std::min(p2_min.x, p2_max.x);
-    const double maxx = std::max(p2_min.x, p2_max.x);
-    const double miny = std::min(p2_min.y, p2_max.y);
-    const double maxy = std::max(p2_min.y, p2_max.y);
-    const mapbox::geometry::box<std::int64_t> tile_clipping_extent(mapbox::geometry::point<std::int64_t>(minx, miny),
-                                                                   mapbox::geometry::point<std::int64_t>(maxx, maxy));
+    std::deque<mapbox::geometry::box<std::int64_t> > tile_boxes;
+    std::deque<encoding_process> encoders;
+    std::deque<clipping_process> clippers;
+    std::vector<mapbox::geometry::box<std::int64_t> > grid_boxes;
+    std::vector<clipping_process*> tiles(layers.size(), nullptr);
+    grid_boxes.reserve(layers.size());
+    for (std::size_t i = 0; i < layers.size(); ++i)
+    {
+        mapbox::geometry::box<std::int64_t> box = get_tile_clipping_extent(layers[i]);
+        std::int64_t dx = static_cast<std::int64_t>(i % cols) * tile_size;
+        std::int64_t dy = static_cast<std::int64_t>(i / cols) * tile_size;
+        grid_boxes.emplace_back(mapbox::geometry::point<std::int64_t>(box.min.x + dx, box.min.y + dy),
+                                mapbox::geometry::point<std::int64_t>(box.max.x + dx, box.max.y + dy));
+        if (!builders[i])
+        {
+            continue;
+        }
+        tile_boxes.push_back(box);
+        encoders.emplace_back(*feature, *builders[i]);
+        clippers.emplace_back(tile_boxes.back(),
+                              area_threshold,
+                              strictly_simple,
+                              multi_polygon_union,
+                              fill_type,
+                              process_all_rings,
+                              trusted_input,
+                              encoders.back());
+        tiles[i] = &clippers.back();
+    }
 
+    slicing_process slicer(cols, rows, tile_size, tiles, grid_boxes);
     if (simplify_distance > 0)
     {
-        using simplifier_process = mapnik::vector_tile_impl::geometry_simplifier<clipping_process>;
-        if (layer.get_proj_transform().equal())
+        using simplifier_process = mapnik::vector_tile_impl::geometry_simplifier<slicing_process>;
+        using transform_type = mapnik::vector_tile_impl::transform_visitor<Strategy, simplifier_process>;
+        simplifier_process simplifier(simplify_distance, slicer);
+        transform_type transformer(strategy, buffered_extent, simplifier);
+        while (feature)
         {
-            using strategy_type = mapnik::vector_tile_impl::vector_tile_strategy;
-            using transform_type = mapnik::vector_tile_impl::transform_visitor<strategy_type, simplifier_process>;
-            while (feature)
+            for (auto & encoder : encoders)
             {
-                mapnik::geometry::geometry<double> const& geom = feature->get_geometry();
-                encoding_process encoder(*feature, builder);
-                clipping_process clipper(tile_clipping_extent,
-                                         area_threshold,
-                                         strictly_simple,
-                                         multi_polygon_union,
-                                         fill_type,
-                                         process_all_rings,
-                                         encoder);
-                simplifier_process simplifier(simplify_distance, clipper);
-                transform_type transformer(vs, buffered_extent, simplifier);
-                mapnik::util::apply_visitor(transformer, geom);
-                feature = features->next();
+                encoder.set_feature(*feature);
             }
+            mapnik::util::apply_visitor(transformer, feature->get_geometry());
+            feature = features->next();
         }
-        else
+    }
+    else
+    {
+        using transform_type = mapnik::vector_tile_impl::transform_visitor<Strategy, slicing_process>;
+        transform_type transformer(strategy, buffered_extent, slicer);
+        while (feature)
         {
-            using strategy_type = mapnik::vector_tile_impl::vector_tile_strategy_proj;
-            using transform_type = mapnik::vector_tile_impl::transform_visitor<strategy_type, simplifier_process>;
-            strategy_type vs2(layer.get_proj_transform(), layer.get_view_transform());
-            mapnik::box2d<double> const& trans_buffered_extent = layer.get_source_buffered_extent();
-            while (feature)
+            for (auto & encoder : encoders)
             {
-                mapnik::geometry::geometry<double> const& geom = feature->get_geometry();
-                encoding_process encoder(*feature, builder);
-                clipping_process clipper(tile_clipping_extent,
-                                         area_threshold,
-                                         strictly_simple,
-                                         multi_polygon_union,
-                                         fill_type,
-                                         process_all_rings,
-                                         encoder);
-                simplifier_process simplifier(simplify_distance, clipper);
-                transform_type transformer(vs2, trans_buffered_extent, simplifier);
-                mapnik::util::apply_visitor(transformer, geom);
-                feature = features->next();
+                encoder.set_feature(*feature);
             }
+            mapnik::util::apply_visitor(transformer, feature->get_geometry());
+            feature = features->next();
         }
     }
-    else
+}
+
+// Encodes the features of a layer queried once for a grid of tiles directly into
+// the layers of every tile, see slice_features_with. The layers of the tiles
+// that are not valid are left alone.
+inline void slice_geom_layers(std::vector<tile_layer> & layers,
+                              std::size_t cols,
+                              std::size_t rows,
+                              mapnik::box2d<double> const& grid_extent,
+                              int offset_x,
+                              int offset_y,
+                              mapnik::featureset_ptr features,
+                              double simplify_distance,
+                              double area_threshold,
+                              polygon_fill_type fill_type,
+                              bool strictly_simple,
+                              bool multi_polygon_union,
+                              bool process_all_rings,
+                              bool trusted_input,
+                              double reprojection_error)
+{
+    std::deque<layer_builder_pbf> builder_storage;
+    std::vector<layer_builder_pbf*> builders(layers.size(), nullptr);
+    tile_layer const* first_valid = nullptr;
+    mapnik::box2d<double> buffered_extent;
+    for (std::size_t i = 0; i < layers.size(); ++i)
     {
-        if (layer.get_proj_transform().equal())
+        tile_layer & layer = layers[i];
+        if (!layer.is_valid())
         {
-            using strategy_type = mapnik::vector_tile_impl::vector_tile_strategy;
-            using transform_type = mapnik::vector_tile_impl::transform_visitor<strategy_type, clipping_process>;
-            while (feature)
-            {
-                mapnik::geometry::geometry<double> const& geom = feature->get_geometry();
-                encoding_process encoder(*feature, builder);
-                clipping_process clipper(tile_clipping_extent,
-                                         area_threshold,
-                                         strictly_simple,
-                                         multi_polygon_union,
-                                         fill_type,
-                                         process_all_rings,
-                                         encoder);
-                transform_type transformer(vs, buffered_extent, clipper);
-                mapnik::util::apply_visitor(transformer, geom);
-                feature = features->next();
-            }
+            continue;
+        }
+        builder_storage.emplace_back(layer.name(), layer.layer_extent(), layer.get_data());
+        builders[i] = &builder_storage.back();
+        if (!first_valid)
+        {
+            first_valid = &layer;
+            buffered_extent = layer.get_source_buffered_extent();
         }
         else
         {
-            using strategy_type = mapnik::vector_tile_impl::vector_tile_strategy_proj;
-            using transform_type = mapnik::vector_tile_impl::transform_visitor<strategy_type, clipping_process>;
-            strategy_type vs2(layer.get_proj_transform(), layer.get_view_transform());
-            mapnik::box2d<double> const& trans_buffered_extent = layer.get_source_buffered_extent();
-            while (feature)
-            {
-                mapnik::geometry::geometry<double> const& geom = feature->get_geometry();
-                encoding_process encoder(*feature, builder);
-                clipping_process clipper(tile_clipping_extent,
-                                         area_threshold,
-                                         strictly_simple,
-                                         multi_polygon_union,
-                                         fill_type,
-                                         process_all_rings,
-                                         encoder);
-                transform_type transformer(vs2, trans_buffered_extent, clipper);
-                mapnik::util::apply_visitor(transformer, geom);
-                feature = features->next();
-            }
+            buffered_extent.expand_to_include(layer.get_source_buffered_extent());
+        }
+    }
+
+    mapnik::feature_ptr feature = features ? features->next() : mapnik::feature_ptr();
+    if (first_valid && feature)
+    {
+        std::int64_t tile_size = first_valid->layer_extent();
+        mapnik::view_transform grid_transform(static_cast<int>(cols * tile_size),
+                                              static_cast<int>(rows * tile_size),
+                                              grid_extent,
+                                              offset_x,
+                                              offset_y);
+        layer_projections const& projections = first_valid->get_projections();
+        if (projections.transform.equal())
+        {
+            mapnik::vector_tile_impl::vector_tile_strategy vs(grid_transform);
+            slice_features_with(vs, buffered_extent, layers, builders, cols, rows, tile_size,
+                                features, std::move(feature), simplify_distance, area_threshold,
+                                fill_type, strictly_simple, multi_polygon_union, process_all_rings,
+                                trusted_input);
+        }
+        else if (projections.lonlat_to_merc)
+        {
+            mapnik::vector_tile_impl::vector_tile_strategy_lonlat_merc vs(grid_transform);
+            slice_features_with(vs, buffered_extent, layers, builders, cols, rows, tile_size,
+                                features, std::move(feature), simplify_distance, area_threshold,
+                                fill_type, strictly_simple, multi_polygon_union, process_all_rings,
+                                trusted_input);
+        }
+        else
+        {
+            reprojection_grid grid(projections.transform, grid_transform, buffered_extent, reprojection_error);
+            mapnik::vector_tile_impl::vector_tile_strategy_proj vs(projections.transform, grid_transform, &grid);
+            slice_features_with(vs, buffered_extent, layers, builders, cols, rows, tile_size,
+                                features, std::move(feature), simplify_distance, area_threshold,
+                                fill_type, strictly_simple, multi_polygon_union, process_all_rings,
+                                trusted_input);
+        }
+    }
+
+    for (std::size_t i = 0; i < layers.size(); ++i)
+    {
+        if (builders[i])
+        {
+            layers[i].build(*builders[i]);
         }
     }
-    layer.build(builder);
-    return;
 }
 
 inline void create_raster_layer(tile_layer & layer,
@@ -236,44 +620,168 @@ inline void create_raster_layer(tile_layer & layer,
     return;
 }
 
+// State of a layer encoded on the executor, so that update_tile can give the
+// layers to its sink in order as they are done
+enum layer_status : int
+{
+    layer_pending = 0,
+    layer_done,
+    layer_failed
+};
+
+// Marks the layer failed unless done is called, as the task may throw
+class layer_status_guard
+{
+    std::atomic<int> & status_;
+    bool done_;
+
+public:
+    explicit layer_status_guard(std::atomic<int> & status)
+        : status_(status),
+          done_(false) {}
+
+    ~layer_status_guard()
+    {
+        status_.store(done_ ? layer_done : layer_failed);
+    }
+
+    void done()
+    {
+        done_ = true;
+    }
+};
+
 } // end ns detail
 
+MAPNIK_VECTOR_INLINE layer_plan const* processor::get_layer_plan(std::size_t index) const
+{
+    if (!plan_)
+    {
+        return nullptr;
+    }
+    if (plan_->size() != m_.layers().size())
+    {
+        throw std::runtime_error("vector_tile_processor: the plan does not match the layers of the map");
+    }
+    layer_plan const& plan = plan_->layer(index);
+    mapnik::layer const& lay = m_.layers()[index];
+    if (!plan.matches(m_, lay))
+    {
+        throw std::runtime_error("vector_tile_processor: the plan does not match the layer '" + lay.name() + "' of the map");
+    }
+    return &plan;
+}
+
 MAPNIK_VECTOR_INLINE void processor::update_tile(tile & t,
                                                  double scale_denom,
                                                  int offset_x,
                                                  int offset_y)
 {
-    // Futures
+    tile_builder_sink sink(t);
+    update_tile(sink, t.extent(), t.tile_size(), t.buffer_size(), scale_denom, offset_x, offset_y);
+}
+
+MAPNIK_VECTOR_INLINE void processor::update_tile(tile_sink & sink,
+                                                 mapnik::box2d<double> const& extent,
+                                                 std::uint32_t tile_size,
+                                                 std::int32_t buffer_size,
+                                                 double scale_denom,
+                                                 int offset_x,
+                                                 int offset_y)
+{
+    // Layers that are not valid are given to the sink as empty ones, in
+    // their place in the map
     std::vector<tile_layer> tile_layers;
+    tile_layers.reserve(m_.layers().size());
 
-    for (mapnik::layer const& lay : m_.layers())
+    for (std::size_t i = 0; i < m_.layers().size(); ++i)
     {
-        if (t.has_layer(lay.name()))
+        mapnik::layer const& lay = m_.layers()[i];
+        if (sink.has_layer(lay.name()))
         {
             continue;
         }
         tile_layers.emplace_back(m_,
                              lay,
-                             t.extent(),
-                             t.tile_size(),
-                             t.buffer_size(),
+                             extent,
+                             tile_size,
+                             buffer_size,
                              scale_factor_,
                              scale_denom,
                              offset_x,
                              offset_y,
-                             vars_);
-        if (!tile_layers.back().is_valid())
+                             vars_,
+                             get_layer_plan(i));
+    }
+
+    if (executor_)
+    {
+        std::unique_ptr<std::atomic<int>[]> status(new std::atomic<int>[tile_layers.size()]);
+        task_group group(*executor_);
+        for (std::size_t i = 0; i < tile_layers.size(); ++i)
         {
-            t.add_empty_layer(lay.name());
-            tile_layers.pop_back();
-            continue;
+            tile_layer * layer_ptr = &tile_layers[i];
+            std::atomic<int> * layer_status = &status[i];
+            if (!layer_ptr->is_valid())
+            {
+                layer_status->store(detail::layer_done);
+                continue;
+            }
+            layer_status->store(detail::layer_pending);
+            if (layer_ptr->get_ds()->type() == datasource::Vector)
+            {
+                group.run([this, layer_ptr, layer_status]() {
+                    detail::layer_status_guard guard(*layer_status);
+                    detail::encode_geom_layer_chunked(*layer_ptr,
+                                                      layer_ptr->get_features(),
+                                                      *executor_,
+                                                      feature_chunk_size_,
+                                                      simplify_distance_,
+                                                      area_threshold_,
+                                                      fill_type_,
+                                                      strictly_simple_,
+                                                      multi_polygon_union_,
+                                                      process_all_rings_,
+                                                      trusted_input_,
+                                                      reprojection_error_);
+                    guard.done();
+                });
+            }
+            else // Raster
+            {
+                group.run([this, layer_ptr, layer_status]() {
+                    detail::layer_status_guard guard(*layer_status);
+                    detail::create_raster_layer(*layer_ptr,
+                                                image_format_,
+                                                scaling_method_);
+                    guard.done();
+                });
+            }
+        }
+        for (std::size_t i = 0; i < tile_layers.size(); ++i)
+        {
+            // Help with the queued tasks while the next layer in order is encoded
+            std::atomic<int> const& layer_status = status[i];
+            group.wait_until([&layer_status]() { return layer_status.load() != detail::layer_pending; });
+            if (status[i].load() == detail::layer_failed)
+            {
+                // Rethrows the error of the layer
+                group.wait();
+                throw std::runtime_error("vector_tile_processor: failed to encode layer " + tile_layers[i].name());
+            }
+            sink.add_layer(tile_layers[i]);
         }
+        group.wait();
     }
-
-    if (threading_mode_ == std::launch::deferred)
+    else if (threading_mode_ == std::launch::deferred)
     {
         for (auto & layer_ref : tile_layers)
         {
+            if (!layer_ref.is_valid())
+            {
+                sink.add_layer(layer_ref);
+                continue;
+            }
             if (layer_ref.get_ds()->type() == datasource::Vector)
             {
                 detail::create_geom_layer(layer_ref,
@@ -282,7 +790,9 @@ MAPNIK_VECTOR_INLINE void processor::update_tile(tile & t,
                                           fill_type_,
                                           strictly_simple_,
                                           multi_polygon_union_,
-                                          process_all_rings_
+                                          process_all_rings_,
+                                          trusted_input_,
+                                          reprojection_error_
                                          );
             }
             else // Raster
@@ -292,18 +802,24 @@ MAPNIK_VECTOR_INLINE void processor::update_tile(tile & t,
                                             scaling_method_
                                            );
             }
+            sink.add_layer(layer_ref);
         }
     }
     else
     {
-        std::vector<std::future<void> > future_layers;
-        future_layers.reserve(tile_layers.size());
+        // Layers that are not valid are left with an empty future
+        std::vector<std::future<void> > future_layers(tile_layers.size());
 
-        for (auto & layer_ref : tile_layers)
+        for (std::size_t i = 0; i < tile_layers.size(); ++i)
         {
+            tile_layer & layer_ref = tile_layers[i];
+            if (!layer_ref.is_valid())
+            {
+                continue;
+            }
             if (layer_ref.get_ds()->type() == datasource::Vector)
             {
-                future_layers.push_back(std::async(
+                future_layers[i] = std::async(
                                         threading_mode_,
                                         detail::create_geom_layer,
                                         std::ref(layer_ref),
@@ -312,35 +828,377 @@ MAPNIK_VECTOR_INLINE void processor::update_tile(tile & t,
                                         fill_type_,
                                         strictly_simple_,
                                         multi_polygon_union_,
-                                        process_all_rings_
-                            ));
+                                        process_all_rings_,
+                                        trusted_input_,
+                                        reprojection_error_
+                            );
             }
             else // Raster
             {
-                future_layers.push_back(std::async(
+                future_layers[i] = std::async(
                                         threading_mode_,
                                         detail::create_raster_layer,
                                         std::ref(layer_ref),
                                         image_format_,
                                         scaling_method_
-                ));
+                );
+            }
+            if (!future_layers[i].valid())
+            {
+                throw std::runtime_error("unexpected invalid async return");
             }
         }
 
-        for (auto && lay_future : future_layers)
+        for (std::size_t i = 0; i < tile_layers.size(); ++i)
         {
-            if (!lay_future.valid())
+            if (future_layers[i].valid())
             {
-                throw std::runtime_error("unexpected invalid async return");
+                future_layers[i].get();
             }
-            lay_future.get();
+            sink.add_layer(tile_layers[i]);
+        }
+    }
+    sink.finish();
+}
+
+MAPNIK_VECTOR_INLINE std::vector<merc_tile> processor::create_tiles(std::uint64_t min_x,
+                                                                    std::uint64_t min_y,
+                                                                    std::uint64_t max_x,
+                                                                    std::uint64_t max_y,
+                                                                    std::uint64_t z,
+                                                                    std::uint32_t tile_size,
+                                                                    std::int32_t buffer_size,
+                                                                    double scale_denom,
+                                                                    int offset_x,
+                                                                    int offset_y)
+{
+    if (max_x < min_x || max_y < min_y)
+    {
+        throw std::runtime_error("vector_tile_processor: invalid tile range for create_tiles");
+    }
+    std::size_t cols = static_cast<std::size_t>(max_x - min_x + 1);
+    std::size_t rows = static_cast<std::size_t>(max_y - min_y + 1);
+
+    std::vector<merc_tile> tiles;
+    tiles.reserve(cols * rows);
+    for (std::uint64_t y = min_y; y <= max_y; ++y)
+    {
+        for (std::uint64_t x = min_x; x <= max_x; ++x)
+        {
+            tiles.emplace_back(x, y, z, tile_size, buffer_size);
         }
     }
 
-    for (auto & layer_ref : tile_layers)
+    if (tiles.size() == 1)
     {
-        t.add_layer(layer_ref);
+        update_tile(tiles.front(), scale_denom, offset_x, offset_y);
+        return tiles;
+    }
+
+    // All tiles must share the scale denominator of a single tile, not the one
+    // that would be derived from the size of the whole metatile.
+    if (scale_denom <= 0.0)
+    {
+        mapnik::projection target_proj(m_.srs(), true);
+        double scale = tiles.front().extent().width() / VT_LEGACY_IMAGE_SIZE;
+        scale_denom = mapnik::scale_denominator(scale, target_proj.is_geographic());
+    }
+
+    mapnik::box2d<double> metatile_extent(tiles.front().extent());
+    metatile_extent.expand_to_include(tiles.back().extent());
+    double const tile_width = tiles.front().extent().width();
+    double const tile_height = tiles.front().extent().height();
+
+    for (std::size_t layer_index = 0; layer_index < m_.layers().size(); ++layer_index)
+    {
+        mapnik::layer const& lay = m_.layers()[layer_index];
+        // As in update_tile, a tile that already has a layer of this name,
+        // from an earlier map layer with the same name, is left alone
+        std::vector<bool> skip(tiles.size());
+        bool skip_all = true;
+        for (std::size_t i = 0; i < tiles.size(); ++i)
+        {
+            skip[i] = tiles[i].has_layer(lay.name());
+            skip_all = skip_all && skip[i];
+        }
+        if (skip_all)
+        {
+            continue;
+        }
+        layer_plan const* plan = get_layer_plan(layer_index);
+        std::vector<tile_layer> tile_layers;
+        tile_layers.reserve(tiles.size());
+        mapnik::box2d<double> query_extent;
+        mapnik::box2d<double> unbuffered_query_extent;
+        double margin = 0.0;
+        tile_layer const* first_valid = nullptr;
+        for (std::size_t i = 0; i < tiles.size(); ++i)
+        {
+            merc_tile const& t = tiles[i];
+            tile_layers.emplace_back(m_,
+                                     lay,
+                                     t.extent(),
+                                     t.tile_size(),
+                                     t.buffer_size(),
+                                     scale_factor_,
+                                     scale_denom,
+                                     offset_x,
+                                     offset_y,
+                                     vars_,
+                                     plan);
+            tile_layer const& tl = tile_layers.back();
+            if (skip[i] || !tl.is_valid())
+            {
+                continue;
+            }
+            if (!first_valid)
+            {
+                query_extent = tl.get_query().get_bbox();
+                unbuffered_query_extent = tl.get_query().get_unbuffered_bbox();
+                margin = 0.5 * (tl.get_target_buffered_extent().width() - t.extent().width());
+                first_valid = &tl;
+            }
+            else
+            {
+                query_extent.expand_to_include(tl.get_query().get_bbox());
+                unbuffered_query_extent.expand_to_include(tl.get_query().get_unbuffered_bbox());
+            }
+        }
+
+        if (!first_valid)
+        {
+            for (std::size_t i = 0; i < tiles.size(); ++i)
+            {
+                if (!skip[i])
+                {
+                    tiles[i].add_empty_layer(lay.name());
+                }
+            }
+            continue;
+        }
+
+        std::vector<std::vector<mapnik::feature_ptr> > bins(tiles.size());
+        bool is_vector = first_valid->get_ds()->type() == datasource::Vector;
+        bool sliced = false;
+        if (is_vector)
+        {
+            // One query for the whole metatile, features are then binned, or
+            // sliced, to every tile whose buffered extent they touch.
+            mapnik::query q(first_valid->get_query());
+            q.set_bbox(query_extent);
+            q.set_unbuffered_bbox(unbuffered_query_extent);
+            mapnik::featureset_ptr features = first_valid->get_ds()->features(q);
+            if (slice_features_)
+            {
+                detail::slice_geom_layers(tile_layers,
+                                          cols,
+                                          rows,
+                                          metatile_extent,
+                                          offset_x,
+                                          offset_y,
+                                          features,
+                                          simplify_distance_,
+                                          area_threshold_,
+                                          fill_type_,
+                                          strictly_simple_,
+                                          multi_polygon_union_,
+                                          process_all_rings_,
+                                          trusted_input_,
+                                          reprojection_error_);
+                sliced = true;
+            }
+            else
+            {
+                mapnik::proj_transform const& prj_trans = first_valid->get_proj_transform();
+                mapnik::feature_ptr feature = features ? features->next() : mapnik::feature_ptr();
+                while (feature)
+                {
+                    mapnik::box2d<double> env = mapnik::geometry::envelope(feature->get_geometry());
+                    if (!env.valid())
+                    {
+                        feature = features->next();
+                        continue;
+                    }
+                    std::size_t first_col = 0;
+                    std::size_t last_col = cols - 1;
+                    std::size_t first_row = 0;
+                    std::size_t last_row = rows - 1;
+                    mapnik::box2d<double> target_env(env);
+                    if (prj_trans.equal() || prj_trans.backward(target_env, PROJ_ENVELOPE_POINTS))
+                    {
+                        double c0 = std::floor((target_env.minx() - margin - metatile_extent.minx()) / tile_width);
+                        double c1 = std::floor((target_env.maxx() + margin - metatile_extent.minx()) / tile_width);
+                        double r0 = std::floor((metatile_extent.maxy() - target_env.maxy() - margin) / tile_height);
+                        double r1 = std::floor((metatile_extent.maxy() - target_env.miny() + margin) / tile_height);
+                        if (c1 < 0.0 || r1 < 0.0 || c0 >= static_cast<double>(cols) || r0 >= static_cast<double>(rows))
+                        {
+                            feature = features->next();
+                            continue;
+                        }
+                        first_col = c0 > 0.0 ? static_cast<std::size_t>(c0) : 0;
+                        first_row = r0 > 0.0 ? static_cast<std::size_t>(r0) : 0;
+                        last_col = std::min(cols - 1, static_cast<std::size_t>(c1));
+                        last_row = std::min(rows - 1, static_cast<std::size_t>(r1));
+                    }
+                    for (std::size_t row = first_row; row <= last_row; ++row)
+                    {
+                        for (std::size_t col = first_col; col <= last_col; ++col)
+                        {
+                            std::size_t idx = row * cols + col;
+                            tile_layer const& tl = tile_layers[idx];
+                            if (!skip[idx] && tl.is_valid() && tl.get_source_buffered_extent().intersects(env))
+                            {
+                                bins[idx].push_back(feature);
+                            }
+                        }
+                    }
+                    feature = features->next();
+                }
+            }
+        }
+
+        if (sliced)
+        {
+            // Every tile layer is already encoded
+        }
+        else if (executor_)
+        {
+            task_group group(*executor_);
+            for (std::size_t i = 0; i < tile_layers.size(); ++i)
+            {
+                tile_layer * layer_ptr = &tile_layers[i];
+                if (skip[i] || !layer_ptr->is_valid())
+                {
+                    continue;
+                }
+                if (is_vector)
+                {
+                    std::vector<mapnik::feature_ptr> const* bin = &bins[i];
+                    group.run([this, layer_ptr, bin]() {
+                        detail::encode_geom_layer_chunked(*layer_ptr,
+                                                          std::make_shared<detail::binned_featureset>(*bin),
+                                                          *executor_,
+                                                          feature_chunk_size_,
+                                                          simplify_distance_,
+                                                          area_threshold_,
+                                                          fill_type_,
+                                                          strictly_simple_,
+                                                          multi_polygon_union_,
+                                                          process_all_rings_,
+                                                          trusted_input_,
+                                                          reprojection_error_);
+                    });
+                }
+                else // Raster
+                {
+                    group.run([this, layer_ptr]() {
+                        detail::create_raster_layer(*layer_ptr,
+                                                    image_format_,
+                                                    scaling_method_);
+                    });
+                }
+            }
+            group.wait();
+        }
+        else if (threading_mode_ == std::launch::deferred)
+        {
+            for (std::size_t i = 0; i < tile_layers.size(); ++i)
+            {
+                tile_layer & layer_ref = tile_layers[i];
+                if (skip[i] || !layer_ref.is_valid())
+                {
+                    continue;
+                }
+                if (is_vector)
+                {
+                    detail::encode_geom_layer(layer_ref,
+                                              std::make_shared<detail::binned_featureset>(bins[i]),
+                                              simplify_distance_,
+                                              area_threshold_,
+                                              fill_type_,
+                                              strictly_simple_,
+                                              multi_polygon_union_,
+                                              process_all_rings_,
+                                              trusted_input_,
+                                              reprojection_error_
+                                             );
+                }
+                else // Raster
+                {
+                    detail::create_raster_layer(layer_ref,
+                                                image_format_,
+                                                scaling_method_
+                                               );
+                }
+            }
+        }
+        else
+        {
+            std::vector<std::future<void> > future_layers;
+            future_layers.reserve(tile_layers.size());
+            for (std::size_t i = 0; i < tile_layers.size(); ++i)
+            {
+                tile_layer & layer_ref = tile_layers[i];
+                if (skip[i] || !layer_ref.is_valid())
+                {
+                    continue;
+                }
+                if (is_vector)
+                {
+                    future_layers.push_back(std::async(
+                                            threading_mode_,
+                                            detail::encode_geom_layer,
+                                            std::ref(layer_ref),
+                                            std::make_shared<detail::binned_featureset>(bins[i]),
+                                            simplify_distance_,
+                                            area_threshold_,
+                                            fill_type_,
+                                            strictly_simple_,
+                                            multi_polygon_union_,
+                                            process_all_rings_,
+                                            trusted_input_,
+                                            reprojection_error_
+                                ));
+                }
+                else // Raster
+                {
+                    future_layers.push_back(std::async(
+                                            threading_mode_,
+                                            detail::create_raster_layer,
+                                            std::ref(layer_ref),
+                                            image_format_,
+                                            scaling_method_
+                    ));
+                }
+            }
+
+            for (auto && lay_future : future_layers)
+            {
+                if (!lay_future.valid())
+                {
+                    throw std::runtime_error("unexpected invalid async return");
+                }
+                lay_future.get();
+            }
+        }
+
+        for (std::size_t i = 0; i < tile_layers.size(); ++i)
+        {
+            if (skip[i])
+            {
+                continue;
+            }
+            if (tile_layers[i].is_valid())
+            {
+                tiles[i].add_layer(tile_layers[i]);
+            }
+            else
+            {
+                tiles[i].add_empty_layer(lay.name());
+            }
+        }
     }
+    return tiles;
 }
 
 } // end ns vector_tile_impl
@@ -0,0 +1,2 @@
+#include "vector_tile_reprojection_grid.hpp"
+#include "vector_tile_reprojection_grid.ipp"
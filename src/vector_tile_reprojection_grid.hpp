@@ -0,0 +1,141 @@
+#ifndef __MAPNIK_VECTOR_TILE_REPROJECTION_GRID_H__
+#define __MAPNIK_VECTOR_TILE_REPROJECTION_GRID_H__
+
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+
+// mapnik
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/proj_transform.hpp>
+#include <mapnik/view_transform.hpp>
+
+// mapbox
+#include <mapbox/geometry/point.hpp>
+
+// std
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+/*
+  Approximation of a reprojection followed by a view transform. The exact
+  transform is sampled on a regular grid over an extent of the source
+  projection, the grid is refined until bilinear interpolation between its
+  nodes is within max_error tile units of the exact transform at the nodes of
+  the next finer grid. When no grid of up to max_cells cells per side is close
+  enough, or the extent can not be reprojected, the grid is left empty and
+  valid() is false.
+
+  The grid is only built when it is first used, so that a layer whose features
+  are all dropped before being transformed never samples the exact transform.
+  Building is not synchronized, a grid must be used by one thread at a time.
+*/
+
+class reprojection_grid
+{
+public:
+    static constexpr std::size_t min_cells = 4;
+    static constexpr std::size_t max_cells = 64;
+
+    MAPNIK_VECTOR_INLINE reprojection_grid(mapnik::proj_transform const& prj_trans,
+                                           mapnik::view_transform const& tr,
+                                           mapnik::box2d<double> const& extent,
+                                           double max_error);
+
+    bool valid() const
+    {
+        build();
+        return !nodes_.empty();
+    }
+
+    bool built() const
+    {
+        return built_;
+    }
+
+    std::size_t cells() const
+    {
+        build();
+        return cells_;
+    }
+
+    // Moves a point of the source projection to tile coordinates, returns
+    // false without changing it when the point is outside of the grid.
+    bool forward(double & x, double & y) const
+    {
+        build();
+        if (nodes_.empty())
+        {
+            return false;
+        }
+        double gx = (x - minx_) * inv_cell_width_;
+        double gy = (y - miny_) * inv_cell_height_;
+        double last = static_cast<double>(cells_);
+        if (!(gx >= 0.0 && gy >= 0.0 && gx <= last && gy <= last))
+        {
+            return false;
+        }
+        std::size_t i = std::min(static_cast<std::size_t>(gx), cells_ - 1);
+        std::size_t j = std::min(static_cast<std::size_t>(gy), cells_ - 1);
+        double fx = gx - static_cast<double>(i);
+        double fy = gy - static_cast<double>(j);
+        std::size_t row = cells_ + 1;
+        mapbox::geometry::point<double> const& p00 = nodes_[j * row + i];
+        mapbox::geometry::point<double> const& p10 = nodes_[j * row + i + 1];
+        mapbox::geometry::point<double> const& p01 = nodes_[(j + 1) * row + i];
+        mapbox::geometry::point<double> const& p11 = nodes_[(j + 1) * row + i + 1];
+        double bottom_x = p00.x + (p10.x - p00.x) * fx;
+        double bottom_y = p00.y + (p10.y - p00.y) * fx;
+        double top_x = p01.x + (p11.x - p01.x) * fx;
+        double top_y = p01.y + (p11.y - p01.y) * fx;
+        x = bottom_x + (top_x - bottom_x) * fy;
+        y = bottom_y + (top_y - bottom_y) * fy;
+        return true;
+    }
+
+private:
+    void build() const
+    {
+        if (!built_)
+        {
+            built_ = true;
+            compute();
+        }
+    }
+
+    MAPNIK_VECTOR_INLINE void compute() const;
+
+    MAPNIK_VECTOR_INLINE bool sample(std::size_t cells,
+                                     std::vector<mapbox::geometry::point<double> > const& coarse,
+                                     std::vector<mapbox::geometry::point<double> > & nodes) const;
+
+    mapnik::proj_transform const& prj_trans_;
+    mapnik::view_transform const& tr_;
+    double minx_;
+    double miny_;
+    double width_;
+    double height_;
+    double max_error_;
+    bool extent_valid_;
+    mutable bool built_;
+    mutable double inv_cell_width_;
+    mutable double inv_cell_height_;
+    mutable std::size_t cells_;
+    mutable std::vector<mapbox::geometry::point<double> > nodes_;
+};
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
+
+#if !defined(MAPNIK_VECTOR_TILE_LIBRARY)
+#include "vector_tile_reprojection_grid.ipp"
+#endif
+
+#endif // __MAPNIK_VECTOR_TILE_REPROJECTION_GRID_H__
@@ -0,0 +1,138 @@
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+#if defined(MAPNIK_VECTOR_TILE_LIBRARY)
+// Only defined in the library, a header only build would define them in every
+// translation unit that includes this file.
+constexpr std::size_t reprojection_grid::min_cells;
+constexpr std::size_t reprojection_grid::max_cells;
+#endif
+
+MAPNIK_VECTOR_INLINE reprojection_grid::reprojection_grid(mapnik::proj_transform const& prj_trans,
+                                                          mapnik::view_transform const& tr,
+                                                          mapnik::box2d<double> const& extent,
+                                                          double max_error)
+    : prj_trans_(prj_trans),
+      tr_(tr),
+      minx_(extent.minx()),
+      miny_(extent.miny()),
+      width_(extent.width()),
+      height_(extent.height()),
+      max_error_(max_error),
+      extent_valid_(extent.valid()),
+      built_(false),
+      inv_cell_width_(0.0),
+      inv_cell_height_(0.0),
+      cells_(0),
+      nodes_() {}
+
+MAPNIK_VECTOR_INLINE void reprojection_grid::compute() const
+{
+    double max_error = max_error_;
+    if (!extent_valid_ || !(width_ > 0.0) || !(height_ > 0.0) || !(max_error > 0.0))
+    {
+        return;
+    }
+    std::vector<mapbox::geometry::point<double> > coarse;
+    std::vector<mapbox::geometry::point<double> > fine;
+    if (!sample(min_cells, coarse, coarse))
+    {
+        return;
+    }
+    for (std::size_t cells = min_cells; cells < max_cells; cells *= 2)
+    {
+        if (!sample(cells * 2, coarse, fine))
+        {
+            return;
+        }
+        // Nodes of the finer grid with an odd index are the midpoints of the
+        // edges and the centers of the cells of the coarser one.
+        std::size_t fine_row = cells * 2 + 1;
+        std::size_t row = cells + 1;
+        double error = 0.0;
+        for (std::size_t j = 0; j < fine_row && error <= max_error; ++j)
+        {
+            for (std::size_t i = 0; i < fine_row; ++i)
+            {
+                if (i % 2 == 0 && j % 2 == 0)
+                {
+                    continue;
+                }
+                std::size_t i0 = i / 2;
+                std::size_t j0 = j / 2;
+                std::size_t i1 = std::min(i0 + i % 2, cells);
+                std::size_t j1 = std::min(j0 + j % 2, cells);
+                mapbox::geometry::point<double> const& p00 = coarse[j0 * row + i0];
+                mapbox::geometry::point<double> const& p10 = coarse[j0 * row + i1];
+                mapbox::geometry::point<double> const& p01 = coarse[j1 * row + i0];
+                mapbox::geometry::point<double> const& p11 = coarse[j1 * row + i1];
+                double x = (p00.x + p10.x + p01.x + p11.x) / 4.0;
+                double y = (p00.y + p10.y + p01.y + p11.y) / 4.0;
+                mapbox::geometry::point<double> const& exact = fine[j * fine_row + i];
+                error = std::max(error, std::max(std::abs(exact.x - x), std::abs(exact.y - y)));
+            }
+        }
+        if (error <= max_error)
+        {
+            // The finer grid is already computed and is at least as close
+            cells_ = cells * 2;
+            inv_cell_width_ = static_cast<double>(cells_) / width_;
+            inv_cell_height_ = static_cast<double>(cells_) / height_;
+            nodes_ = std::move(fine);
+            return;
+        }
+        coarse.swap(fine);
+    }
+}
+
+MAPNIK_VECTOR_INLINE bool reprojection_grid::sample(std::size_t cells,
+                                                    std::vector<mapbox::geometry::point<double> > const& coarse,
+                                                    std::vector<mapbox::geometry::point<double> > & nodes) const
+{
+    // Nodes shared with a coarser grid of half as many cells are copied from it
+    std::size_t row = cells + 1;
+    std::size_t coarse_row = cells / 2 + 1;
+    bool reuse = &coarse != &nodes && coarse.size() == coarse_row * coarse_row;
+    std::vector<mapbox::geometry::point<double> > result;
+    result.reserve(row * row);
+    for (std::size_t j = 0; j < row; ++j)
+    {
+        for (std::size_t i = 0; i < row; ++i)
+        {
+            if (reuse && i % 2 == 0 && j % 2 == 0)
+            {
+                result.push_back(coarse[(j / 2) * coarse_row + i / 2]);
+                continue;
+            }
+            double x = minx_ + width_ * static_cast<double>(i) / static_cast<double>(cells);
+            double y = miny_ + height_ * static_cast<double>(j) / static_cast<double>(cells);
+            double z = 0.0;
+            if (!prj_trans_.backward(x, y, z))
+            {
+                return false;
+            }
+            tr_.forward(&x, &y);
+            if (!std::isfinite(x) || !std::isfinite(y))
+            {
+                return false;
+            }
+            result.emplace_back(x, y);
+        }
+    }
+    nodes = std::move(result);
+    return true;
+}
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
@@ -0,0 +1,2 @@
+#include "vector_tile_retile.hpp"
+#include "vector_tile_retile.ipp"
@@ -0,0 +1,87 @@
+#ifndef __MAPNIK_VECTOR_TILE_RETILE_H__
+#define __MAPNIK_VECTOR_TILE_RETILE_H__
+
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+#include "vector_tile_merc_tile.hpp"
+
+// protozero
+#include <protozero/data_view.hpp>
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+/*
+  Builds tiles from other tiles of the same pyramid by working on their
+  encoded geometries directly. Vertices are only scaled and offset in integer
+  tile coordinates and clipped with the clipper of the processor, feature ids
+  along with the keys and values of the layers are copied still encoded. Only
+  the keys and values used by the features written are kept, the indexes of
+  the tags are rewritten to them. No mapnik::value, datasource or map is ever
+  built.
+*/
+
+// Adds to target the layers of source clipped to the extent of target, plus
+// its buffer, and scaled to its tile size. target must be source or one of
+// its descendants. Raster features are not carried over.
+MAPNIK_VECTOR_INLINE void overzoom(merc_tile const& source,
+                                   merc_tile & target,
+                                   double area_threshold = 0.1,
+                                   bool strictly_simple = true,
+                                   bool multi_polygon_union = false,
+                                   polygon_fill_type fill_type = positive_fill,
+                                   bool process_all_rings = false);
+
+// Adds to target the layers of its children, scaled down to its tile size.
+// Each child is clipped to its own quarter of target, extended by the buffer
+// of target on the outer edges, and the layers of the children that have the
+// same name are merged into one, with a single table of keys and values.
+// Lines and polygons smaller than a unit are dropped and the rest is
+// simplified with simplify_distance. Null children are skipped, so the
+// children of target that have no data can be left out.
+MAPNIK_VECTOR_INLINE void underzoom(std::vector<merc_tile_ptr> const& children,
+                                    merc_tile & target,
+                                    double simplify_distance = 0.0,
+                                    double area_threshold = 0.1,
+                                    bool strictly_simple = true,
+                                    bool multi_polygon_union = false,
+                                    polygon_fill_type fill_type = positive_fill,
+                                    bool process_all_rings = false);
+
+// Options of the clipper used by upgrade_layer, the ones merge_from_buffer
+// gave the processor when it upgraded layers through a map. The buffer is
+// large enough not to miss any buffered feature.
+constexpr std::int64_t upgrade_buffer_size = 4096;
+constexpr double upgrade_area_threshold = 0.1;
+constexpr bool upgrade_strictly_simple = true;
+constexpr bool upgrade_multi_polygon_union = true;
+constexpr polygon_fill_type upgrade_fill_type = even_odd_fill;
+constexpr bool upgrade_process_all_rings = true;
+
+// Writes to layer_buffer a version 2 copy of an encoded version 1 layer, scaled
+// to extent. Rings are given the winding of version 2 and degenerate ones are
+// dropped, the rings of every polygon feature are unioned with the even-odd
+// rule so that self intersections are resolved. Geometries are clipped to a
+// buffer of upgrade_buffer_size units around the tile. Raster features are
+// copied as they are. Returns false when no feature is left.
+MAPNIK_VECTOR_INLINE bool upgrade_layer(protozero::data_view const& layer_data,
+                                        std::uint32_t extent,
+                                        std::string & layer_buffer);
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
+
+#if !defined(MAPNIK_VECTOR_TILE_LIBRARY)
+#include "vector_tile_retile.ipp"
+#endif
+
+#endif // __MAPNIK_VECTOR_TILE_RETILE_H__
@@ -0,0 +1,952 @@
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+#include "vector_tile_geometry_clipper.hpp"
+#include "vector_tile_geometry_decoder.hpp"
+#include "vector_tile_geometry_encoder_pbf.hpp"
+#include "vector_tile_geometry_simplifier.hpp"
+
+// mapnik
+#include <mapnik/geometry.hpp>
+#include <mapnik/util/variant.hpp>
+
+// mapbox
+#include <mapbox/geometry/geometry.hpp>
+
+// protozero
+#include <protozero/pbf_reader.hpp>
+#include <protozero/pbf_writer.hpp>
+#include <protozero/varint.hpp>
+
+// std
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+namespace detail
+{
+
+// The fields of an encoded layer, keys and values are kept encoded
+struct retile_layer
+{
+    std::string name;
+    std::uint32_t version;
+    std::uint32_t extent;
+    std::vector<protozero::data_view> features;
+    std::vector<protozero::data_view> keys;
+    std::vector<protozero::data_view> values;
+};
+
+// The fields of an encoded feature, its tags are kept encoded
+struct retile_feature
+{
+    bool has_id;
+    std::uint64_t id;
+    std::int32_t type;
+    protozero::data_view tags;
+    protozero::data_view geometry;
+};
+
+inline void read_retile_layer(protozero::data_view const& data, retile_layer & layer)
+{
+    layer.name.clear();
+    layer.version = 1;
+    layer.extent = 4096;
+    layer.features.clear();
+    layer.keys.clear();
+    layer.values.clear();
+    protozero::pbf_reader layer_reader(data);
+    while (layer_reader.next())
+    {
+        switch (layer_reader.tag())
+        {
+            case Layer_Encoding::NAME:
+                layer.name = layer_reader.get_string();
+                break;
+            case Layer_Encoding::FEATURES:
+                layer.features.push_back(layer_reader.get_view());
+                break;
+            case Layer_Encoding::KEYS:
+                layer.keys.push_back(layer_reader.get_view());
+                break;
+            case Layer_Encoding::VALUES:
+                layer.values.push_back(layer_reader.get_view());
+                break;
+            case Layer_Encoding::EXTENT:
+                layer.extent = layer_reader.get_uint32();
+                break;
+            case Layer_Encoding::VERSION:
+                layer.version = layer_reader.get_uint32();
+                break;
+            default:
+                layer_reader.skip();
+                break;
+        }
+    }
+}
+
+// Returns false for features without a vector geometry
+inline bool read_retile_feature(protozero::data_view const& data, retile_feature & feature)
+{
+    feature.has_id = false;
+    feature.id = 0;
+    feature.type = 0;
+    feature.tags = protozero::data_view();
+    feature.geometry = protozero::data_view();
+    bool has_geometry = false;
+    protozero::pbf_reader feature_reader(data);
+    while (feature_reader.next())
+    {
+        switch (feature_reader.tag())
+        {
+            case Feature_Encoding::ID:
+                feature.has_id = true;
+                feature.id = feature_reader.get_uint64();
+                break;
+            case Feature_Encoding::TAGS:
+                feature.tags = feature_reader.get_view();
+                break;
+            case Feature_Encoding::TYPE:
+                feature.type = feature_reader.get_enum();
+                break;
+            case Feature_Encoding::GEOMETRY:
+                has_geometry = true;
+                feature.geometry = feature_reader.get_view();
+                break;
+            case Feature_Encoding::RASTER:
+                return false;
+            default:
+                feature_reader.skip();
+                break;
+        }
+    }
+    return has_geometry;
+}
+
+inline bool is_raster_feature(protozero::data_view const& data)
+{
+    protozero::pbf_reader feature_reader(data);
+    return feature_reader.next(Feature_Encoding::RASTER);
+}
+
+// Scale num / den from the coordinates of a layer to those of the tile it is
+// retiled to. Zoom levels and tile sizes are mostly powers of two, the scale
+// is then an integer shift instead of a multiplication in doubles.
+class retile_scale
+{
+private:
+    double ratio_;
+    bool exact_;
+    bool has_shift_;
+    int shift_;
+
+public:
+    retile_scale(std::int64_t num, std::int64_t den)
+        : ratio_(static_cast<double>(num) / static_cast<double>(den)),
+          exact_((num % den) == 0),
+          has_shift_(false),
+          shift_(0)
+    {
+        std::int64_t quotient = 0;
+        int sign = 1;
+        if (exact_)
+        {
+            quotient = num / den;
+        }
+        else if ((den % num) == 0)
+        {
+            quotient = den / num;
+            sign = -1;
+        }
+        if (quotient > 0 && (quotient & (quotient - 1)) == 0)
+        {
+            has_shift_ = true;
+            while (quotient > 1)
+            {
+                quotient >>= 1;
+                shift_ += sign;
+            }
+        }
+    }
+
+    double ratio() const
+    {
+        return ratio_;
+    }
+
+    // Whether the scale is a whole number, valid polygons then stay valid
+    bool exact() const
+    {
+        return exact_;
+    }
+
+    // Whether the scale is a power of two, vertices are then scaled by shift
+    bool has_shift() const
+    {
+        return has_shift_;
+    }
+
+    // Scales a vertex coordinate with integer shifts, rounding half away
+    // from zero when scaling down as decode_geometry does
+    std::int64_t shift(std::int64_t value) const
+    {
+        if (shift_ >= 0)
+        {
+            return value * (static_cast<std::int64_t>(1) << shift_);
+        }
+        std::int64_t half = static_cast<std::int64_t>(1) << (-shift_ - 1);
+        if (value >= 0)
+        {
+            return (value + half) >> -shift_;
+        }
+        return -((-value + half) >> -shift_);
+    }
+};
+
+// Hands decoded geometries to the clipper as mapbox geometries. Points are
+// clipped here, the clipper passes them through as they are. When the scale
+// has a shift, geometries are decoded in the coordinates of their layer and
+// vertices are scaled and offset here in integers.
+template <typename NextProcessor>
+struct retile_geometry_visitor
+{
+    NextProcessor & next_;
+    mapbox::geometry::box<std::int64_t> const& clip_box_;
+    retile_scale const& scale_;
+    std::int64_t tile_x_;
+    std::int64_t tile_y_;
+    mapbox::geometry::multi_point<std::int64_t> multi_point_;
+    mapbox::geometry::line_string<std::int64_t> line_;
+    mapbox::geometry::multi_line_string<std::int64_t> multi_line_;
+    mapbox::geometry::polygon<std::int64_t> polygon_;
+    mapbox::geometry::multi_polygon<std::int64_t> multi_polygon_;
+
+    retile_geometry_visitor(mapbox::geometry::box<std::int64_t> const& clip_box,
+                            retile_scale const& scale,
+                            std::int64_t tile_x,
+                            std::int64_t tile_y,
+                            NextProcessor & next)
+        : next_(next),
+          clip_box_(clip_box),
+          scale_(scale),
+          tile_x_(tile_x),
+          tile_y_(tile_y),
+          multi_point_(),
+          line_(),
+          multi_line_(),
+          polygon_(),
+          multi_polygon_() {}
+
+    template <typename Point>
+    mapbox::geometry::point<std::int64_t> transform(Point const& pt) const
+    {
+        if (!scale_.has_shift())
+        {
+            return mapbox::geometry::point<std::int64_t>(pt.x, pt.y);
+        }
+        return mapbox::geometry::point<std::int64_t>(scale_.shift(pt.x) + tile_x_,
+                                                     scale_.shift(pt.y) + tile_y_);
+    }
+
+    bool contains(mapbox::geometry::point<std::int64_t> const& pt) const
+    {
+        return pt.x >= clip_box_.min.x && pt.x <= clip_box_.max.x &&
+               pt.y >= clip_box_.min.y && pt.y <= clip_box_.max.y;
+    }
+
+    template <typename Points, typename NewPoints>
+    void copy_points(Points const& points, NewPoints & new_points) const
+    {
+        new_points.clear();
+        new_points.reserve(points.size());
+        for (auto const& pt : points)
+        {
+            new_points.push_back(transform(pt));
+        }
+    }
+
+    template <typename Polygon>
+    void copy_polygon(Polygon const& poly, mapbox::geometry::polygon<std::int64_t> & new_poly) const
+    {
+        new_poly.resize(poly.size());
+        auto new_ring = new_poly.begin();
+        for (auto const& ring : poly)
+        {
+            copy_points(ring, *new_ring++);
+        }
+    }
+
+    void operator() (mapnik::geometry::geometry_empty const&)
+    {
+    }
+
+    void operator() (mapnik::geometry::point<std::int64_t> const& geom)
+    {
+        mapbox::geometry::point<std::int64_t> new_geom = transform(geom);
+        if (contains(new_geom))
+        {
+            next_(new_geom);
+        }
+    }
+
+    void operator() (mapnik::geometry::multi_point<std::int64_t> const& geom)
+    {
+        multi_point_.clear();
+        for (auto const& pt : geom)
+        {
+            mapbox::geometry::point<std::int64_t> new_pt = transform(pt);
+            if (contains(new_pt))
+            {
+                multi_point_.push_back(new_pt);
+            }
+        }
+        if (!multi_point_.empty())
+        {
+            next_(multi_point_);
+        }
+    }
+
+    void operator() (mapnik::geometry::line_string<std::int64_t> const& geom)
+    {
+        copy_points(geom, line_);
+        next_(line_);
+    }
+
+    void operator() (mapnik::geometry::multi_line_string<std::int64_t> const& geom)
+    {
+        multi_line_.resize(geom.size());
+        auto new_line = multi_line_.begin();
+        for (auto const& line : geom)
+        {
+            copy_points(line, *new_line++);
+        }
+        next_(multi_line_);
+    }
+
+    void operator() (mapnik::geometry::polygon<std::int64_t> const& geom)
+    {
+        copy_polygon(geom, polygon_);
+        next_(polygon_);
+    }
+
+    void operator() (mapnik::geometry::multi_polygon<std::int64_t> const& geom)
+    {
+        multi_polygon_.resize(geom.size());
+        auto new_poly = multi_polygon_.begin();
+        for (auto const& poly : geom)
+        {
+            copy_polygon(poly, *new_poly++);
+        }
+        next_(multi_polygon_);
+    }
+
+    void operator() (mapnik::geometry::geometry_collection<std::int64_t> const& geom)
+    {
+        for (auto const& g : geom)
+        {
+            mapnik::util::apply_visitor((*this), g);
+        }
+    }
+};
+
+// Keys and values of a layer built from one or several layers. Entries are told
+// apart by their encoded bytes and are only added once a feature written to
+// the layer uses them.
+class retile_tables
+{
+private:
+    std::vector<protozero::data_view> keys_;
+    std::vector<protozero::data_view> values_;
+    std::unordered_map<std::string, std::uint32_t> key_index_;
+    std::unordered_map<std::string, std::uint32_t> value_index_;
+    retile_layer const* layer_;
+    std::vector<std::uint32_t> key_map_;
+    std::vector<std::uint32_t> value_map_;
+    std::vector<std::uint32_t> tags_;
+    std::string remapped_tags_;
+
+    static std::uint32_t unmapped()
+    {
+        return std::numeric_limits<std::uint32_t>::max();
+    }
+
+    static std::uint32_t map_entry(std::uint32_t index,
+                                   std::vector<protozero::data_view> const& layer_entries,
+                                   std::vector<std::uint32_t> & entry_map,
+                                   std::vector<protozero::data_view> & entries,
+                                   std::unordered_map<std::string, std::uint32_t> & entry_index)
+    {
+        std::uint32_t & mapped = entry_map[index];
+        if (mapped == unmapped())
+        {
+            protozero::data_view const& entry = layer_entries[index];
+            auto p = entry_index.emplace(std::string(entry.data(), entry.size()),
+                                         static_cast<std::uint32_t>(entries.size()));
+            if (p.second)
+            {
+                entries.push_back(entry);
+            }
+            mapped = p.first->second;
+        }
+        return mapped;
+    }
+
+public:
+    retile_tables()
+        : keys_(),
+          values_(),
+          key_index_(),
+          value_index_(),
+          layer_(nullptr),
+          key_map_(),
+          value_map_(),
+          tags_(),
+          remapped_tags_() {}
+
+    std::vector<protozero::data_view> const& keys() const
+    {
+        return keys_;
+    }
+
+    std::vector<protozero::data_view> const& values() const
+    {
+        return values_;
+    }
+
+    // Tags passed to remap afterwards come from this layer, which must
+    // outlive the tables.
+    void set_layer(retile_layer const& layer)
+    {
+        layer_ = &layer;
+        key_map_.assign(layer.keys.size(), unmapped());
+        value_map_.assign(layer.values.size(), unmapped());
+    }
+
+    // Returns a copy of the encoded tags using the indexes of the tables,
+    // which is valid until the next call. Invalid tags of a version 1 layer
+    // are dropped, as readers of version 1 skip them.
+    protozero::data_view remap(protozero::data_view const& tags)
+    {
+        decode_packed_uint32(tags, tags_);
+        remapped_tags_.clear();
+        if (tags_.size() % 2 != 0 && layer_->version != 1)
+        {
+            throw std::runtime_error("Vector Tile has a feature with an odd number of tags, can not retile it");
+        }
+        for (std::size_t i = 0; i + 1 < tags_.size(); i += 2)
+        {
+            std::uint32_t key = tags_[i];
+            std::uint32_t value = tags_[i + 1];
+            if (key >= layer_->keys.size() || value >= layer_->values.size())
+            {
+                if (layer_->version != 1)
+                {
+                    throw std::runtime_error("Vector Tile has a feature with an invalid tag index, can not retile it");
+                }
+                continue;
+            }
+            protozero::write_varint(std::back_inserter(remapped_tags_), map_entry(key, layer_->keys, key_map_, keys_, key_index_));
+            protozero::write_varint(std::back_inserter(remapped_tags_), map_entry(value, layer_->values, value_map_, values_, value_index_));
+        }
+        return protozero::data_view(remapped_tags_.data(), remapped_tags_.size());
+    }
+};
+
+// Writes the clipped geometries of a feature to a layer along with the id and
+// the tags of the feature they came from, remapped to the tables of the layer.
+class retile_feature_writer
+{
+private:
+    protozero::pbf_writer & layer_writer_;
+    retile_tables & tables_;
+    retile_feature const* feature_;
+    protozero::data_view tags_;
+    bool has_tags_;
+    std::size_t count_;
+
+public:
+    retile_feature_writer(protozero::pbf_writer & layer_writer,
+                          retile_tables & tables)
+        : layer_writer_(layer_writer),
+          tables_(tables),
+          feature_(nullptr),
+          tags_(),
+          has_tags_(false),
+          count_(0) {}
+
+    void set_feature(retile_feature const& feature)
+    {
+        feature_ = &feature;
+        has_tags_ = false;
+    }
+
+    // Number of features written so far
+    std::size_t count() const
+    {
+        return count_;
+    }
+
+    template <typename T>
+    void operator() (T const& geom)
+    {
+        std::int32_t x = 0;
+        std::int32_t y = 0;
+        protozero::pbf_writer feature_writer(layer_writer_, Layer_Encoding::FEATURES);
+        if (!encode_geometry_pbf(geom, feature_writer, x, y))
+        {
+            feature_writer.rollback();
+            return;
+        }
+        if (feature_->has_id)
+        {
+            feature_writer.add_uint64(Feature_Encoding::ID, feature_->id);
+        }
+        if (!feature_->tags.empty())
+        {
+            // Remapped on the first geometry written, so the keys and values of
+            // features clipped away do not end up in the tables
+            if (!has_tags_)
+            {
+                tags_ = tables_.remap(feature_->tags);
+                has_tags_ = true;
+            }
+            // packed tags are length delimited on the wire, write them as is
+            feature_writer.add_bytes(Feature_Encoding::TAGS, tags_);
+        }
+        ++count_;
+    }
+
+    void operator() (mapbox::geometry::geometry_collection<std::int64_t> const& collection)
+    {
+        for (auto & g : collection)
+        {
+            mapbox::util::apply_visitor((*this), g);
+        }
+    }
+};
+
+// Copies a raster feature to a layer with its tags remapped to the tables
+inline void write_retile_raster_feature(protozero::data_view const& data,
+                                        retile_tables & tables,
+                                        protozero::pbf_writer & layer_writer)
+{
+    protozero::pbf_writer feature_writer(layer_writer, Layer_Encoding::FEATURES);
+    protozero::pbf_reader feature_reader(data);
+    while (feature_reader.next())
+    {
+        switch (feature_reader.tag())
+        {
+            case Feature_Encoding::ID:
+                feature_writer.add_uint64(Feature_Encoding::ID, feature_reader.get_uint64());
+                break;
+            case Feature_Encoding::TAGS:
+                feature_writer.add_bytes(Feature_Encoding::TAGS, tables.remap(feature_reader.get_view()));
+                break;
+            case Feature_Encoding::TYPE:
+                feature_writer.add_enum(Feature_Encoding::TYPE, feature_reader.get_enum());
+                break;
+            case Feature_Encoding::RASTER:
+                feature_writer.add_bytes(Feature_Encoding::RASTER, feature_reader.get_view());
+                break;
+            default:
+                feature_reader.skip();
+                break;
+        }
+    }
+}
+
+// Writes the layer header in the same order as layer_builder_pbf
+inline void write_retile_layer_header(protozero::pbf_writer & layer_writer,
+                                      std::string const& name,
+                                      std::uint32_t version,
+                                      std::uint32_t extent)
+{
+    layer_writer.add_uint32(Layer_Encoding::VERSION, version);
+    layer_writer.add_string(Layer_Encoding::NAME, name);
+    layer_writer.add_uint32(Layer_Encoding::EXTENT, extent);
+}
+
+inline void write_retile_layer_tables(protozero::pbf_writer & layer_writer,
+                                      std::vector<protozero::data_view> const& keys,
+                                      std::vector<protozero::data_view> const& values)
+{
+    for (auto const& key : keys)
+    {
+        layer_writer.add_bytes(Layer_Encoding::KEYS, key);
+    }
+    for (auto const& value : values)
+    {
+        layer_writer.add_message(Layer_Encoding::VALUES, value);
+    }
+}
+
+// Decodes the features of a layer to the coordinates of another tile, where a
+// vertex (x, y) of the layer lands on (x * ratio + tile_x, y * ratio + tile_y),
+// and runs them through next. Features whose bounding box misses clip_box are
+// skipped before being decoded, and so are lines and polygons that fit within
+// a single unit when drop_small is set.
+template <typename NextProcessor>
+inline void retile_features(retile_layer const& layer,
+                            retile_scale const& scale,
+                            std::int64_t tile_x,
+                            std::int64_t tile_y,
+                            mapbox::geometry::box<std::int64_t> const& clip_box,
+                            bool drop_small,
+                            retile_feature_writer & writer,
+                            NextProcessor & next)
+{
+    retile_geometry_visitor<NextProcessor> visitor(clip_box, scale, tile_x, tile_y, next);
+    retile_feature feature;
+    std::vector<std::uint32_t> values;
+    double ratio = scale.ratio();
+    // With a shift the vertices are scaled by the visitor
+    bool shift = scale.has_shift();
+    std::int64_t geometry_x = shift ? 0 : tile_x;
+    std::int64_t geometry_y = shift ? 0 : tile_y;
+    double geometry_scale = shift ? 1.0 : 1.0 / ratio;
+    for (auto const& data : layer.features)
+    {
+        if (!read_retile_feature(data, feature))
+        {
+            continue;
+        }
+        decode_packed_uint32(feature.geometry, values);
+        mapbox::geometry::box<std::int64_t> bbox(mapbox::geometry::point<std::int64_t>(0, 0),
+                                                 mapbox::geometry::point<std::int64_t>(0, 0));
+        if (!decode_geometry_bbox(values, bbox))
+        {
+            continue;
+        }
+        double minx = static_cast<double>(bbox.min.x) * ratio + static_cast<double>(tile_x);
+        double miny = static_cast<double>(bbox.min.y) * ratio + static_cast<double>(tile_y);
+        double maxx = static_cast<double>(bbox.max.x) * ratio + static_cast<double>(tile_x);
+        double maxy = static_cast<double>(bbox.max.y) * ratio + static_cast<double>(tile_y);
+        if (drop_small &&
+            feature.type != Geometry_Type::POINT &&
+            (maxx - minx) < 1.0 &&
+            (maxy - miny) < 1.0)
+        {
+            continue;
+        }
+        bbox.min.x = static_cast<std::int64_t>(std::floor(minx));
+        bbox.min.y = static_cast<std::int64_t>(std::floor(miny));
+        bbox.max.x = static_cast<std::int64_t>(std::ceil(maxx));
+        bbox.max.y = static_cast<std::int64_t>(std::ceil(maxy));
+        if (box_disjoint(bbox, clip_box))
+        {
+            continue;
+        }
+        writer.set_feature(feature);
+        GeometryPBF paths(values);
+        mapnik::geometry::geometry<std::int64_t> geom = decode_geometry<std::int64_t>(paths,
+                                                                                      feature.type,
+                                                                                      layer.version,
+                                                                                      geometry_x,
+                                                                                      geometry_y,
+                                                                                      geometry_scale,
+                                                                                      geometry_scale);
+        mapnik::util::apply_visitor(visitor, geom);
+    }
+}
+
+// Same as above through the processing chain of the processor, writing the
+// features to layer_writer with their tags remapped to tables, which must be
+// set to layer. When the scale is a whole number valid polygons stay valid and
+// those of v2 layers are trusted by the clipper. Returns the number of
+// features written.
+inline std::size_t retile_layer_features(retile_layer const& layer,
+                                         retile_scale const& scale,
+                                         std::int64_t tile_x,
+                                         std::int64_t tile_y,
+                                         mapbox::geometry::box<std::int64_t> const& clip_box,
+                                         bool drop_small,
+                                         double simplify_distance,
+                                         double area_threshold,
+                                         bool strictly_simple,
+                                         bool multi_polygon_union,
+                                         polygon_fill_type fill_type,
+                                         bool process_all_rings,
+                                         retile_tables & tables,
+                                         protozero::pbf_writer & layer_writer)
+{
+    using clipping_process = geometry_clipper<retile_feature_writer>;
+
+    retile_feature_writer writer(layer_writer, tables);
+    clipping_process clipper(clip_box,
+                             area_threshold,
+                             strictly_simple,
+                             multi_polygon_union,
+                             fill_type,
+                             process_all_rings,
+                             scale.exact() && layer.version == 2,
+                             writer);
+    if (simplify_distance > 0)
+    {
+        using simplifier_process = geometry_simplifier<clipping_process>;
+        simplifier_process simplifier(simplify_distance, clipper);
+        retile_features(layer, scale, tile_x, tile_y, clip_box, drop_small, writer, simplifier);
+    }
+    else
+    {
+        retile_features(layer, scale, tile_x, tile_y, clip_box, drop_small, writer, clipper);
+    }
+    return writer.count();
+}
+
+} // end ns detail
+
+MAPNIK_VECTOR_INLINE void overzoom(merc_tile const& source,
+                                   merc_tile & target,
+                                   double area_threshold,
+                                   bool strictly_simple,
+                                   bool multi_polygon_union,
+                                   polygon_fill_type fill_type,
+                                   bool process_all_rings)
+{
+    if (target.tile_size() <= 0)
+    {
+        throw std::runtime_error("Vector tile size must be great than zero");
+    }
+    if (target.z() < source.z())
+    {
+        throw std::runtime_error("Vector tile can only be overzoomed to a higher zoom level");
+    }
+    std::uint64_t dz = target.z() - source.z();
+    if (dz >= 32)
+    {
+        throw std::runtime_error("Vector tile can not be overzoomed by 32 zoom levels or more");
+    }
+    if ((target.x() >> dz) != source.x() || (target.y() >> dz) != source.y())
+    {
+        throw std::runtime_error("Vector tile can only be overzoomed to one of its descendants");
+    }
+    std::int64_t scale = static_cast<std::int64_t>(1) << dz;
+    std::int64_t tile_size = static_cast<std::int64_t>(target.tile_size());
+    std::int64_t buffer_size = static_cast<std::int64_t>(target.buffer_size());
+    std::int64_t offset_x = static_cast<std::int64_t>(target.x() - (source.x() << dz)) * tile_size;
+    std::int64_t offset_y = static_cast<std::int64_t>(target.y() - (source.y() << dz)) * tile_size;
+    mapbox::geometry::box<std::int64_t> clip_box(mapbox::geometry::point<std::int64_t>(-buffer_size, -buffer_size),
+                                                 mapbox::geometry::point<std::int64_t>(tile_size + buffer_size, tile_size + buffer_size));
+
+    detail::retile_layer layer;
+    std::string layer_buffer;
+    protozero::pbf_reader tile_message(source.get_reader());
+    while (tile_message.next(Tile_Encoding::LAYERS))
+    {
+        detail::read_retile_layer(tile_message.get_view(), layer);
+        if (layer.name.empty() || layer.extent == 0)
+        {
+            continue;
+        }
+        layer_buffer.clear();
+        detail::retile_tables tables;
+        tables.set_layer(layer);
+        std::size_t count = 0;
+        {
+            protozero::pbf_writer layer_writer(layer_buffer);
+            detail::write_retile_layer_header(layer_writer, layer.name, layer.version, target.tile_size());
+            count = detail::retile_layer_features(layer,
+                                                  detail::retile_scale(scale * tile_size, layer.extent),
+                                                  -offset_x,
+                                                  -offset_y,
+                                                  clip_box,
+                                                  false,
+                                                  0.0,
+                                                  area_threshold,
+                                                  strictly_simple,
+                                                  multi_polygon_union,
+                                                  fill_type,
+                                                  process_all_rings,
+                                                  tables,
+                                                  layer_writer);
+            detail::write_retile_layer_tables(layer_writer, tables.keys(), tables.values());
+        }
+        if (count > 0)
+        {
+            target.append_layer_buffer(layer_buffer.data(), layer_buffer.size(), layer.name);
+        }
+        else
+        {
+            target.add_empty_layer(layer.name);
+        }
+    }
+}
+
+MAPNIK_VECTOR_INLINE void underzoom(std::vector<merc_tile_ptr> const& children,
+                                    merc_tile & target,
+                                    double simplify_distance,
+                                    double area_threshold,
+                                    bool strictly_simple,
+                                    bool multi_polygon_union,
+                                    polygon_fill_type fill_type,
+                                    bool process_all_rings)
+{
+    if (target.tile_size() <= 0)
+    {
+        throw std::runtime_error("Vector tile size must be great than zero");
+    }
+    for (auto const& child : children)
+    {
+        if (child &&
+            (child->z() != target.z() + 1 || (child->x() >> 1) != target.x() || (child->y() >> 1) != target.y()))
+        {
+            throw std::runtime_error("Vector tile can only be underzoomed from its children");
+        }
+    }
+    std::int64_t tile_size = static_cast<std::int64_t>(target.tile_size());
+    std::int64_t buffer_size = static_cast<std::int64_t>(target.buffer_size());
+    std::int64_t half_size = tile_size / 2;
+
+    // Layers by name, in the order they are first found in the children
+    std::vector<std::string> names;
+    std::map<std::string, std::size_t> name_index;
+    std::vector<std::vector<std::pair<std::size_t, protozero::data_view> > > sources;
+    for (std::size_t i = 0; i < children.size(); ++i)
+    {
+        if (!children[i])
+        {
+            continue;
+        }
+        protozero::pbf_reader tile_message(children[i]->get_reader());
+        while (tile_message.next(Tile_Encoding::LAYERS))
+        {
+            protozero::data_view data = tile_message.get_view();
+            protozero::pbf_reader layer_message(data);
+            if (!layer_message.next(Layer_Encoding::NAME))
+            {
+                continue;
+            }
+            auto p = name_index.emplace(layer_message.get_string(), names.size());
+            if (p.second)
+            {
+                names.push_back(p.first->first);
+                sources.emplace_back();
+            }
+            sources[p.first->second].emplace_back(i, data);
+        }
+    }
+
+    detail::retile_layer layer;
+    std::string layer_buffer;
+    for (std::size_t n = 0; n < names.size(); ++n)
+    {
+        layer_buffer.clear();
+        detail::retile_tables tables;
+        std::size_t count = 0;
+        {
+            protozero::pbf_writer layer_writer(layer_buffer);
+            detail::write_retile_layer_header(layer_writer, names[n], 2, target.tile_size());
+            for (auto const& source : sources[n])
+            {
+                detail::read_retile_layer(source.second, layer);
+                if (layer.extent == 0)
+                {
+                    continue;
+                }
+                // Each child is clipped to its quarter of the target so that the
+                // features in the buffers of two children are not written twice.
+                merc_tile const& child = *children[source.first];
+                bool right = (child.x() & 1) != 0;
+                bool bottom = (child.y() & 1) != 0;
+                mapbox::geometry::box<std::int64_t> clip_box(
+                    mapbox::geometry::point<std::int64_t>(right ? half_size : -buffer_size,
+                                                          bottom ? half_size : -buffer_size),
+                    mapbox::geometry::point<std::int64_t>(right ? tile_size + buffer_size : half_size,
+                                                          bottom ? tile_size + buffer_size : half_size));
+                std::int64_t child_extent = 2 * static_cast<std::int64_t>(layer.extent);
+                tables.set_layer(layer);
+                count += detail::retile_layer_features(layer,
+                                                       detail::retile_scale(tile_size, child_extent),
+                                                       right ? half_size : 0,
+                                                       bottom ? half_size : 0,
+                                                       clip_box,
+                                                       true,
+                                                       simplify_distance,
+                                                       area_threshold,
+                                                       strictly_simple,
+                                                       multi_polygon_union,
+                                                       fill_type,
+                                                       process_all_rings,
+                                                       tables,
+                                                       layer_writer);
+            }
+            detail::write_retile_layer_tables(layer_writer, tables.keys(), tables.values());
+        }
+        if (count > 0)
+        {
+            target.append_layer_buffer(layer_buffer.data(), layer_buffer.size(), names[n]);
+        }
+        else
+        {
+            target.add_empty_layer(names[n]);
+        }
+    }
+}
+
+MAPNIK_VECTOR_INLINE bool upgrade_layer(protozero::data_view const& layer_data,
+                                        std::uint32_t extent,
+                                        std::string & layer_buffer)
+{
+    if (extent == 0)
+    {
+        throw std::runtime_error("Vector tile size must be great than zero");
+    }
+    detail::retile_layer layer;
+    detail::read_retile_layer(layer_data, layer);
+    if (layer.extent == 0)
+    {
+        return false;
+    }
+    std::int64_t buffer_size = upgrade_buffer_size;
+    std::int64_t tile_size = static_cast<std::int64_t>(extent);
+    mapbox::geometry::box<std::int64_t> clip_box(mapbox::geometry::point<std::int64_t>(-buffer_size, -buffer_size),
+                                                 mapbox::geometry::point<std::int64_t>(tile_size + buffer_size, tile_size + buffer_size));
+    layer_buffer.clear();
+    detail::retile_tables tables;
+    tables.set_layer(layer);
+    std::size_t count = 0;
+    {
+        protozero::pbf_writer layer_writer(layer_buffer);
+        detail::write_retile_layer_header(layer_writer, layer.name, 2, extent);
+        count = detail::retile_layer_features(layer,
+                                              detail::retile_scale(tile_size, layer.extent),
+                                              0,
+                                              0,
+                                              clip_box,
+                                              false,
+                                              0.0,
+                                              upgrade_area_threshold,
+                                              upgrade_strictly_simple,
+                                              upgrade_multi_polygon_union,
+                                              upgrade_fill_type,
+                                              upgrade_process_all_rings,
+                                              tables,
+                                              layer_writer);
+        // Raster features have no geometry to upgrade
+        for (auto const& feature : layer.features)
+        {
+            if (detail::is_raster_feature(feature))
+            {
+                detail::write_retile_raster_feature(feature, tables, layer_writer);
+                ++count;
+            }
+        }
+        detail::write_retile_layer_tables(layer_writer, tables.keys(), tables.values());
+    }
+    return count > 0;
+}
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
@@ -24,6 +24,12 @@
 #include <boost/geometry/core/access.hpp>
 #pragma GCC diagnostic pop
 
+// mapnik-vector-tile
+#include "vector_tile_geometry_pool.hpp"
+#include "vector_tile_reprojection_grid.hpp"
+
+#include <algorithm>
+#include <cmath>
 #include <memory>
 
 namespace mapnik {
@@ -66,12 +72,16 @@ struct vector_tile_strategy
     view_transform const& tr_;
 };
 
+// When a valid reprojection grid is given, points inside of it are
+// interpolated from the grid and only the others go through proj_transform.
 struct vector_tile_strategy_proj
 {
     vector_tile_strategy_proj(proj_transform const& prj_trans,
-                              view_transform const& tr)
+                              view_transform const& tr,
+                              reprojection_grid const* grid = nullptr)
         : prj_trans_(prj_trans),
-          tr_(tr) {}
+          tr_(tr),
+          grid_(grid) {}
 
     template <typename P1, typename P2>
     inline bool apply(P1 const& p1, P2 & p2) const
@@ -79,9 +89,12 @@ struct vector_tile_strategy_proj
         using p2_type = typename boost::geometry::coordinate_type<P2>::type;
         double x = boost::geometry::get<0>(p1);
         double y = boost::geometry::get<1>(p1);
-        double z = 0.0;
-        if (!prj_trans_.backward(x, y, z)) return false;
-        tr_.forward(&x,&y);
+        if (!grid_ || !grid_->forward(x, y))
+        {
+            double z = 0.0;
+            if (!prj_trans_.backward(x, y, z)) return false;
+            tr_.forward(&x,&y);
+        }
         x = std::round(x);
         y = std::round(y);
         if (x <= coord_min || x >= coord_max ||
@@ -101,6 +114,51 @@ struct vector_tile_strategy_proj
 
     proj_transform const& prj_trans_;
     view_transform const& tr_;
+    reprojection_grid const* grid_;
+};
+
+// Geographic wgs84 to spherical mercator in closed form. This gives the same
+// result as vector_tile_strategy_proj for that pair of projections without
+// the per point dispatch of proj_transform, and does not share any state so
+// it can be used by several threads at once.
+struct vector_tile_strategy_lonlat_merc
+{
+    vector_tile_strategy_lonlat_merc(view_transform const& tr)
+        : tr_(tr) {}
+
+    template <typename P1, typename P2>
+    inline bool apply(P1 const& p1, P2 & p2) const
+    {
+        using p2_type = typename boost::geometry::coordinate_type<P2>::type;
+        constexpr double pi = 3.14159265358979323846;
+        constexpr double earth_radius = 6378137.0;
+        constexpr double max_longitude = 180.0;
+        constexpr double max_latitude = 85.0511287798066;
+        double lon = boost::geometry::get<0>(p1);
+        double lat = boost::geometry::get<1>(p1);
+        lon = std::min(std::max(lon, -max_longitude), max_longitude);
+        lat = std::min(std::max(lat, -max_latitude), max_latitude);
+        double x = lon * (earth_radius * pi / 180.0);
+        double y = earth_radius * std::log(std::tan((90.0 + lat) * (pi / 360.0)));
+        tr_.forward(&x,&y);
+        x = std::round(x);
+        y = std::round(y);
+        if (x <= coord_min || x >= coord_max ||
+            y <= coord_min || y >= coord_max) return false;
+        boost::geometry::set<0>(p2, static_cast<p2_type>(x));
+        boost::geometry::set<1>(p2, static_cast<p2_type>(y));
+        return true;
+    }
+
+    template <typename P1, typename P2>
+    inline P2 execute(P1 const& p1, bool & status) const
+    {
+        P2 p2;
+        status = apply(p1, p2);
+        return p2;
+    }
+
+    view_transform const& tr_;
 };
 
 template <typename T>
@@ -116,19 +174,105 @@ struct geom_out_visitor
 };
 
 // TODO - avoid creating degenerate polygons when first/last point of ring is skipped
+//
+// The transformed geometries are members that are rebuilt for every feature, so a
+// transform_visitor that lives for a whole layer reuses their memory, along with the
+// point buffers kept in its pool, instead of allocating new ones for each feature.
+//
+// Before transforming a line or a ring, its vertices that lie in the same half plane
+// outside of the clipping extent as the last kept vertex and the next vertex are
+// dropped. Only the ends of a run of such vertices are kept, the straight edge between
+// them stays outside of the extent, so the clipped result does not change while huge
+// features that only touch the tile are not transformed vertex by vertex. A margin
+// around the extent keeps this true when reprojecting bends the edges.
 template <typename TransformType, typename NextProcessor>
 struct transform_visitor
 {
+    enum outcode : unsigned
+    {
+        inside = 0,
+        left = 1,
+        right = 2,
+        bottom = 4,
+        top = 8
+    };
+
     TransformType const& tr_;
     NextProcessor & next_;
     box2d<double> const& target_clipping_extent_;
+    box2d<double> cull_extent_;
+    point_buffer_pool<std::int64_t> pool_;
+    mapbox::geometry::multi_point<std::int64_t> multi_point_;
+    mapbox::geometry::line_string<std::int64_t> line_;
+    mapbox::geometry::multi_line_string<std::int64_t> multi_line_;
+    mapbox::geometry::polygon<std::int64_t> polygon_;
+    mapbox::geometry::multi_polygon<std::int64_t> multi_polygon_;
 
     transform_visitor(TransformType const& tr,
                       box2d<double> const& target_clipping_extent,
                       NextProcessor & next) :
       tr_(tr),
       next_(next),
-      target_clipping_extent_(target_clipping_extent) {}
+      target_clipping_extent_(target_clipping_extent),
+      cull_extent_(target_clipping_extent.minx() - target_clipping_extent.width() / 2,
+                   target_clipping_extent.miny() - target_clipping_extent.height() / 2,
+                   target_clipping_extent.maxx() + target_clipping_extent.width() / 2,
+                   target_clipping_extent.maxy() + target_clipping_extent.height() / 2),
+      pool_(),
+      multi_point_(),
+      line_(),
+      multi_line_(),
+      polygon_(),
+      multi_polygon_() {}
+
+    template <typename Point>
+    inline unsigned cull_code(Point const& pt) const
+    {
+        unsigned code = inside;
+        if (pt.x < cull_extent_.minx()) code |= left;
+        else if (pt.x > cull_extent_.maxx()) code |= right;
+        if (pt.y < cull_extent_.miny()) code |= bottom;
+        else if (pt.y > cull_extent_.maxy()) code |= top;
+        return code;
+    }
+
+    template <typename Point, typename NewRing>
+    inline void transform_point(Point const& pt, NewRing & new_ring)
+    {
+        mapbox::geometry::point<std::int64_t> pt2;
+        if (tr_.apply(pt,pt2))
+        {
+            new_ring.push_back(std::move(pt2));
+        }
+    }
+
+    template <typename Ring, typename NewRing>
+    inline void transform_points(Ring const& ring, NewRing & new_ring)
+    {
+        std::size_t size = ring.size();
+        if (size < 3)
+        {
+            for (auto const& pt : ring)
+            {
+                transform_point(pt, new_ring);
+            }
+            return;
+        }
+        transform_point(ring[0], new_ring);
+        unsigned kept_code = cull_code(ring[0]);
+        unsigned code = cull_code(ring[1]);
+        for (std::size_t i = 1; i < size - 1; ++i)
+        {
+            unsigned next_code = cull_code(ring[i + 1]);
+            if ((kept_code & code & next_code) == 0)
+            {
+                transform_point(ring[i], new_ring);
+                kept_code = code;
+            }
+            code = next_code;
+        }
+        transform_point(ring[size - 1], new_ring);
+    }
 
     inline void operator() (mapnik::geometry::point<double> const& geom)
     {
@@ -146,7 +290,8 @@ struct transform_visitor
 
     inline void operator() (mapnik::geometry::multi_point<double> const& geom)
     {
-        mapbox::geometry::multi_point<std::int64_t> new_geom;
+        mapbox::geometry::multi_point<std::int64_t> & new_geom = multi_point_;
+        new_geom.clear();
         new_geom.reserve(geom.size());
         for (auto const& pt : geom)
         {
@@ -170,38 +315,24 @@ struct transform_visitor
         {
             return;
         }
-        mapbox::geometry::line_string<std::int64_t> new_geom;
+        mapbox::geometry::line_string<std::int64_t> & new_geom = line_;
+        new_geom.clear();
         new_geom.reserve(geom.size());
-        for (auto const& pt : geom)
-        {
-            mapbox::geometry::point<std::int64_t> pt2;
-            if (tr_.apply(pt,pt2))
-            {
-                new_geom.push_back(std::move(pt2));
-            }
-        }
+        transform_points(geom, new_geom);
         return next_(new_geom);
     }
 
     inline void operator() (mapnik::geometry::multi_line_string<double> const& geom)
     {
-        mapbox::geometry::multi_line_string<std::int64_t> new_geom;
+        mapbox::geometry::multi_line_string<std::int64_t> & new_geom = multi_line_;
+        pool_.release(new_geom);
         new_geom.reserve(geom.size());
         for (auto const& line : geom)
         {
             mapnik::box2d<double> line_bbox = mapnik::geometry::envelope(line);
             if (!target_clipping_extent_.intersects(line_bbox)) continue;
-            mapbox::geometry::line_string<std::int64_t> new_line;
-            new_line.reserve(line.size());
-            for (auto const& pt : line)
-            {
-                mapbox::geometry::point<std::int64_t> pt2;
-                if (tr_.apply(pt,pt2))
-                {
-                    new_line.push_back(std::move(pt2));
-                }
-            }
-            new_geom.push_back(std::move(new_line));
+            new_geom.push_back(pool_.template acquire<mapbox::geometry::line_string<std::int64_t>>(line.size()));
+            transform_points(line, new_geom.back());
         }
         if (new_geom.empty())
         {
@@ -213,7 +344,8 @@ struct transform_visitor
     inline void operator() (mapnik::geometry::polygon<double> const& geom)
     {
         bool exterior = true;
-        mapbox::geometry::polygon<std::int64_t> new_geom;
+        mapbox::geometry::polygon<std::int64_t> & new_geom = polygon_;
+        pool_.release(new_geom);
         for (auto const& ring : geom)
         {
             mapnik::box2d<double> ring_bbox = mapnik::geometry::envelope(ring);
@@ -223,24 +355,16 @@ struct transform_visitor
                 else continue;
             }
             exterior = false;
-            mapbox::geometry::linear_ring<std::int64_t> new_ring;
-            new_ring.reserve(ring.size());
-            for (auto const& pt : ring)
-            {
-                mapbox::geometry::point<std::int64_t> pt2;
-                if (tr_.apply(pt,pt2))
-                {
-                    new_ring.push_back(std::move(pt2));
-                }
-            }
-            new_geom.push_back(std::move(new_ring));
+            new_geom.push_back(pool_.template acquire<mapbox::geometry::linear_ring<std::int64_t>>(ring.size()));
+            transform_points(ring, new_geom.back());
         }
         return next_(new_geom);
     }
 
     inline void operator() (mapnik::geometry::multi_polygon<double> const& geom)
     {
-        mapbox::geometry::multi_polygon<std::int64_t> new_geom;
+        mapbox::geometry::multi_polygon<std::int64_t> & new_geom = multi_polygon_;
+        pool_.release(new_geom);
         new_geom.reserve(geom.size());
         for (auto const& poly : geom)
         {
@@ -249,7 +373,8 @@ struct transform_visitor
             {
                 continue;
             }
-            mapbox::geometry::polygon<std::int64_t> new_poly;
+            new_geom.emplace_back();
+            mapbox::geometry::polygon<std::int64_t> & new_poly = new_geom.back();
             for (auto const& ring : poly)
             {
                 mapnik::box2d<double> ring_bbox = mapnik::geometry::envelope(ring);
@@ -257,19 +382,9 @@ struct transform_visitor
                 {
                     continue;
                 }
-                mapbox::geometry::linear_ring<std::int64_t> new_ring;
-                new_ring.reserve(ring.size());
-                for (auto const& pt : ring)
-                {
-                    mapbox::geometry::point<std::int64_t> pt2;
-                    if (tr_.apply(pt,pt2))
-                    {
-                        new_ring.push_back(std::move(pt2));
-                    }
-                }
-                new_poly.push_back(std::move(new_ring));
+                new_poly.push_back(pool_.template acquire<mapbox::geometry::linear_ring<std::int64_t>>(ring.size()));
+                transform_points(ring, new_poly.back());
             }
-            new_geom.push_back(std::move(new_poly));
         }
         if (new_geom.empty())
         {
@@ -3,6 +3,7 @@
 
 // mapnik-vector-tile
 #include "vector_tile_config.hpp"
+#include "vector_tile_layer_directory.hpp"
 
 //protozero
 #include <protozero/pbf_reader.hpp>
@@ -33,6 +34,7 @@ protected:
     std::set<std::string> empty_layers_;
     std::set<std::string> layers_set_;
     std::vector<std::string> layers_;
+    layer_directory directory_;
     mapnik::box2d<double> extent_;
     std::uint32_t tile_size_;
     std::int32_t buffer_size_;
@@ -46,6 +48,7 @@ public:
           empty_layers_(),
           layers_set_(),
           layers_(),
+          directory_(),
           extent_(extent),
           tile_size_(tile_size),
           buffer_size_(buffer_size) {}
@@ -180,6 +183,7 @@ public:
         empty_layers_.clear();
         layers_.clear();
         layers_set_.clear();
+        directory_.clear();
         painted_layers_.clear();
     }
 
@@ -205,6 +209,12 @@ public:
     MAPNIK_VECTOR_INLINE bool layer_reader(std::string const& name, protozero::pbf_reader & layer_msg) const;
 
     MAPNIK_VECTOR_INLINE bool layer_reader(std::size_t index, protozero::pbf_reader & layer_msg) const;
+
+    // The encoded layer within the buffer of the tile, valid until the next
+    // layer is added
+    MAPNIK_VECTOR_INLINE bool layer_view(std::string const& name, protozero::data_view & layer) const;
+
+    MAPNIK_VECTOR_INLINE bool layer_view(std::size_t index, protozero::data_view & layer) const;
 };
 
 } // end ns vector_tile_impl
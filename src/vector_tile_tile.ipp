@@ -7,8 +7,10 @@
 #include <protozero/pbf_writer.hpp>
 
 // std
+#include <exception>
 #include <set>
 #include <string>
+#include <vector>
 
 namespace mapnik
 {
@@ -37,8 +39,12 @@ MAPNIK_VECTOR_INLINE bool tile::add_layer(tile_layer const& layer)
             return false;
         }
         layers_.push_back(new_name);
-        protozero::pbf_writer tile_writer(*buffer_);
-        tile_writer.add_message(Tile_Encoding::LAYERS, layer.get_data());
+        std::string const& layer_data = layer.get_data();
+        {
+            protozero::pbf_writer tile_writer(*buffer_);
+            tile_writer.add_message(Tile_Encoding::LAYERS, layer_data);
+        }
+        directory_.add(new_name, buffer_->size() - layer_data.size(), layer_data.size());
         auto itr = empty_layers_.find(new_name);
         if (itr != empty_layers_.end())
         {
@@ -58,8 +64,14 @@ MAPNIK_VECTOR_INLINE bool tile::append_layer_buffer(const char * data, std::size
         return false;
     }
     layers_.push_back(name);
-    protozero::pbf_writer writer(*buffer_);
-    writer.add_message(3, data, size);
+    // Layers are found by the names within their buffer
+    std::vector<std::string> buffer_names;
+    std::exception_ptr error = read_layer_names(protozero::data_view(data, size), buffer_names);
+    {
+        protozero::pbf_writer writer(*buffer_);
+        writer.add_message(3, data, size);
+    }
+    directory_.add(buffer_names, buffer_->size() - size, size, error);
     auto itr = empty_layers_.find(name);
     if (itr != empty_layers_.end())
     {
@@ -70,37 +82,39 @@ MAPNIK_VECTOR_INLINE bool tile::append_layer_buffer(const char * data, std::size
 
 MAPNIK_VECTOR_INLINE bool tile::layer_reader(std::string const& name, protozero::pbf_reader & layer_msg) const
 {
-    protozero::pbf_reader item(buffer_->data(), buffer_->size());
-    while (item.next(Tile_Encoding::LAYERS))
+    protozero::data_view layer;
+    if (!layer_view(name, layer))
     {
-        layer_msg = item.get_message();
-        protozero::pbf_reader lay(layer_msg);
-        while (lay.next(Layer_Encoding::NAME))
-        {
-            if (lay.get_string() == name)
-            {
-                return true;
-            }
-        }
+        return false;
     }
-    return false;
+    layer_msg = protozero::pbf_reader(layer);
+    return true;
 }
 
 MAPNIK_VECTOR_INLINE bool tile::layer_reader(std::size_t index, protozero::pbf_reader & layer_msg) const
 {
-    protozero::pbf_reader item(buffer_->data(), buffer_->size());
-    std::size_t idx = 0;
-    while (item.next(Tile_Encoding::LAYERS))
+    protozero::data_view layer;
+    if (!layer_view(index, layer))
     {
-        if (idx == index)
-        {
-            layer_msg = item.get_message();
-            return true;
-        }
-        ++idx;
-        item.skip();
+        return false;
     }
-    return false;
+    layer_msg = protozero::pbf_reader(layer);
+    return true;
+}
+
+MAPNIK_VECTOR_INLINE bool tile::layer_view(std::string const& name, protozero::data_view & layer) const
+{
+    return layer_view(directory_.find(name), layer);
+}
+
+MAPNIK_VECTOR_INLINE bool tile::layer_view(std::size_t index, protozero::data_view & layer) const
+{
+    if (index >= directory_.size())
+    {
+        return false;
+    }
+    layer = directory_.view(buffer_->data(), index);
+    return true;
 }
 
 } // end ns vector_tile_impl
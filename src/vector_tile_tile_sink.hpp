@@ -0,0 +1,220 @@
+#ifndef __MAPNIK_VECTOR_TILE_TILE_SINK_H__
+#define __MAPNIK_VECTOR_TILE_TILE_SINK_H__
+
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+#include "vector_tile_layer.hpp"
+#include "vector_tile_tile.hpp"
+
+// protozero
+#include <protozero/data_view.hpp>
+#include <protozero/types.hpp>
+#include <protozero/varint.hpp>
+
+// std
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+/*
+  Receives the layers of a tile from the processor. Layers are given one at a
+  time in the order of the map, each as soon as it and every layer before it
+  are encoded, on the thread that asked for the tile. A sink can so compress
+  or send the first layers of a tile while a slow one is still being encoded.
+*/
+
+class tile_sink
+{
+public:
+    virtual ~tile_sink() {}
+
+    // Layers the sink already has are not encoded again
+    virtual bool has_layer(std::string const& /*name*/) const
+    {
+        return false;
+    }
+
+    // A layer without features is empty, the encoded layer of the others can
+    // be moved out of get_data() as the processor does not use it afterwards.
+    // The layer itself stays valid until finish() returns.
+    virtual void add_layer(tile_layer & layer) = 0;
+
+    // Called once every layer of the tile was given, never when encoding a
+    // layer failed
+    virtual void finish() {}
+};
+
+// Adds the layers to a tile, as update_tile does. They are only added once
+// every layer is encoded, so a tile is left untouched when one of them fails.
+class tile_builder_sink : public tile_sink
+{
+    tile & tile_;
+    std::vector<tile_layer const*> layers_;
+
+public:
+    explicit tile_builder_sink(tile & t)
+        : tile_(t),
+          layers_() {}
+
+    bool has_layer(std::string const& name) const override
+    {
+        return tile_.has_layer(name);
+    }
+
+    void add_layer(tile_layer & layer) override
+    {
+        layers_.push_back(&layer);
+    }
+
+    void finish() override
+    {
+        for (tile_layer const* layer : layers_)
+        {
+            tile_.add_layer(*layer);
+        }
+        layers_.clear();
+    }
+};
+
+// Keeps the layers as they are given, without copying them into a single
+// buffer. The tile is then the list of buffers of get_buffers, which can be
+// written with writev or sent as the chunks of a response.
+class gather_tile_sink : public tile_sink
+{
+    std::vector<std::string> names_;
+    std::vector<std::string> headers_;
+    std::vector<std::string> layers_;
+    std::set<std::string> empty_layers_;
+    std::set<std::string> painted_layers_;
+    std::size_t size_;
+
+public:
+    gather_tile_sink()
+        : names_(),
+          headers_(),
+          layers_(),
+          empty_layers_(),
+          painted_layers_(),
+          size_(0) {}
+
+    bool has_layer(std::string const& name) const override
+    {
+        for (auto const& n : names_)
+        {
+            if (n == name)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void add_layer(tile_layer & layer) override
+    {
+        std::string const& name = layer.name();
+        if (layer.is_empty())
+        {
+            empty_layers_.insert(name);
+            if (layer.is_painted())
+            {
+                painted_layers_.insert(name);
+            }
+            return;
+        }
+        painted_layers_.insert(name);
+        if (has_layer(name))
+        {
+            return;
+        }
+        empty_layers_.erase(name);
+        // The tag and length of the layer within the tile
+        std::string header;
+        protozero::write_varint(std::back_inserter(header),
+                                (static_cast<std::uint32_t>(Tile_Encoding::LAYERS) << 3) |
+                                static_cast<std::uint32_t>(protozero::pbf_wire_type::length_delimited));
+        protozero::write_varint(std::back_inserter(header), layer.get_data().size());
+        size_ += header.size() + layer.get_data().size();
+        names_.push_back(name);
+        headers_.push_back(std::move(header));
+        layers_.push_back(std::move(layer.get_data()));
+    }
+
+    std::vector<std::string> const& get_layers() const
+    {
+        return names_;
+    }
+
+    std::set<std::string> const& get_empty_layers() const
+    {
+        return empty_layers_;
+    }
+
+    std::set<std::string> const& get_painted_layers() const
+    {
+        return painted_layers_;
+    }
+
+    bool is_empty() const
+    {
+        return names_.empty();
+    }
+
+    // Size of the whole tile
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    // The encoded layer at index, without its header
+    protozero::data_view layer_view(std::size_t index) const
+    {
+        return protozero::data_view(layers_[index].data(), layers_[index].size());
+    }
+
+    // The header of every layer followed by the layer, valid until the next
+    // layer is added
+    std::vector<protozero::data_view> get_buffers() const
+    {
+        std::vector<protozero::data_view> buffers;
+        buffers.reserve(2 * layers_.size());
+        for (std::size_t i = 0; i < layers_.size(); ++i)
+        {
+            buffers.emplace_back(headers_[i].data(), headers_[i].size());
+            buffers.emplace_back(layers_[i].data(), layers_[i].size());
+        }
+        return buffers;
+    }
+
+    void append_to_string(std::string & str) const
+    {
+        str.reserve(str.size() + size_);
+        for (std::size_t i = 0; i < layers_.size(); ++i)
+        {
+            str.append(headers_[i]);
+            str.append(layers_[i]);
+        }
+    }
+
+    void clear()
+    {
+        names_.clear();
+        headers_.clear();
+        layers_.clear();
+        empty_layers_.clear();
+        painted_layers_.clear();
+        size_ = 0;
+    }
+};
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
+
+#endif // __MAPNIK_VECTOR_TILE_TILE_SINK_H__
@@ -0,0 +1,2 @@
+#include "vector_tile_tile_view.hpp"
+#include "vector_tile_tile_view.ipp"
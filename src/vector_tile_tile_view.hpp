@@ -0,0 +1,105 @@
+#ifndef __MAPNIK_VECTOR_TILE_TILE_VIEW_H__
+#define __MAPNIK_VECTOR_TILE_TILE_VIEW_H__
+
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+#include "vector_tile_layer_directory.hpp"
+
+//protozero
+#include <protozero/pbf_reader.hpp>
+
+// std
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+/*
+  Read only view of an encoded tile in memory owned by someone else, such as
+  a file mapped in memory or a buffer shared between threads. The owner is
+  kept alive by the view and by everything that reads from it, so layers can
+  be handed to a tile_datasource_pbf without being copied.
+*/
+
+class tile_view
+{
+    std::shared_ptr<const void> owner_;
+    const char * data_;
+    std::size_t size_;
+    std::vector<std::string> layers_;
+    layer_directory directory_;
+
+public:
+    // data must stay valid as long as owner is alive. The names of the layers
+    // are read once here along with where each layer starts. A layer without
+    // a name is listed with an empty one and is only found by index. A corrupt
+    // layer makes the lookups by name that reach it throw.
+    MAPNIK_VECTOR_INLINE tile_view(std::shared_ptr<const void> owner,
+                                   const char * data,
+                                   std::size_t size);
+
+    explicit tile_view(std::shared_ptr<const std::string> buffer)
+        : tile_view(buffer, buffer->data(), buffer->size()) {}
+
+    tile_view(tile_view const& rhs) = default;
+
+    tile_view(tile_view && rhs) = default;
+
+    const char * data() const
+    {
+        return data_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    std::shared_ptr<const void> const& owner() const
+    {
+        return owner_;
+    }
+
+    bool is_empty() const
+    {
+        return layers_.empty();
+    }
+
+    std::vector<std::string> const& get_layers() const
+    {
+        return layers_;
+    }
+
+    bool has_layer(std::string const& name) const
+    {
+        return directory_.find(name) < directory_.size();
+    }
+
+    protozero::pbf_reader get_reader() const
+    {
+        return protozero::pbf_reader(data_, size_);
+    }
+
+    MAPNIK_VECTOR_INLINE bool layer_reader(std::string const& name, protozero::pbf_reader & layer_msg) const;
+
+    MAPNIK_VECTOR_INLINE bool layer_reader(std::size_t index, protozero::pbf_reader & layer_msg) const;
+
+    MAPNIK_VECTOR_INLINE bool layer_view(std::string const& name, protozero::data_view & layer) const;
+
+    MAPNIK_VECTOR_INLINE bool layer_view(std::size_t index, protozero::data_view & layer) const;
+};
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
+
+#if !defined(MAPNIK_VECTOR_TILE_LIBRARY)
+#include "vector_tile_tile_view.ipp"
+#endif
+
+#endif // __MAPNIK_VECTOR_TILE_TILE_VIEW_H__
@@ -0,0 +1,79 @@
+// mapnik-vector-tile
+#include "vector_tile_config.hpp"
+
+//protozero
+#include <protozero/pbf_reader.hpp>
+
+// std
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mapnik
+{
+
+namespace vector_tile_impl
+{
+
+MAPNIK_VECTOR_INLINE tile_view::tile_view(std::shared_ptr<const void> owner,
+                                          const char * data,
+                                          std::size_t size)
+    : owner_(std::move(owner)),
+      data_(data),
+      size_(size),
+      layers_(),
+      directory_()
+{
+    protozero::pbf_reader item(data_, size_);
+    while (item.next(Tile_Encoding::LAYERS))
+    {
+        protozero::data_view layer = item.get_view();
+        std::size_t offset = static_cast<std::size_t>(layer.data() - data_);
+        std::vector<std::string> names;
+        std::exception_ptr error = read_layer_names(layer, names);
+        directory_.add(names, offset, layer.size(), error);
+        layers_.push_back(names.empty() ? std::string() : names.front());
+    }
+}
+
+MAPNIK_VECTOR_INLINE bool tile_view::layer_reader(std::string const& name, protozero::pbf_reader & layer_msg) const
+{
+    protozero::data_view layer;
+    if (!layer_view(name, layer))
+    {
+        return false;
+    }
+    layer_msg = protozero::pbf_reader(layer);
+    return true;
+}
+
+MAPNIK_VECTOR_INLINE bool tile_view::layer_reader(std::size_t index, protozero::pbf_reader & layer_msg) const
+{
+    protozero::data_view layer;
+    if (!layer_view(index, layer))
+    {
+        return false;
+    }
+    layer_msg = protozero::pbf_reader(layer);
+    return true;
+}
+
+MAPNIK_VECTOR_INLINE bool tile_view::layer_view(std::string const& name, protozero::data_view & layer) const
+{
+    return layer_view(directory_.find(name), layer);
+}
+
+MAPNIK_VECTOR_INLINE bool tile_view::layer_view(std::size_t index, protozero::data_view & layer) const
+{
+    if (index >= directory_.size())
+    {
+        return false;
+    }
+    layer = directory_.view(data_, index);
+    return true;
+}
+
+} // end ns vector_tile_impl
+
+} // end ns mapnik
@@ -63,6 +63,49 @@ std::shared_ptr<mapnik::memory_datasource> build_ds(double x,double y, bool seco
     return ds;
 }
 
+std::shared_ptr<mapnik::memory_datasource> build_features_ds(std::int64_t count,
+                                                             std::vector<std::string> const& properties,
+                                                             feature_filler const& fill)
+{
+    mapnik::parameters params;
+    params["type"] = "memory";
+    std::shared_ptr<mapnik::memory_datasource> ds = std::make_shared<mapnik::memory_datasource>(params);
+    mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
+    for (auto const& name : properties)
+    {
+        ctx->push(name);
+    }
+    for (std::int64_t i = 0; i < count; ++i)
+    {
+        mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, i + 1));
+        fill(*feature, i);
+        ds->push(feature);
+    }
+    return ds;
+}
+
+mapnik::feature_ptr build_feature(mapnik::context_ptr const& ctx, std::int64_t id, std::string const& name)
+{
+    mapnik::feature_ptr feature(mapnik::feature_factory::create(ctx, id));
+    put_string(*feature, "name", name);
+    feature->put("id", static_cast<mapnik::value_integer>(id));
+    return feature;
+}
+
+void put_string(mapnik::feature_impl & feature, std::string const& key, std::string const& value)
+{
+    mapnik::transcoder tr("utf-8");
+    feature.put(key, tr.transcode(value.c_str()));
+}
+
+mapnik::geometry::line_string<double> build_line(double x0, double y0, double x1, double y1)
+{
+    mapnik::geometry::line_string<double> line;
+    line.emplace_back(x0, y0);
+    line.emplace_back(x1, y1);
+    return line;
+}
+
 std::shared_ptr<mapnik::memory_datasource> build_geojson_ds(std::string const& geojson_file)
 {
     mapnik::util::file input(geojson_file);
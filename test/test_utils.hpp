@@ -3,13 +3,30 @@
 
 // mapnik
 #include <mapnik/memory_datasource.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/geometry.hpp>
 #include <mapnik/image.hpp>
 #include <mapnik/image_any.hpp>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace testing {
 
 std::shared_ptr<mapnik::memory_datasource> build_ds(double x,double y, bool second=false);
+
+// Memory datasource of count features with ids from 1, feature i being given
+// its geometry and the properties named in properties by fill(feature, i)
+using feature_filler = std::function<void(mapnik::feature_impl & feature, std::int64_t i)>;
+std::shared_ptr<mapnik::memory_datasource> build_features_ds(std::int64_t count,
+                                                             std::vector<std::string> const& properties,
+                                                             feature_filler const& fill);
+// A feature with a "name" property and an "id" property set to its id
+mapnik::feature_ptr build_feature(mapnik::context_ptr const& ctx, std::int64_t id, std::string const& name);
+void put_string(mapnik::feature_impl & feature, std::string const& key, std::string const& value);
+mapnik::geometry::line_string<double> build_line(double x0, double y0, double x1, double y1);
 mapnik::geometry::geometry<double> read_geojson(std::string const& geojson_file);
 std::shared_ptr<mapnik::memory_datasource> build_geojson_ds(std::string const& geojson_file);
 mapnik::datasource_ptr build_geojson_fs_ds(std::string const& geojson_file);
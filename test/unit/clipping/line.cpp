@@ -0,0 +1,64 @@
+#include "catch.hpp"
+
+// mapnik vector tile
+#include "vector_tile_geometry_clipper.hpp"
+
+// mapbox
+#include <mapbox/geometry/geometry.hpp>
+
+namespace {
+
+using line_type = mapbox::geometry::line_string<std::int64_t>;
+using multi_line_type = mapbox::geometry::multi_line_string<std::int64_t>;
+using box_type = mapbox::geometry::box<std::int64_t>;
+using point_type = mapbox::geometry::point<std::int64_t>;
+
+multi_line_type clip(line_type const& line)
+{
+    box_type box(point_type(0, 0), point_type(100, 100));
+    multi_line_type result;
+    mapnik::vector_tile_impl::detail::clip_line(line, box, result);
+    return result;
+}
+
+}
+
+TEST_CASE("line entirely inside the box is kept as is")
+{
+    line_type line { { 10, 10 }, { 50, 20 }, { 90, 90 } };
+    multi_line_type result = clip(line);
+    REQUIRE(result.size() == 1);
+    CHECK(result.front() == line);
+}
+
+TEST_CASE("line crossing the box is cut at its edges")
+{
+    line_type line { { -50, 50 }, { 150, 50 } };
+    multi_line_type result = clip(line);
+    REQUIRE(result.size() == 1);
+    CHECK(result.front() == line_type({ { 0, 50 }, { 100, 50 } }));
+}
+
+TEST_CASE("line leaving and entering the box again is split")
+{
+    line_type line { { 50, 50 }, { 50, 150 }, { 80, 150 }, { 80, 50 }, { 90, 50 } };
+    multi_line_type result = clip(line);
+    REQUIRE(result.size() == 2);
+    CHECK(result[0] == line_type({ { 50, 50 }, { 50, 100 } }));
+    CHECK(result[1] == line_type({ { 80, 100 }, { 80, 50 }, { 90, 50 } }));
+}
+
+TEST_CASE("diagonal intersections are rounded to the integer grid")
+{
+    line_type line { { -10, -5 }, { 110, 55 } };
+    multi_line_type result = clip(line);
+    REQUIRE(result.size() == 1);
+    CHECK(result.front() == line_type({ { 0, 0 }, { 100, 50 } }));
+}
+
+TEST_CASE("line outside of the box or only touching a corner is dropped")
+{
+    CHECK(clip(line_type({ { -10, -10 }, { -5, 200 } })).empty());
+    CHECK(clip(line_type({ { -10, 10 }, { 10, -10 } })).empty());
+    CHECK(clip(line_type({ { -10, -10 }, { 0, 0 }, { 10, -10 } })).empty());
+}
@@ -0,0 +1,99 @@
+#include "catch.hpp"
+
+// mapnik vector tile
+#include "vector_tile_geometry_clipper.hpp"
+
+// mapbox
+#include <mapbox/geometry/geometry.hpp>
+
+namespace {
+
+struct collect_polygons
+{
+    mapbox::geometry::multi_polygon<std::int64_t> result;
+
+    template <typename T>
+    void operator() (T &) {}
+
+    void operator() (mapbox::geometry::multi_polygon<std::int64_t> & geom)
+    {
+        result = geom;
+    }
+};
+
+using clipper_type = mapnik::vector_tile_impl::geometry_clipper<collect_polygons>;
+
+mapbox::geometry::polygon<std::int64_t> building()
+{
+    // Exterior in the wrong orientation for the clipper, hole and tiny hole
+    mapbox::geometry::polygon<std::int64_t> poly;
+    poly.push_back({ { 10, 10 }, { 10, 50 }, { 50, 50 }, { 50, 10 }, { 10, 10 } });
+    poly.push_back({ { 20, 20 }, { 30, 20 }, { 30, 30 }, { 20, 30 }, { 20, 20 } });
+    poly.push_back({ { 40, 40 }, { 40, 41 }, { 41, 40 }, { 40, 40 } });
+    return poly;
+}
+
+}
+
+TEST_CASE("trusted polygon inside the tile only gets its rings fixed")
+{
+    mapbox::geometry::box<std::int64_t> extent({ 0, 0 }, { 100, 100 });
+    collect_polygons collect;
+    clipper_type clipper(extent, 1.0, true, false, mapnik::vector_tile_impl::positive_fill, false, true, collect);
+
+    mapbox::geometry::polygon<std::int64_t> poly = building();
+    clipper(poly);
+    REQUIRE(collect.result.size() == 1);
+    auto const& out = collect.result.front();
+    REQUIRE(out.size() == 2);
+    CHECK(mapnik::vector_tile_impl::detail::area(out[0]) > 0);
+    CHECK(mapnik::vector_tile_impl::detail::area(out[1]) < 0);
+    CHECK(out[0].front() == out[0].back());
+    // Same vertices, only reversed
+    CHECK(out[0].size() == 5);
+    CHECK(out[1].size() == 5);
+}
+
+TEST_CASE("trusted and untrusted polygons inside the tile have the same area")
+{
+    mapbox::geometry::box<std::int64_t> extent({ 0, 0 }, { 100, 100 });
+    collect_polygons trusted;
+    collect_polygons untrusted;
+    clipper_type trusted_clipper(extent, 1.0, true, false, mapnik::vector_tile_impl::positive_fill, false, true, trusted);
+    clipper_type untrusted_clipper(extent, 1.0, true, false, mapnik::vector_tile_impl::positive_fill, false, false, untrusted);
+
+    mapbox::geometry::polygon<std::int64_t> poly1 = building();
+    mapbox::geometry::polygon<std::int64_t> poly2 = building();
+    trusted_clipper(poly1);
+    untrusted_clipper(poly2);
+    REQUIRE(trusted.result.size() == 1);
+    REQUIRE(untrusted.result.size() == 1);
+    auto polygon_area = [](mapbox::geometry::polygon<std::int64_t> const& poly) {
+        double a = 0.0;
+        for (auto const& ring : poly)
+        {
+            a += mapnik::vector_tile_impl::detail::area(ring);
+        }
+        return a;
+    };
+    CHECK(polygon_area(trusted.result.front()) == Approx(polygon_area(untrusted.result.front())));
+}
+
+TEST_CASE("trusted polygon crossing the tile is still clipped")
+{
+    mapbox::geometry::box<std::int64_t> extent({ 0, 0 }, { 30, 30 });
+    collect_polygons collect;
+    clipper_type clipper(extent, 1.0, true, false, mapnik::vector_tile_impl::positive_fill, false, true, collect);
+
+    mapbox::geometry::polygon<std::int64_t> poly = building();
+    clipper(poly);
+    REQUIRE(collect.result.size() == 1);
+    for (auto const& ring : collect.result.front())
+    {
+        for (auto const& pt : ring)
+        {
+            CHECK(pt.x <= 30);
+            CHECK(pt.y <= 30);
+        }
+    }
+}
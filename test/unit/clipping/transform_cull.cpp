@@ -0,0 +1,76 @@
+#include "catch.hpp"
+
+// mapnik vector tile
+#include "vector_tile_strategy.hpp"
+
+// mapnik
+#include <mapnik/geometry.hpp>
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/view_transform.hpp>
+
+// mapbox
+#include <mapbox/geometry/geometry.hpp>
+
+namespace {
+
+struct collect_lines
+{
+    mapbox::geometry::line_string<std::int64_t> line;
+    mapbox::geometry::polygon<std::int64_t> polygon;
+
+    void operator() (mapbox::geometry::line_string<std::int64_t> & geom)
+    {
+        line = geom;
+    }
+
+    void operator() (mapbox::geometry::polygon<std::int64_t> & geom)
+    {
+        polygon = geom;
+    }
+
+    template <typename T>
+    void operator() (T &) {}
+};
+
+}
+
+TEST_CASE("transform visitor drops runs of vertices outside of the same side")
+{
+    mapnik::box2d<double> extent(0, 0, 100, 100);
+    mapnik::view_transform tr(100, 100, extent, 0.0, 0.0);
+    mapnik::vector_tile_impl::vector_tile_strategy vs(tr);
+    collect_lines next;
+    mapnik::vector_tile_impl::transform_visitor<mapnik::vector_tile_impl::vector_tile_strategy, collect_lines> visitor(vs, extent, next);
+
+    // Goes far to the right of the tile and comes back
+    mapnik::geometry::line_string<double> line;
+    line.emplace_back(50, 50);
+    line.emplace_back(90, 50);
+    for (int i = 0; i < 10; ++i)
+    {
+        line.emplace_back(200 + i * 100, 50 + i);
+    }
+    line.emplace_back(90, 60);
+    line.emplace_back(50, 60);
+    visitor(line);
+
+    mapbox::geometry::line_string<std::int64_t> expected { { 50, 50 }, { 90, 50 }, { 200, 50 }, { 1100, 41 }, { 90, 40 }, { 50, 40 } };
+    CHECK(next.line == expected);
+
+    // Runs that change sides keep the vertex where they turn
+    mapnik::geometry::polygon<double> poly;
+    mapnik::geometry::linear_ring<double> ring;
+    ring.emplace_back(-200, -200);
+    ring.emplace_back(-300, 50);
+    ring.emplace_back(-200, 300);
+    ring.emplace_back(50, 400);
+    ring.emplace_back(300, 300);
+    ring.emplace_back(50, 50);
+    ring.emplace_back(-200, -200);
+    poly.push_back(std::move(ring));
+    visitor(poly);
+
+    REQUIRE(next.polygon.size() == 1);
+    CHECK(next.polygon.front().size() == 5);
+    CHECK(next.polygon.front().front() == next.polygon.front().back());
+}
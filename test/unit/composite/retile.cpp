@@ -0,0 +1,341 @@
+#include "catch.hpp"
+
+// test utils
+#include "test_utils.hpp"
+
+// mapnik
+#include <mapnik/geometry/envelope.hpp>
+
+// mapnik vector tile
+#include "vector_tile_geometry_decoder.hpp"
+#include "vector_tile_geometry_feature.hpp"
+#include "vector_tile_layer.hpp"
+#include "vector_tile_retile.hpp"
+
+// libprotobuf
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#include "vector_tile.pb.h"
+#pragma GCC diagnostic pop
+
+namespace {
+
+// A line across the tile, a point in its lower right quarter and a square in
+// its upper left quarter, in a tile of extent 4096 at z0.
+mapnik::vector_tile_impl::merc_tile_ptr build_source()
+{
+    mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
+    ctx->push("name");
+    ctx->push("id");
+    std::string buffer;
+    mapnik::vector_tile_impl::layer_builder_pbf builder("layer", 4096, buffer);
+
+    mapnik::feature_ptr line_feature = testing::build_feature(ctx, 1, "name 1");
+    mapnik::vector_tile_impl::geometry_to_feature_pbf_visitor visitor(*line_feature, builder);
+    mapbox::geometry::line_string<std::int64_t> line { { 0, 1024 }, { 4096, 1024 } };
+    visitor(line);
+
+    mapnik::feature_ptr point_feature = testing::build_feature(ctx, 2, "name 2");
+    visitor.set_feature(*point_feature);
+    visitor(mapbox::geometry::point<std::int64_t>(3000, 3000));
+
+    mapnik::feature_ptr polygon_feature = testing::build_feature(ctx, 3, "name 3");
+    visitor.set_feature(*polygon_feature);
+    mapbox::geometry::polygon<std::int64_t> poly { { { 512, 512 }, { 1536, 512 }, { 1536, 1536 }, { 512, 1536 }, { 512, 512 } } };
+    visitor(poly);
+
+    auto source = std::make_shared<mapnik::vector_tile_impl::merc_tile>(0, 0, 0, 4096, 0);
+    source->append_layer_buffer(buffer.data(), buffer.size(), "layer");
+    return source;
+}
+
+mapnik::geometry::geometry<std::int64_t> decode(vector_tile::Tile_Feature const& feature)
+{
+    std::string geometry;
+    {
+        protozero::pbf_writer writer(geometry);
+        writer.add_packed_uint32(1, feature.geometry().begin(), feature.geometry().end());
+    }
+    protozero::pbf_reader reader(geometry);
+    REQUIRE(reader.next(1));
+    mapnik::vector_tile_impl::GeometryPBF paths(reader.get_packed_uint32());
+    return mapnik::vector_tile_impl::decode_geometry<std::int64_t>(paths, feature.type(), 2, 0, 0, 1.0, 1.0);
+}
+
+} // end anonymous ns
+
+TEST_CASE("overzoom clips and scales the features of a parent tile")
+{
+    mapnik::vector_tile_impl::merc_tile_ptr source = build_source();
+    vector_tile::Tile source_tile;
+    REQUIRE(source_tile.ParseFromString(source->get_buffer()));
+    REQUIRE(source_tile.layers_size() == 1);
+    vector_tile::Tile_Layer const& source_layer = source_tile.layers(0);
+
+    SECTION("upper right child only keeps the line")
+    {
+        mapnik::vector_tile_impl::merc_tile target(1, 0, 1, 4096, 0);
+        mapnik::vector_tile_impl::overzoom(*source, target);
+        vector_tile::Tile tile;
+        REQUIRE(tile.ParseFromString(target.get_buffer()));
+        REQUIRE(tile.layers_size() == 1);
+        vector_tile::Tile_Layer const& layer = tile.layers(0);
+        CHECK(layer.name() == "layer");
+        CHECK(layer.extent() == 4096);
+        CHECK(layer.version() == 2);
+        REQUIRE(layer.features_size() == 1);
+        vector_tile::Tile_Feature const& feature = layer.features(0);
+        CHECK(feature.id() == 1);
+        CHECK(feature.type() == vector_tile::Tile_GeomType_LINESTRING);
+        std::vector<std::uint32_t> expected { 9, 0, 4096, 10, 8192, 0 };
+        CHECK(std::vector<std::uint32_t>(feature.geometry().begin(), feature.geometry().end()) == expected);
+
+        // Only the keys and values of the line are kept
+        CHECK(layer.keys_size() == 2);
+        CHECK(layer.values_size() == 2);
+        REQUIRE(feature.tags_size() == 4);
+        CHECK(layer.keys(feature.tags(0)) == "name");
+        CHECK(layer.values(feature.tags(1)).string_value() == "name 1");
+        CHECK(layer.keys(feature.tags(2)) == "id");
+        CHECK(layer.values(feature.tags(3)).int_value() == 1);
+        CHECK(source_layer.values_size() == 6);
+    }
+
+    SECTION("upper left child keeps the line and the scaled square")
+    {
+        mapnik::vector_tile_impl::merc_tile target(0, 0, 1, 4096, 0);
+        mapnik::vector_tile_impl::overzoom(*source, target);
+        vector_tile::Tile tile;
+        REQUIRE(tile.ParseFromString(target.get_buffer()));
+        REQUIRE(tile.layers_size() == 1);
+        vector_tile::Tile_Layer const& layer = tile.layers(0);
+        REQUIRE(layer.features_size() == 2);
+        CHECK(layer.features(0).id() == 1);
+        vector_tile::Tile_Feature const& feature = layer.features(1);
+        CHECK(feature.id() == 3);
+        CHECK(feature.type() == vector_tile::Tile_GeomType_POLYGON);
+        mapnik::box2d<double> bbox = mapnik::geometry::envelope(decode(feature));
+        CHECK(bbox == mapnik::box2d<double>(1024, 1024, 3072, 3072));
+    }
+
+    SECTION("a child with a smaller extent and a buffer")
+    {
+        mapnik::vector_tile_impl::merc_tile target(2, 2, 2, 256, 16);
+        mapnik::vector_tile_impl::overzoom(*source, target);
+        vector_tile::Tile tile;
+        REQUIRE(tile.ParseFromString(target.get_buffer()));
+        REQUIRE(tile.layers_size() == 1);
+        vector_tile::Tile_Layer const& layer = tile.layers(0);
+        CHECK(layer.extent() == 256);
+        REQUIRE(layer.features_size() == 1);
+        vector_tile::Tile_Feature const& feature = layer.features(0);
+        CHECK(feature.id() == 2);
+        // (3000, 3000) is at (3000 / 4 - 512, 3000 / 4 - 512)
+        std::vector<std::uint32_t> expected { 9, 476, 476 };
+        CHECK(std::vector<std::uint32_t>(feature.geometry().begin(), feature.geometry().end()) == expected);
+    }
+
+    SECTION("a child without features gets an empty layer")
+    {
+        mapnik::vector_tile_impl::merc_tile target(0, 1, 1, 4096, 0);
+        mapnik::vector_tile_impl::overzoom(*source, target);
+        CHECK(target.is_empty());
+        CHECK(target.get_empty_layers().count("layer") == 1);
+    }
+
+    SECTION("only descendants can be overzoomed to")
+    {
+        mapnik::vector_tile_impl::merc_tile parent(0, 0, 0, 4096, 0);
+        mapnik::vector_tile_impl::merc_tile other(1, 0, 1);
+        mapnik::vector_tile_impl::merc_tile not_child(0, 0, 2);
+        CHECK_THROWS(mapnik::vector_tile_impl::overzoom(other, not_child));
+        CHECK_THROWS(mapnik::vector_tile_impl::overzoom(other, parent));
+    }
+}
+
+TEST_CASE("underzoom merges the features of the children of a tile")
+{
+    mapnik::vector_tile_impl::merc_tile_ptr source = build_source();
+    std::vector<mapnik::vector_tile_impl::merc_tile_ptr> children;
+    for (std::uint64_t y = 0; y < 2; ++y)
+    {
+        for (std::uint64_t x = 0; x < 2; ++x)
+        {
+            auto child = std::make_shared<mapnik::vector_tile_impl::merc_tile>(x, y, 1, 4096, 0);
+            mapnik::vector_tile_impl::overzoom(*source, *child);
+            children.push_back(child);
+        }
+    }
+
+    SECTION("each child adds its quarter of the parent")
+    {
+        mapnik::vector_tile_impl::merc_tile target(0, 0, 0, 4096, 0);
+        mapnik::vector_tile_impl::underzoom(children, target);
+        vector_tile::Tile tile;
+        REQUIRE(tile.ParseFromString(target.get_buffer()));
+        REQUIRE(tile.layers_size() == 1);
+        vector_tile::Tile_Layer const& layer = tile.layers(0);
+        CHECK(layer.name() == "layer");
+        CHECK(layer.version() == 2);
+        CHECK(layer.extent() == 4096);
+        REQUIRE(layer.features_size() == 4);
+
+        // The line is cut where the children meet
+        CHECK(layer.features(0).id() == 1);
+        CHECK(mapnik::geometry::envelope(decode(layer.features(0))) == mapnik::box2d<double>(0, 1024, 2048, 1024));
+        CHECK(layer.features(1).id() == 3);
+        CHECK(mapnik::geometry::envelope(decode(layer.features(1))) == mapnik::box2d<double>(512, 512, 1536, 1536));
+        CHECK(layer.features(2).id() == 1);
+        CHECK(mapnik::geometry::envelope(decode(layer.features(2))) == mapnik::box2d<double>(2048, 1024, 4096, 1024));
+        CHECK(layer.features(3).id() == 2);
+        CHECK(mapnik::geometry::envelope(decode(layer.features(3))) == mapnik::box2d<double>(3000, 3000, 3000, 3000));
+
+        // Keys and values shared by the children are only written once
+        CHECK(layer.keys_size() == 2);
+        CHECK(layer.values_size() == 6);
+        vector_tile::Tile_Feature const& point = layer.features(3);
+        REQUIRE(point.tags_size() == 4);
+        CHECK(layer.keys(point.tags(0)) == "name");
+        CHECK(layer.values(point.tags(1)).string_value() == "name 2");
+        CHECK(layer.keys(point.tags(2)) == "id");
+        CHECK(layer.values(point.tags(3)).int_value() == 2);
+    }
+
+    SECTION("missing children are skipped")
+    {
+        std::vector<mapnik::vector_tile_impl::merc_tile_ptr> some_children { children[3], nullptr };
+        mapnik::vector_tile_impl::merc_tile target(0, 0, 0, 4096, 0);
+        mapnik::vector_tile_impl::underzoom(some_children, target);
+        vector_tile::Tile tile;
+        REQUIRE(tile.ParseFromString(target.get_buffer()));
+        REQUIRE(tile.layers_size() == 1);
+        REQUIRE(tile.layers(0).features_size() == 1);
+        CHECK(tile.layers(0).features(0).id() == 2);
+    }
+
+    SECTION("features smaller than a unit are dropped")
+    {
+        mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
+        ctx->push("name");
+        ctx->push("id");
+        std::string buffer;
+        mapnik::vector_tile_impl::layer_builder_pbf builder("small", 4096, buffer);
+        mapnik::feature_ptr feature = testing::build_feature(ctx, 1, "name 1");
+        mapnik::vector_tile_impl::geometry_to_feature_pbf_visitor visitor(*feature, builder);
+        mapbox::geometry::line_string<std::int64_t> line { { 100, 100 }, { 101, 100 } };
+        visitor(line);
+        auto child = std::make_shared<mapnik::vector_tile_impl::merc_tile>(0, 0, 1, 4096, 0);
+        child->append_layer_buffer(buffer.data(), buffer.size(), "small");
+
+        mapnik::vector_tile_impl::merc_tile target(0, 0, 0, 4096, 0);
+        mapnik::vector_tile_impl::underzoom({ child }, target);
+        CHECK(target.is_empty());
+        CHECK(target.get_empty_layers().count("small") == 1);
+    }
+
+    SECTION("only children can be underzoomed from")
+    {
+        mapnik::vector_tile_impl::merc_tile target(1, 0, 1, 4096, 0);
+        CHECK_THROWS(mapnik::vector_tile_impl::underzoom(children, target));
+    }
+}
+
+TEST_CASE("upgrade layer rewrites version 1 geometries as valid version 2 ones")
+{
+    // A bow tie and a degenerate ring
+    std::vector<std::uint32_t> geometry {
+        9, 0, 0,
+        26, 200, 200, 0, 199, 199, 200,
+        15,
+        9, 100, 99,
+        10, 20, 0,
+        15 };
+    std::vector<std::uint32_t> tags { 0, 0 };
+    std::string buffer;
+    {
+        protozero::pbf_writer layer_writer(buffer);
+        layer_writer.add_uint32(mapnik::vector_tile_impl::Layer_Encoding::VERSION, 1);
+        layer_writer.add_string(mapnik::vector_tile_impl::Layer_Encoding::NAME, "layer");
+        layer_writer.add_uint32(mapnik::vector_tile_impl::Layer_Encoding::EXTENT, 4096);
+        {
+            protozero::pbf_writer feature_writer(layer_writer, mapnik::vector_tile_impl::Layer_Encoding::FEATURES);
+            feature_writer.add_uint64(mapnik::vector_tile_impl::Feature_Encoding::ID, 7);
+            feature_writer.add_packed_uint32(mapnik::vector_tile_impl::Feature_Encoding::TAGS, tags.begin(), tags.end());
+            feature_writer.add_enum(mapnik::vector_tile_impl::Feature_Encoding::TYPE, mapnik::vector_tile_impl::Geometry_Type::POLYGON);
+            feature_writer.add_packed_uint32(mapnik::vector_tile_impl::Feature_Encoding::GEOMETRY, geometry.begin(), geometry.end());
+        }
+        layer_writer.add_string(mapnik::vector_tile_impl::Layer_Encoding::KEYS, "name");
+        {
+            protozero::pbf_writer value_writer(layer_writer, mapnik::vector_tile_impl::Layer_Encoding::VALUES);
+            value_writer.add_string(mapnik::vector_tile_impl::Value_Encoding::STRING, "bow tie");
+        }
+    }
+
+    std::string upgraded;
+    REQUIRE(mapnik::vector_tile_impl::upgrade_layer(protozero::data_view(buffer.data(), buffer.size()), 4096, upgraded));
+    vector_tile::Tile_Layer layer;
+    REQUIRE(layer.ParseFromString(upgraded));
+    CHECK(layer.name() == "layer");
+    CHECK(layer.version() == 2);
+    CHECK(layer.extent() == 4096);
+    REQUIRE(layer.keys_size() == 1);
+    CHECK(layer.keys(0) == "name");
+    REQUIRE(layer.values_size() == 1);
+    CHECK(layer.values(0).string_value() == "bow tie");
+    REQUIRE(layer.features_size() == 1);
+    vector_tile::Tile_Feature const& feature = layer.features(0);
+    CHECK(feature.id() == 7);
+    REQUIRE(feature.tags_size() == 2);
+
+    // The bow tie is split in two triangles
+    mapnik::geometry::geometry<std::int64_t> geom = decode(feature);
+    REQUIRE(geom.is<mapnik::geometry::multi_polygon<std::int64_t> >());
+    auto const& mp = mapnik::util::get<mapnik::geometry::multi_polygon<std::int64_t> >(geom);
+    REQUIRE(mp.size() == 2);
+    CHECK(mp[0].size() == 1);
+    CHECK(mp[1].size() == 1);
+    CHECK(mapnik::geometry::envelope(geom) == mapnik::box2d<double>(0, 0, 100, 100));
+}
+
+TEST_CASE("upgrade layer keeps only the keys and values its features use")
+{
+    // A square
+    std::vector<std::uint32_t> geometry { 9, 0, 0, 26, 20, 0, 0, 20, 19, 0, 15 };
+    // The second tag does not exist in the layer, version 1 readers skip it
+    std::vector<std::uint32_t> tags { 0, 1, 5, 5 };
+    std::string buffer;
+    {
+        protozero::pbf_writer layer_writer(buffer);
+        layer_writer.add_uint32(mapnik::vector_tile_impl::Layer_Encoding::VERSION, 1);
+        layer_writer.add_string(mapnik::vector_tile_impl::Layer_Encoding::NAME, "layer");
+        layer_writer.add_uint32(mapnik::vector_tile_impl::Layer_Encoding::EXTENT, 4096);
+        {
+            protozero::pbf_writer feature_writer(layer_writer, mapnik::vector_tile_impl::Layer_Encoding::FEATURES);
+            feature_writer.add_packed_uint32(mapnik::vector_tile_impl::Feature_Encoding::TAGS, tags.begin(), tags.end());
+            feature_writer.add_enum(mapnik::vector_tile_impl::Feature_Encoding::TYPE, mapnik::vector_tile_impl::Geometry_Type::POLYGON);
+            feature_writer.add_packed_uint32(mapnik::vector_tile_impl::Feature_Encoding::GEOMETRY, geometry.begin(), geometry.end());
+        }
+        layer_writer.add_string(mapnik::vector_tile_impl::Layer_Encoding::KEYS, "name");
+        layer_writer.add_string(mapnik::vector_tile_impl::Layer_Encoding::KEYS, "unused");
+        for (auto const& value : { "unused", "square" })
+        {
+            protozero::pbf_writer value_writer(layer_writer, mapnik::vector_tile_impl::Layer_Encoding::VALUES);
+            value_writer.add_string(mapnik::vector_tile_impl::Value_Encoding::STRING, value);
+        }
+    }
+
+    std::string upgraded;
+    REQUIRE(mapnik::vector_tile_impl::upgrade_layer(protozero::data_view(buffer.data(), buffer.size()), 4096, upgraded));
+    vector_tile::Tile_Layer layer;
+    REQUIRE(layer.ParseFromString(upgraded));
+    REQUIRE(layer.keys_size() == 1);
+    CHECK(layer.keys(0) == "name");
+    REQUIRE(layer.values_size() == 1);
+    CHECK(layer.values(0).string_value() == "square");
+    REQUIRE(layer.features_size() == 1);
+    vector_tile::Tile_Feature const& feature = layer.features(0);
+    REQUIRE(feature.tags_size() == 2);
+    CHECK(feature.tags(0) == 0);
+    CHECK(feature.tags(1) == 0);
+}
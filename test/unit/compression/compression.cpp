@@ -3,6 +3,10 @@
 // mapnik-vector-tile
 #include "vector_tile_compression.hpp"
 
+// std
+#include <string>
+#include <vector>
+
 TEST_CASE("invalid decompression")
 {
     std::string data("this is a string that should be compressed data");
@@ -11,6 +15,28 @@ TEST_CASE("invalid decompression")
     CHECK_THROWS(mapnik::vector_tile_impl::zlib_decompress(data, output));
 }
 
+TEST_CASE("truncated decompression")
+{
+    std::string data;
+    for (int i = 0; i < 1000; ++i)
+    {
+        data += "feature " + std::to_string(i) + " ";
+    }
+    for (bool gzip : { false, true })
+    {
+        std::string compressed_data;
+        mapnik::vector_tile_impl::zlib_compress(data, compressed_data, gzip);
+        // Both with the end of the stream cut and with only its header left
+        for (std::size_t size : { compressed_data.size() / 2, std::size_t(10) })
+        {
+            std::string truncated = compressed_data.substr(0, size);
+            std::string output;
+            CHECK_THROWS_AS(mapnik::vector_tile_impl::zlib_decompress(truncated, output), std::runtime_error);
+            CHECK(output.empty());
+        }
+    }
+}
+
 TEST_CASE("round trip compression - zlib")
 {
     std::string data("this is a sentence that will be compressed into something");
@@ -458,3 +484,160 @@ TEST_CASE("round trip compression - gzip")
         }
     }
 }
+
+TEST_CASE("compression type detection")
+{
+    std::string data("this is a sentence that will be compressed into something");
+    CHECK(mapnik::vector_tile_impl::get_compression_type(data.data(), data.size()) == mapnik::vector_tile_impl::no_compression);
+    CHECK(!mapnik::vector_tile_impl::is_zstd_compressed(data));
+    std::string zstd_header("\x28\xB5\x2F\xFD\x20", 5);
+    CHECK(mapnik::vector_tile_impl::is_zstd_compressed(zstd_header));
+    CHECK(mapnik::vector_tile_impl::get_compression_type(zstd_header.data(), zstd_header.size()) == mapnik::vector_tile_impl::zstd_compression);
+
+    std::string zlib_data;
+    mapnik::vector_tile_impl::compress(data.data(), data.size(), zlib_data, mapnik::vector_tile_impl::zlib_compression);
+    CHECK(mapnik::vector_tile_impl::get_compression_type(zlib_data.data(), zlib_data.size()) == mapnik::vector_tile_impl::zlib_compression);
+    std::string gzip_data;
+    mapnik::vector_tile_impl::compress(data.data(), data.size(), gzip_data, mapnik::vector_tile_impl::gzip_compression);
+    CHECK(mapnik::vector_tile_impl::get_compression_type(gzip_data.data(), gzip_data.size()) == mapnik::vector_tile_impl::gzip_compression);
+}
+
+TEST_CASE("round trip compression - codecs")
+{
+    // Large enough to need more than one pass without the size of the output
+    std::string data;
+    for (int i = 0; i < 10000; ++i)
+    {
+        data += "feature " + std::to_string(i % 97) + " ";
+    }
+    std::vector<mapnik::vector_tile_impl::compression_type> types = {
+        mapnik::vector_tile_impl::no_compression,
+        mapnik::vector_tile_impl::zlib_compression,
+        mapnik::vector_tile_impl::gzip_compression
+    };
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+    types.push_back(mapnik::vector_tile_impl::zstd_compression);
+#endif
+    for (auto type : types)
+    {
+        // The contexts of the thread are reused from one call to the next
+        for (int i = 0; i < 3; ++i)
+        {
+            std::string compressed_data;
+            mapnik::vector_tile_impl::compress(data.data(), data.size(), compressed_data, type);
+            CHECK(mapnik::vector_tile_impl::get_compression_type(compressed_data.data(), compressed_data.size()) == type);
+            std::string new_data;
+            bool decompressed = mapnik::vector_tile_impl::decompress(compressed_data.data(), compressed_data.size(), new_data);
+            CHECK(decompressed == (type != mapnik::vector_tile_impl::no_compression));
+            if (decompressed)
+            {
+                CHECK(data == new_data);
+            }
+        }
+    }
+}
+
+TEST_CASE("round trip compression - empty data")
+{
+    std::string data;
+    std::string compressed_data;
+    mapnik::vector_tile_impl::zlib_compress(data, compressed_data);
+    CHECK(mapnik::vector_tile_impl::is_gzip_compressed(compressed_data));
+    std::string new_data("not empty");
+    mapnik::vector_tile_impl::zlib_decompress(compressed_data, new_data);
+    CHECK(new_data.empty());
+}
+
+#if defined(MAPNIK_VECTOR_TILE_ZSTD)
+
+TEST_CASE("round trip compression - zstd")
+{
+    std::string data("this is a sentence that will be compressed into something");
+    for (int level = 1; level <= ZSTD_maxCLevel(); ++level)
+    {
+        std::string compressed_data;
+        mapnik::vector_tile_impl::zstd_compress(data.data(), data.size(), compressed_data, level);
+        CHECK(mapnik::vector_tile_impl::is_zstd_compressed(compressed_data));
+        std::string new_data;
+        mapnik::vector_tile_impl::zstd_decompress(compressed_data.data(), compressed_data.size(), new_data);
+        CHECK(data == new_data);
+    }
+    std::string invalid("\x28\xB5\x2F\xFD this is not a frame", 24);
+    std::string output;
+    CHECK_THROWS(mapnik::vector_tile_impl::zstd_decompress(invalid.data(), invalid.size(), output));
+}
+
+TEST_CASE("zstd frame header with a forged content size")
+{
+    // Single segment frame that claims 2^40 bytes but holds a raw block of 5
+    std::string forged("\x28\xB5\x2F\xFD\xE0", 5);
+    forged.append("\x00\x00\x00\x00\x00\x01\x00\x00", 8);
+    forged.append("\x29\x00\x00", 3);
+    forged.append("hello");
+    std::string output;
+    CHECK_THROWS_AS(mapnik::vector_tile_impl::zstd_decompress(forged.data(), forged.size(), output), std::runtime_error);
+    CHECK(output.empty());
+
+    // Data compressed beyond the clamp is still decoded, as a stream
+    std::string data(4 * 1024 * 1024, 'a');
+    std::string compressed_data;
+    mapnik::vector_tile_impl::zstd_compress(data.data(), data.size(), compressed_data);
+    CHECK(compressed_data.size() * 1032 + 1024 < data.size());
+    std::string new_data;
+    mapnik::vector_tile_impl::zstd_decompress(compressed_data.data(), compressed_data.size(), new_data);
+    CHECK(data == new_data);
+}
+
+TEST_CASE("round trip compression - zstd dictionary")
+{
+    // Small tiles that share their keys and values
+    std::vector<std::string> samples;
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::string sample("water" "class" "river" "stream" "canal" "name" "name_en" "osm_id");
+        sample += std::to_string(i * 7919 % 10007);
+        sample += i % 3 == 0 ? "landuse" "residential" : "building" "height";
+        sample += std::to_string(i);
+        samples.push_back(sample);
+    }
+    std::string dictionary;
+    mapnik::vector_tile_impl::zstd_train_dictionary(samples, dictionary, 4096);
+    CHECK(!dictionary.empty());
+    CHECK(dictionary.size() <= 4096);
+    mapnik::vector_tile_impl::zstd_dictionary dict(dictionary);
+    CHECK(dict.id() != 0);
+
+    std::string const& data = samples[42];
+    std::string plain_data;
+    mapnik::vector_tile_impl::zstd_compress(data.data(), data.size(), plain_data);
+    std::string compressed_data;
+    mapnik::vector_tile_impl::zstd_compress(data.data(), data.size(), compressed_data, dict);
+    CHECK(mapnik::vector_tile_impl::is_zstd_compressed(compressed_data));
+    CHECK(compressed_data.size() < plain_data.size());
+
+    std::string new_data;
+    mapnik::vector_tile_impl::zstd_decompress(compressed_data.data(), compressed_data.size(), new_data, dict);
+    CHECK(data == new_data);
+    // The dictionary does not stay with the context of the thread
+    CHECK_THROWS(mapnik::vector_tile_impl::zstd_decompress(compressed_data.data(), compressed_data.size(), new_data));
+    mapnik::vector_tile_impl::zstd_decompress(plain_data.data(), plain_data.size(), new_data);
+    CHECK(data == new_data);
+}
+
+TEST_CASE("zstd dictionary training without samples")
+{
+    std::vector<std::string> samples;
+    std::string dictionary;
+    CHECK_THROWS(mapnik::vector_tile_impl::zstd_train_dictionary(samples, dictionary));
+}
+
+#else
+
+TEST_CASE("zstd compression is not enabled")
+{
+    std::string data("this is a sentence that will be compressed into something");
+    std::string compressed_data;
+    CHECK_THROWS(mapnik::vector_tile_impl::compress(data.data(), data.size(), compressed_data, mapnik::vector_tile_impl::zstd_compression));
+}
+
+#endif
@@ -7,6 +7,9 @@
 // mapnik
 #include <mapnik/util/geometry_to_wkt.hpp>
 
+// protozero
+#include <protozero/pbf_writer.hpp>
+
 // libprotobuf
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -17,6 +20,9 @@
 // Boost
 #include <boost/optional.hpp>
 
+// std
+#include <iterator>
+
 
 TEST_CASE( "cannot create datasource from layer pbf without name" )
 {
@@ -296,3 +302,255 @@ TEST_CASE( "datasource of pbf with unknown version returns a null featureset poi
 
     CHECK(!featureset);
 }
+
+TEST_CASE( "datasource of pbf only puts the attributes requested by the query" )
+{
+    std::string buffer;
+    vector_tile::Tile_Layer layer;
+    layer.set_name("test_name");
+    layer.set_extent(4096);
+    layer.set_version(2);
+    layer.add_keys("name");
+    layer.add_keys("class");
+    layer.add_values()->set_string_value("shared");
+    layer.add_values()->set_int_value(42);
+
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        vector_tile::Tile_Feature * new_feature = layer.add_features();
+        new_feature->set_type(vector_tile::Tile_GeomType_POINT);
+        new_feature->add_geometry(9); // move_to | (1 << 3)
+        new_feature->add_geometry(protozero::encode_zigzag32(5 + i));
+        new_feature->add_geometry(protozero::encode_zigzag32(5));
+        new_feature->add_tags(0);
+        new_feature->add_tags(0);
+        new_feature->add_tags(1);
+        new_feature->add_tags(1);
+    }
+    layer.SerializePartialToString(&buffer);
+    protozero::pbf_reader pbf_layer(buffer);
+
+    mapnik::vector_tile_impl::tile_datasource_pbf ds(pbf_layer,0,0,0);
+
+    mapnik::query q(ds.get_tile_extent());
+    q.add_property_name("name");
+    mapnik::featureset_ptr featureset = ds.features(q);
+    REQUIRE(featureset);
+    unsigned count = 0;
+    mapnik::feature_ptr feature;
+    while ((feature = featureset->next()))
+    {
+        ++count;
+        CHECK(feature->get("name").to_string() == "shared");
+        CHECK_FALSE(feature->has_key("class"));
+    }
+    CHECK(count == 3);
+}
+
+TEST_CASE( "datasource of pbf converts the layer values only for queries with attributes" )
+{
+    std::string buffer;
+    vector_tile::Tile_Layer layer;
+    layer.set_name("test_name");
+    layer.set_extent(4096);
+    layer.set_version(2);
+    layer.add_keys("name");
+    layer.add_values()->set_string_value("shared");
+    vector_tile::Tile_Feature * new_feature = layer.add_features();
+    new_feature->set_type(vector_tile::Tile_GeomType_POINT);
+    new_feature->add_geometry(9); // move_to | (1 << 3)
+    new_feature->add_geometry(protozero::encode_zigzag32(5));
+    new_feature->add_geometry(protozero::encode_zigzag32(5));
+    new_feature->add_tags(0);
+    new_feature->add_tags(0);
+    layer.SerializePartialToString(&buffer);
+    protozero::pbf_reader pbf_layer(buffer);
+
+    mapnik::vector_tile_impl::tile_datasource_pbf ds(pbf_layer,0,0,0);
+
+    mapnik::featureset_ptr featureset = ds.features(mapnik::query(ds.get_tile_extent()));
+    REQUIRE(featureset);
+    mapnik::feature_ptr feature = featureset->next();
+    REQUIRE(feature);
+    CHECK_FALSE(feature->has_key("name"));
+    CHECK_FALSE(ds.has_layer_values());
+
+    mapnik::query q(ds.get_tile_extent());
+    q.add_property_name("name");
+    featureset = ds.features(q);
+    REQUIRE(featureset);
+    CHECK(ds.has_layer_values());
+    feature = featureset->next();
+    REQUIRE(feature);
+    CHECK(feature->get("name").to_string() == "shared");
+}
+
+TEST_CASE( "datasource of pbf rejects malformed tags with and without requested attributes" )
+{
+    auto make_layer = [](std::vector<std::uint32_t> const& tags) {
+        std::string buffer;
+        vector_tile::Tile_Layer layer;
+        layer.set_name("test_name");
+        layer.set_extent(4096);
+        layer.set_version(2);
+        layer.add_keys("name");
+        layer.add_values()->set_string_value("shared");
+        vector_tile::Tile_Feature * new_feature = layer.add_features();
+        new_feature->set_type(vector_tile::Tile_GeomType_POINT);
+        new_feature->add_geometry(9); // move_to | (1 << 3)
+        new_feature->add_geometry(protozero::encode_zigzag32(5));
+        new_feature->add_geometry(protozero::encode_zigzag32(5));
+        for (auto tag : tags)
+        {
+            new_feature->add_tags(tag);
+        }
+        layer.SerializePartialToString(&buffer);
+        return buffer;
+    };
+
+    std::vector<std::vector<std::uint32_t>> malformed = {
+        { 0 },     // odd number of tags
+        { 1, 0 },  // key out of range
+        { 0, 1 }   // value out of range
+    };
+    for (auto const& tags : malformed)
+    {
+        std::string buffer = make_layer(tags);
+        protozero::pbf_reader pbf_layer(buffer);
+        mapnik::vector_tile_impl::tile_datasource_pbf ds(pbf_layer,0,0,0);
+
+        mapnik::featureset_ptr featureset = ds.features(mapnik::query(ds.get_tile_extent()));
+        REQUIRE(featureset);
+        CHECK_THROWS_AS(featureset->next(), std::runtime_error);
+
+        mapnik::query q(ds.get_tile_extent());
+        q.add_property_name("name");
+        featureset = ds.features(q);
+        REQUIRE(featureset);
+        CHECK_THROWS_AS(featureset->next(), std::runtime_error);
+
+        // Also when the feature is outside of the query
+        mapnik::box2d<double> outside(0.0, -20037508.342789, 20037508.342789, 0.0);
+        featureset = ds.features(mapnik::query(outside));
+        REQUIRE(featureset);
+        CHECK_THROWS_AS(featureset->next(), std::runtime_error);
+    }
+}
+
+TEST_CASE( "datasource of pbf drops buffer features outside of a query covering the tile" )
+{
+    std::string buffer;
+    vector_tile::Tile_Layer layer;
+    layer.set_name("test_name");
+    layer.set_extent(4096);
+    layer.set_version(2);
+    // One point inside the tile and one in its buffer
+    std::vector<std::int32_t> coordinates = { 100, -100 };
+    for (auto coordinate : coordinates)
+    {
+        vector_tile::Tile_Feature * new_feature = layer.add_features();
+        new_feature->set_type(vector_tile::Tile_GeomType_POINT);
+        new_feature->add_geometry(9); // move_to | (1 << 3)
+        new_feature->add_geometry(protozero::encode_zigzag32(coordinate));
+        new_feature->add_geometry(protozero::encode_zigzag32(coordinate));
+    }
+    layer.SerializePartialToString(&buffer);
+    protozero::pbf_reader pbf_layer(buffer);
+
+    mapnik::vector_tile_impl::tile_datasource_pbf ds(pbf_layer,0,0,0);
+    mapnik::featureset_ptr featureset = ds.features(mapnik::query(ds.get_tile_extent()));
+    REQUIRE(featureset);
+    mapnik::feature_ptr feature = featureset->next();
+    REQUIRE(feature);
+    CHECK(feature->id() == 0);
+    CHECK_FALSE(featureset->next());
+}
+
+TEST_CASE( "datasource of pbf returns the same features with and without a feature index" )
+{
+    std::string buffer;
+    vector_tile::Tile_Layer layer;
+    layer.set_name("test_name");
+    layer.set_extent(4096);
+    layer.set_version(2);
+
+    // 8 x 8 points spread over the tile
+    for (unsigned i = 0; i < 64; ++i)
+    {
+        vector_tile::Tile_Feature * new_feature = layer.add_features();
+        new_feature->set_type(vector_tile::Tile_GeomType_POINT);
+        new_feature->add_geometry(9); // move_to | (1 << 3)
+        new_feature->add_geometry(protozero::encode_zigzag32(256 + 512 * static_cast<int>(i % 8)));
+        new_feature->add_geometry(protozero::encode_zigzag32(256 + 512 * static_cast<int>(i / 8)));
+    }
+    layer.SerializePartialToString(&buffer);
+    protozero::pbf_reader pbf_layer(buffer);
+
+    mapnik::vector_tile_impl::tile_datasource_pbf ds(pbf_layer,0,0,0);
+    mapnik::vector_tile_impl::tile_datasource_pbf ds_indexed(pbf_layer,0,0,0);
+    ds_indexed.set_use_feature_index(true);
+
+    // Top left quarter of the upper left quarter of the tile
+    mapnik::box2d<double> extent = ds.get_tile_extent();
+    double quarter = extent.width() / 4.0;
+    mapnik::box2d<double> bbox(extent.minx(), extent.maxy() - quarter, extent.minx() + quarter, extent.maxy());
+
+    auto ids = [&](mapnik::vector_tile_impl::tile_datasource_pbf const& source) {
+        std::vector<mapnik::value_integer> result;
+        mapnik::featureset_ptr featureset = source.features(mapnik::query(bbox));
+        REQUIRE(featureset);
+        mapnik::feature_ptr feature;
+        while ((feature = featureset->next()))
+        {
+            result.push_back(feature->id());
+        }
+        return result;
+    };
+
+    std::vector<mapnik::value_integer> expected = { 0, 1, 8, 9 };
+    CHECK(ids(ds) == expected);
+    CHECK(ids(ds_indexed) == expected);
+
+    // Query again to use the index built by the first one
+    CHECK(ids(ds_indexed) == expected);
+
+    mapnik::featureset_ptr at_point = ds_indexed.features_at_point(mapnik::coord2d(bbox.minx() + quarter / 4.0, bbox.maxy() - quarter / 4.0), 1.0);
+    REQUIRE(at_point);
+    mapnik::feature_ptr feature = at_point->next();
+    REQUIRE(feature);
+    CHECK(feature->id() == 0);
+    CHECK_FALSE(at_point->next());
+}
+
+TEST_CASE( "datasource of pbf with a feature index skips invalid v1 geometries" )
+{
+    std::string buffer;
+    protozero::pbf_writer layer_writer(buffer);
+    layer_writer.add_string(1, "test_name");
+    {
+        protozero::pbf_writer feature_writer(layer_writer, 2);
+        feature_writer.add_enum(3, 1); // POINT
+        // move_to | (1 << 3) followed by a truncated varint
+        std::string geometry = { 9, static_cast<char>(0x80) };
+        feature_writer.add_bytes(4, geometry);
+    }
+    {
+        protozero::pbf_writer feature_writer(layer_writer, 2);
+        feature_writer.add_enum(3, 1); // POINT
+        std::uint32_t geometry[] = { 9, protozero::encode_zigzag32(10), protozero::encode_zigzag32(10) };
+        feature_writer.add_packed_uint32(4, std::begin(geometry), std::end(geometry));
+    }
+    layer_writer.add_uint32(5, 4096);
+    layer_writer.add_uint32(15, 1);
+    protozero::pbf_reader pbf_layer(buffer);
+
+    mapnik::vector_tile_impl::tile_datasource_pbf ds(pbf_layer,0,0,0);
+    ds.set_use_feature_index(true);
+    mapnik::featureset_ptr featureset;
+    REQUIRE_NOTHROW(featureset = ds.features(mapnik::query(ds.get_tile_extent())));
+    REQUIRE(featureset);
+    mapnik::feature_ptr feature = featureset->next();
+    REQUIRE(feature);
+    CHECK(feature->id() == 1);
+    CHECK_FALSE(featureset->next());
+}
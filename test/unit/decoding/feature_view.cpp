@@ -0,0 +1,114 @@
+#include "catch.hpp"
+
+// mapnik vector tile
+#include "vector_tile_feature_view.hpp"
+
+// libprotobuf
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#include "vector_tile.pb.h"
+#pragma GCC diagnostic pop
+
+TEST_CASE("feature view exposes ids, tags and geometry without decoding the layer")
+{
+    vector_tile::Tile_Layer layer;
+    layer.set_version(2);
+    layer.set_name("layer");
+    layer.set_extent(4096);
+    layer.add_keys("name");
+    layer.add_keys("rank");
+    layer.add_values()->set_string_value("first");
+    layer.add_values()->set_int_value(-3);
+    layer.add_values()->set_double_value(0.5);
+
+    vector_tile::Tile_Feature * feature = layer.add_features();
+    feature->set_id(7);
+    feature->set_type(vector_tile::Tile_GeomType_POINT);
+    feature->add_geometry(9); // move_to | (1 << 3)
+    feature->add_geometry(protozero::encode_zigzag32(5));
+    feature->add_geometry(protozero::encode_zigzag32(6));
+    feature->add_tags(0);
+    feature->add_tags(0);
+    feature->add_tags(1);
+    feature->add_tags(1);
+
+    vector_tile::Tile_Feature * feature2 = layer.add_features();
+    feature2->set_type(vector_tile::Tile_GeomType_POINT);
+    feature2->add_geometry(9);
+    feature2->add_geometry(protozero::encode_zigzag32(1));
+    feature2->add_geometry(protozero::encode_zigzag32(1));
+    feature2->add_tags(1);
+    feature2->add_tags(2);
+
+    std::string buffer;
+    layer.SerializeToString(&buffer);
+
+    protozero::pbf_reader layer_reader(buffer);
+    mapnik::vector_tile_impl::layer_view view(layer_reader);
+    CHECK(std::string(view.name().data(), view.name().size()) == "layer");
+    CHECK(view.extent() == 4096);
+    CHECK(view.version() == 2);
+    REQUIRE(view.size() == 2);
+
+    mapnik::vector_tile_impl::feature_view f = view.feature(0);
+    CHECK(f.has_id());
+    CHECK(f.id() == 7);
+    CHECK(f.type() == mapnik::vector_tile_impl::Geometry_Type::POINT);
+    REQUIRE(f.has_geometry());
+    CHECK_FALSE(f.has_raster());
+
+    auto const* name = f.get("name");
+    REQUIRE(name);
+    REQUIRE(name->is<protozero::data_view>());
+    protozero::data_view const& name_view = name->get<protozero::data_view>();
+    CHECK(std::string(name_view.data(), name_view.size()) == "first");
+    auto const* rank = f.get("rank");
+    REQUIRE(rank);
+    REQUIRE(rank->is<std::int64_t>());
+    CHECK(rank->get<std::int64_t>() == -3);
+    CHECK(f.get("missing") == nullptr);
+
+    mapnik::vector_tile_impl::GeometryPBF geom = f.geometry();
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+    CHECK(geom.point_next(x, y) == mapnik::vector_tile_impl::GeometryPBF::move_to);
+    CHECK(x == 5);
+    CHECK(y == 6);
+    CHECK(geom.point_next(x, y) == mapnik::vector_tile_impl::GeometryPBF::end);
+
+    std::size_t count = 0;
+    std::size_t tags = 0;
+    for (auto const& feat : view)
+    {
+        ++count;
+        feat.for_each_tag([&](protozero::data_view const&, mapnik::vector_tile_impl::tile_value_view const&) {
+            ++tags;
+        });
+    }
+    CHECK(count == 2);
+    CHECK(tags == 3);
+    CHECK_FALSE(view.feature(1).has_id());
+    REQUIRE(view.feature(1).get("rank"));
+    CHECK(view.feature(1).get("rank")->is<double>());
+}
+
+TEST_CASE("feature view rejects tags missing from a version 2 layer")
+{
+    vector_tile::Tile_Layer layer;
+    layer.set_version(2);
+    layer.set_name("layer");
+    layer.set_extent(4096);
+    layer.add_keys("name");
+    vector_tile::Tile_Feature * feature = layer.add_features();
+    feature->set_type(vector_tile::Tile_GeomType_POINT);
+    feature->add_tags(0);
+    feature->add_tags(3);
+
+    std::string buffer;
+    layer.SerializeToString(&buffer);
+    protozero::pbf_reader layer_reader(buffer);
+    mapnik::vector_tile_impl::layer_view view(layer_reader);
+    REQUIRE(view.size() == 1);
+    CHECK_THROWS_AS(view.feature(0).get("name"), std::runtime_error);
+}
@@ -7,9 +7,17 @@
 #include "decoding_util.hpp"
 #include "geom_to_wkt.hpp"
 
+// protozero
+#include <protozero/exception.hpp>
+
 // mapnik
 #include <mapnik/geometry.hpp>
 
+// std
+#include <string>
+#include <type_traits>
+#include <vector>
+
 // libprotobuf
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -580,3 +588,120 @@ TEST_CASE("decode malicious linestring")
         CHECK_THROWS(mapnik::vector_tile_impl::decode_geometry<double>(geoms, vector_tile::Tile_GeomType_LINESTRING, 2, 0.0, 0.0, 1.0, 1.0));
     }
 }
+
+TEST_CASE("decode linestring unpacked into a reusable buffer")
+{
+    vector_tile::Tile_Feature feature;
+    feature.set_type(vector_tile::Tile_GeomType_LINESTRING);
+    // MoveTo(1,1)
+    feature.add_geometry(9); // move_to | (1 << 3)
+    feature.add_geometry(protozero::encode_zigzag32(1));
+    feature.add_geometry(protozero::encode_zigzag32(1));
+    // Twenty LineTo, enough to go through the whole bulk unpacking path
+    feature.add_geometry((20 << 3u) | 2u);
+    for (int i = 0; i < 20; ++i)
+    {
+        feature.add_geometry(protozero::encode_zigzag32(i % 2 == 0 ? 1 : 1000));
+        feature.add_geometry(protozero::encode_zigzag32(-1));
+    }
+
+    std::string feature_string = feature.SerializeAsString();
+    protozero::pbf_reader feature_pbf(feature_string);
+    REQUIRE(feature_pbf.next(4));
+    protozero::data_view geom_view = feature_pbf.get_view();
+
+    mapnik::vector_tile_impl::GeometryPBF expected_geoms = feature_to_pbf_geometry(feature_string);
+    auto expected = mapnik::vector_tile_impl::decode_geometry<double>(expected_geoms, feature.type(), 2, 0.0, 0.0, 1.0, 1.0);
+    std::string expected_wkt;
+    CHECK( test_utils::to_wkt(expected_wkt, expected) );
+
+    std::vector<std::uint32_t> buffer = { 42 };
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        mapnik::vector_tile_impl::GeometryPBF geoms(geom_view, buffer);
+        auto geom = mapnik::vector_tile_impl::decode_geometry<double>(geoms, feature.type(), 2, 0.0, 0.0, 1.0, 1.0);
+        std::string wkt0;
+        CHECK( test_utils::to_wkt(wkt0, geom) );
+        CHECK( wkt0 == expected_wkt );
+        CHECK( buffer.size() == 44 );
+    }
+}
+
+TEST_CASE("decode linestring straight from the packed field")
+{
+    vector_tile::Tile_Feature feature;
+    feature.set_type(vector_tile::Tile_GeomType_LINESTRING);
+    feature.add_geometry(9); // move_to | (1 << 3)
+    feature.add_geometry(protozero::encode_zigzag32(1));
+    feature.add_geometry(protozero::encode_zigzag32(1));
+    feature.add_geometry((20 << 3u) | 2u);
+    for (int i = 0; i < 20; ++i)
+    {
+        feature.add_geometry(protozero::encode_zigzag32(i % 2 == 0 ? 1 : 1000));
+        feature.add_geometry(protozero::encode_zigzag32(-1));
+    }
+
+    std::string feature_string = feature.SerializeAsString();
+    protozero::pbf_reader feature_pbf(feature_string);
+    REQUIRE(feature_pbf.next(4));
+    protozero::data_view geom_view = feature_pbf.get_view();
+
+    std::vector<std::uint32_t> buffer;
+    mapnik::vector_tile_impl::GeometryPBF buffered_geoms(geom_view, buffer);
+    auto expected = mapnik::vector_tile_impl::decode_geometry<double>(buffered_geoms, feature.type(), 2, 0.0, 0.0, 1.0, 1.0);
+    std::string expected_wkt;
+    CHECK( test_utils::to_wkt(expected_wkt, expected) );
+
+    // The pbf_itr path keeps only iterators into the tile, it owns no memory
+    CHECK( std::is_trivially_copyable<mapnik::vector_tile_impl::GeometryPBF>::value );
+    mapnik::vector_tile_impl::GeometryPBF geoms = feature_to_pbf_geometry(feature_string);
+    auto geom = mapnik::vector_tile_impl::decode_geometry<double>(geoms, feature.type(), 2, 0.0, 0.0, 1.0, 1.0);
+    std::string wkt0;
+    CHECK( test_utils::to_wkt(wkt0, geom) );
+    CHECK( wkt0 == expected_wkt );
+}
+
+TEST_CASE("decode linestring with a truncated command stream from a buffer")
+{
+    vector_tile::Tile_Feature feature;
+    feature.set_type(vector_tile::Tile_GeomType_LINESTRING);
+    feature.add_geometry(9); // move_to | (1 << 3)
+    feature.add_geometry(protozero::encode_zigzag32(1));
+    feature.add_geometry(protozero::encode_zigzag32(1));
+    feature.add_geometry((2 << 3u) | 2u);
+    feature.add_geometry(protozero::encode_zigzag32(1));
+    feature.add_geometry(protozero::encode_zigzag32(1));
+    feature.add_geometry(protozero::encode_zigzag32(2));
+
+    std::string feature_string = feature.SerializeAsString();
+    protozero::pbf_reader feature_pbf(feature_string);
+    REQUIRE(feature_pbf.next(4));
+    std::vector<std::uint32_t> buffer;
+    mapnik::vector_tile_impl::GeometryPBF geoms(feature_pbf.get_view(), buffer);
+    CHECK_THROWS_AS(mapnik::vector_tile_impl::decode_geometry<double>(geoms, feature.type(), 2, 0.0, 0.0, 1.0, 1.0), std::runtime_error);
+    mapnik::vector_tile_impl::GeometryPBF itr_geoms = feature_to_pbf_geometry(feature_string);
+    CHECK_THROWS_AS(mapnik::vector_tile_impl::decode_geometry<double>(itr_geoms, feature.type(), 2, 0.0, 0.0, 1.0, 1.0), std::runtime_error);
+}
+
+TEST_CASE("decode packed geometry with a broken varint")
+{
+    std::vector<std::uint32_t> buffer;
+
+    SECTION("truncated")
+    {
+        // The continuation bit of the last byte is set
+        std::string data = { 9, 2, 2, static_cast<char>(0x80) };
+        CHECK_THROWS_AS(mapnik::vector_tile_impl::decode_packed_uint32(protozero::data_view(data.data(), data.size()), buffer),
+                        protozero::end_of_buffer_exception const&);
+    }
+
+    SECTION("too long")
+    {
+        // Sixteen single byte varints go through the bulk path first
+        std::string data(16, 2);
+        data.append(11, static_cast<char>(0x80));
+        data.push_back(1);
+        CHECK_THROWS_AS(mapnik::vector_tile_impl::decode_packed_uint32(protozero::data_view(data.data(), data.size()), buffer),
+                        protozero::varint_too_long_exception const&);
+    }
+}
@@ -1659,3 +1659,54 @@ TEST_CASE("decode malicious polygon")
         REQUIRE_THROWS(mapnik::vector_tile_impl::decode_geometry<std::int64_t>(geoms, feature.type(), 2, 0.0, 0.0, 1.0, 1.0));
     }
 }
+
+TEST_CASE("bounding box of a multi polygon without decoding it")
+{
+    vector_tile::Tile_Feature feature;
+    feature.set_type(vector_tile::Tile_GeomType_POLYGON);
+    // MoveTo(0,0) LineTo(0,10) LineTo(-10,10) Close
+    feature.add_geometry(9);
+    feature.add_geometry(protozero::encode_zigzag32(0));
+    feature.add_geometry(protozero::encode_zigzag32(0));
+    feature.add_geometry((2 << 3u) | 2u);
+    feature.add_geometry(protozero::encode_zigzag32(0));
+    feature.add_geometry(protozero::encode_zigzag32(10));
+    feature.add_geometry(protozero::encode_zigzag32(-10));
+    feature.add_geometry(protozero::encode_zigzag32(0));
+    feature.add_geometry(15);
+    // MoveTo(20,30) LineTo(25,40) LineTo(20,40) Close
+    feature.add_geometry(9);
+    feature.add_geometry(protozero::encode_zigzag32(30));
+    feature.add_geometry(protozero::encode_zigzag32(20));
+    feature.add_geometry((2 << 3u) | 2u);
+    feature.add_geometry(protozero::encode_zigzag32(5));
+    feature.add_geometry(protozero::encode_zigzag32(10));
+    feature.add_geometry(protozero::encode_zigzag32(-5));
+    feature.add_geometry(protozero::encode_zigzag32(0));
+    feature.add_geometry(15);
+
+    std::string feature_string = feature.SerializeAsString();
+    protozero::pbf_reader feature_pbf(feature_string);
+    REQUIRE(feature_pbf.next(4));
+    auto geom_itr = feature_pbf.get_packed_uint32();
+
+    mapbox::geometry::box<std::int64_t> bbox({0, 0}, {0, 0});
+    std::size_t num_vertices = 0;
+    std::size_t num_parts = 0;
+    REQUIRE(mapnik::vector_tile_impl::decode_geometry_bbox(geom_itr, bbox, num_vertices, num_parts));
+    CHECK(bbox.min.x == -10);
+    CHECK(bbox.min.y == 0);
+    CHECK(bbox.max.x == 25);
+    CHECK(bbox.max.y == 40);
+    CHECK(num_vertices == 6);
+    CHECK(num_parts == 2);
+
+    // A truncated command stream has no bounding box
+    vector_tile::Tile_Feature truncated;
+    truncated.add_geometry(9);
+    truncated.add_geometry(protozero::encode_zigzag32(1));
+    std::string truncated_string = truncated.SerializeAsString();
+    protozero::pbf_reader truncated_pbf(truncated_string);
+    REQUIRE(truncated_pbf.next(4));
+    CHECK_FALSE(mapnik::vector_tile_impl::decode_geometry_bbox(truncated_pbf.get_packed_uint32(), bbox));
+}
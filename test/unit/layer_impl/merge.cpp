@@ -0,0 +1,88 @@
+#include "catch.hpp"
+
+// test utils
+#include "test_utils.hpp"
+
+// mapnik vector tile layer class
+#include "vector_tile_layer.hpp"
+#include "vector_tile_geometry_feature.hpp"
+
+namespace {
+
+mapnik::feature_ptr build_feature(mapnik::context_ptr const& ctx, std::int64_t id)
+{
+    mapnik::feature_ptr feature = testing::build_feature(ctx, id, "name " + std::to_string(id % 5));
+    if (id % 3 == 0)
+    {
+        feature->put("ratio", 0.1 * static_cast<double>(id));
+    }
+    return feature;
+}
+
+void add_point(mapnik::vector_tile_impl::layer_builder_pbf & builder, mapnik::feature_impl const& feature, std::int64_t id)
+{
+    mapnik::vector_tile_impl::geometry_to_feature_pbf_visitor visitor(feature, builder);
+    visitor(mapbox::geometry::point<std::int64_t>(id * 10, id * 20));
+}
+
+} // end anonymous ns
+
+TEST_CASE("Vector tile layer builder merge")
+{
+    mapnik::context_ptr ctx = std::make_shared<mapnik::context_type>();
+    ctx->push("name");
+    ctx->push("id");
+    ctx->push("ratio");
+    std::vector<mapnik::feature_ptr> features;
+    for (std::int64_t i = 1; i <= 20; ++i)
+    {
+        features.push_back(build_feature(ctx, i));
+    }
+
+    std::string expected_buffer;
+    mapnik::vector_tile_impl::layer_builder_pbf expected("layer", 4096, expected_buffer);
+    for (std::size_t i = 0; i < features.size(); ++i)
+    {
+        add_point(expected, *features[i], static_cast<std::int64_t>(i));
+    }
+    REQUIRE_FALSE(expected.empty);
+
+    SECTION("Merging fragments in order writes the same layer as a single builder")
+    {
+        for (std::size_t fragment_size : { 1, 3, 7, 20 })
+        {
+            std::vector<std::string> fragment_buffers((features.size() + fragment_size - 1) / fragment_size);
+            std::string actual_buffer;
+            mapnik::vector_tile_impl::layer_builder_pbf actual("layer", 4096, actual_buffer);
+            for (std::size_t f = 0; f < fragment_buffers.size(); ++f)
+            {
+                mapnik::vector_tile_impl::layer_builder_pbf fragment(fragment_buffers[f]);
+                for (std::size_t i = f * fragment_size; i < std::min(features.size(), (f + 1) * fragment_size); ++i)
+                {
+                    add_point(fragment, *features[i], static_cast<std::int64_t>(i));
+                }
+                actual.merge(fragment);
+            }
+            CHECK(actual_buffer == expected_buffer);
+            CHECK(actual.keys == expected.keys);
+            CHECK(actual.values.size() == expected.values.size());
+            CHECK_FALSE(actual.empty);
+        }
+    }
+
+    SECTION("Merging an encoded layer remaps its tags to the existing keys and values")
+    {
+        std::string actual_buffer;
+        mapnik::vector_tile_impl::layer_builder_pbf actual("layer", 4096, actual_buffer);
+        actual.merge(protozero::data_view(expected_buffer.data(), expected_buffer.size()));
+        CHECK(actual_buffer == expected_buffer);
+
+        // Merging it a second time does not add any new key or value
+        std::size_t num_keys = actual.keys.size();
+        std::size_t num_values = actual.values.size();
+        actual.merge(protozero::data_view(expected_buffer.data(), expected_buffer.size()));
+        CHECK(actual.keys.size() == num_keys);
+        CHECK(actual.values.size() == num_values);
+        CHECK(actual_buffer.size() > expected_buffer.size());
+    }
+}
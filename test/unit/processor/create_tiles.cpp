@@ -0,0 +1,195 @@
+#include "catch.hpp"
+
+// test utils
+#include "test_utils.hpp"
+
+// mapnik
+#include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
+#include <mapnik/memory_datasource.hpp>
+
+// mapnik-vector-tile
+#include "vector_tile_processor.hpp"
+#include "vector_tile_merc_tile.hpp"
+
+// libprotobuf
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#include "vector_tile.pb.h"
+#pragma GCC diagnostic pop
+
+// protozero
+#include <protozero/varint.hpp>
+
+// std
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+std::shared_ptr<mapnik::memory_datasource> build_metatile_ds()
+{
+    return testing::build_features_ds(5, { "name" }, [](mapnik::feature_impl & feature, std::int64_t i) {
+        if (i == 0)
+        {
+            // a line crossing all four z1 tiles
+            testing::put_string(feature, "name", "line");
+            feature.set_geometry(testing::build_line(-10000000.0, 10000000.0, 10000000.0, -10000000.0));
+            return;
+        }
+        // a point in each quadrant
+        testing::put_string(feature, "name", "point");
+        double x = (i - 1) < 2 ? -5000000.0 : 5000000.0;
+        double y = (i - 1) % 2 == 0 ? -5000000.0 : 5000000.0;
+        feature.set_geometry(mapnik::geometry::point<double>(x, y));
+    });
+}
+
+struct command_point
+{
+    std::uint32_t cmd;
+    std::int64_t x;
+    std::int64_t y;
+};
+
+// Commands of an encoded geometry with the absolute position they move to
+std::vector<command_point> decode_commands(vector_tile::Tile_Feature const& feature)
+{
+    std::vector<command_point> result;
+    std::int64_t x = 0;
+    std::int64_t y = 0;
+    int i = 0;
+    while (i < feature.geometry_size())
+    {
+        std::uint32_t cmd_length = feature.geometry(i++);
+        std::uint32_t cmd = cmd_length & 0x7;
+        std::uint32_t length = cmd_length >> 3;
+        if (cmd == 7) // close
+        {
+            result.push_back({ cmd, x, y });
+            continue;
+        }
+        for (std::uint32_t j = 0; j < length && i + 1 < feature.geometry_size(); ++j)
+        {
+            x += protozero::decode_zigzag32(feature.geometry(i++));
+            y += protozero::decode_zigzag32(feature.geometry(i++));
+            result.push_back({ cmd, x, y });
+        }
+    }
+    return result;
+}
+
+} // end anonymous ns
+
+TEST_CASE("feature processor - create_tiles matches create_tile")
+{
+    mapnik::Map map(256, 256, "epsg:3857");
+    mapnik::layer lyr("layer", "epsg:3857");
+    lyr.set_datasource(build_metatile_ds());
+    map.add_layer(lyr);
+    mapnik::vector_tile_impl::processor ren(map);
+
+    std::vector<mapnik::vector_tile_impl::merc_tile> tiles = ren.create_tiles(0, 0, 1, 1, 1, 4096, 64);
+    REQUIRE(tiles.size() == 4);
+
+    std::size_t idx = 0;
+    for (std::uint64_t y = 0; y < 2; ++y)
+    {
+        for (std::uint64_t x = 0; x < 2; ++x)
+        {
+            mapnik::vector_tile_impl::merc_tile const& batch_tile = tiles[idx++];
+            CHECK(batch_tile.x() == x);
+            CHECK(batch_tile.y() == y);
+            CHECK(batch_tile.z() == 1);
+            mapnik::vector_tile_impl::merc_tile single_tile = ren.create_tile(x, y, 1, 4096, 64);
+            CHECK(batch_tile.get_layers() == single_tile.get_layers());
+            CHECK(batch_tile.get_buffer() == single_tile.get_buffer());
+        }
+    }
+}
+
+TEST_CASE("feature processor - create_tiles keeps the first of two layers with the same name")
+{
+    mapnik::Map map(256, 256, "epsg:3857");
+    mapnik::layer lyr("layer", "epsg:3857");
+    lyr.set_datasource(build_metatile_ds());
+    map.add_layer(lyr);
+    mapnik::layer other("layer", "epsg:3857");
+    other.set_datasource(testing::build_features_ds(1, { "name" }, [](mapnik::feature_impl & feature, std::int64_t) {
+        testing::put_string(feature, "name", "other");
+        feature.set_geometry(mapnik::geometry::point<double>(-5000000.0, 5000000.0));
+    }));
+    map.add_layer(other);
+    mapnik::vector_tile_impl::processor ren(map);
+
+    std::vector<mapnik::vector_tile_impl::merc_tile> tiles = ren.create_tiles(0, 0, 1, 1, 1, 4096, 64);
+    REQUIRE(tiles.size() == 4);
+
+    for (auto const& batch_tile : tiles)
+    {
+        CHECK(batch_tile.get_layers().size() == 1);
+        mapnik::vector_tile_impl::merc_tile single_tile = ren.create_tile(batch_tile.x(), batch_tile.y(), 1, 4096, 64);
+        CHECK(batch_tile.get_layers() == single_tile.get_layers());
+        CHECK(batch_tile.get_buffer() == single_tile.get_buffer());
+        vector_tile::Tile result;
+        REQUIRE(result.ParseFromString(batch_tile.get_buffer()));
+        REQUIRE(result.layers_size() == 1);
+        // "line" and "point" from the first layer, never "other"
+        CHECK(result.layers(0).values_size() == 2);
+    }
+}
+
+TEST_CASE("feature processor - create_tiles slicing features gives the same features")
+{
+    mapnik::Map map(256, 256, "epsg:3857");
+    mapnik::layer lyr("layer", "epsg:3857");
+    lyr.set_datasource(build_metatile_ds());
+    map.add_layer(lyr);
+    mapnik::vector_tile_impl::processor ren(map);
+
+    std::vector<mapnik::vector_tile_impl::merc_tile> tiles = ren.create_tiles(0, 0, 1, 1, 1, 4096, 64);
+    CHECK_FALSE(ren.get_slice_features());
+    ren.set_slice_features(true);
+    std::vector<mapnik::vector_tile_impl::merc_tile> sliced_tiles = ren.create_tiles(0, 0, 1, 1, 1, 4096, 64);
+    REQUIRE(sliced_tiles.size() == tiles.size());
+
+    for (std::size_t i = 0; i < tiles.size(); ++i)
+    {
+        CHECK(sliced_tiles[i].x() == tiles[i].x());
+        CHECK(sliced_tiles[i].y() == tiles[i].y());
+        CHECK(sliced_tiles[i].get_layers() == tiles[i].get_layers());
+        vector_tile::Tile expected;
+        vector_tile::Tile result;
+        REQUIRE(expected.ParseFromString(tiles[i].get_buffer()));
+        REQUIRE(result.ParseFromString(sliced_tiles[i].get_buffer()));
+        REQUIRE(result.layers_size() == expected.layers_size());
+        for (int j = 0; j < expected.layers_size(); ++j)
+        {
+            REQUIRE(result.layers(j).features_size() == expected.layers(j).features_size());
+            for (int k = 0; k < expected.layers(j).features_size(); ++k)
+            {
+                CHECK(result.layers(j).features(k).id() == expected.layers(j).features(k).id());
+                CHECK(result.layers(j).features(k).type() == expected.layers(j).features(k).type());
+                // Cutting at the edges of the tiles may round differently from
+                // clipping to each tile, by at most one unit
+                std::vector<command_point> expected_commands = decode_commands(expected.layers(j).features(k));
+                std::vector<command_point> result_commands = decode_commands(result.layers(j).features(k));
+                REQUIRE(result_commands.size() == expected_commands.size());
+                for (std::size_t c = 0; c < expected_commands.size(); ++c)
+                {
+                    CHECK(result_commands[c].cmd == expected_commands[c].cmd);
+                    CHECK(std::abs(result_commands[c].x - expected_commands[c].x) <= 1);
+                    CHECK(std::abs(result_commands[c].y - expected_commands[c].y) <= 1);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("feature processor - create_tiles rejects an invalid range")
+{
+    mapnik::Map map(256, 256, "epsg:3857");
+    mapnik::vector_tile_impl::processor ren(map);
+    CHECK_THROWS(ren.create_tiles(1, 0, 0, 0, 1));
+}
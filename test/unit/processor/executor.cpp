@@ -0,0 +1,105 @@
+#include "catch.hpp"
+
+// test utils
+#include "test_utils.hpp"
+
+// mapnik
+#include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
+#include <mapnik/memory_datasource.hpp>
+
+// mapnik-vector-tile
+#include "vector_tile_executor.hpp"
+#include "vector_tile_processor.hpp"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <thread>
+
+namespace {
+
+std::shared_ptr<mapnik::memory_datasource> build_many_features_ds()
+{
+    return testing::build_features_ds(500, { "name", "rank", "even" }, [](mapnik::feature_impl & feature, std::int64_t i) {
+        testing::put_string(feature, "name", "feature " + std::to_string(i % 37));
+        feature.put("rank", static_cast<mapnik::value_integer>(i % 11));
+        if (i % 2 == 0)
+        {
+            feature.put("even", true);
+        }
+        double x = -15000000.0 + 60000.0 * static_cast<double>(i);
+        double y = 10000000.0 - 40000.0 * static_cast<double>(i);
+        if (i % 3 == 0)
+        {
+            feature.set_geometry(mapnik::geometry::point<double>(x, y));
+        }
+        else
+        {
+            feature.set_geometry(testing::build_line(x, y, x + 500000.0, y - 250000.0));
+        }
+    });
+}
+
+} // end anonymous ns
+
+TEST_CASE("feature processor - executor encodes the same tile as the serial processor")
+{
+    mapnik::Map map(256, 256, "epsg:3857");
+    mapnik::layer lyr("layer", "epsg:3857");
+    lyr.set_datasource(build_many_features_ds());
+    map.add_layer(lyr);
+    mapnik::layer lyr2("layer2", "epsg:3857");
+    lyr2.set_datasource(build_many_features_ds());
+    map.add_layer(lyr2);
+
+    mapnik::vector_tile_impl::processor serial(map);
+    mapnik::vector_tile_impl::merc_tile expected = serial.create_tile(0, 0, 0, 4096, 64);
+    REQUIRE(expected.get_layers().size() == 2);
+
+    auto exec = std::make_shared<mapnik::vector_tile_impl::work_stealing_executor>(4);
+    for (std::size_t chunk_size : { 0, 1, 7, 64, 1024 })
+    {
+        mapnik::vector_tile_impl::processor ren(map);
+        ren.set_executor(exec);
+        ren.set_feature_chunk_size(chunk_size);
+        mapnik::vector_tile_impl::merc_tile actual = ren.create_tile(0, 0, 0, 4096, 64);
+        CHECK(actual.get_layers() == expected.get_layers());
+        CHECK(actual.get_buffer() == expected.get_buffer());
+    }
+}
+
+TEST_CASE("feature processor - task group rethrows task exceptions")
+{
+    mapnik::vector_tile_impl::work_stealing_executor exec(2);
+    mapnik::vector_tile_impl::task_group group(exec);
+    std::atomic<int> count(0);
+    for (int i = 0; i < 10; ++i)
+    {
+        group.run([&count]() { ++count; });
+    }
+    group.run([]() { throw std::runtime_error("task failed"); });
+    CHECK_THROWS_AS(group.wait(), std::runtime_error);
+    CHECK(count == 10);
+}
+
+TEST_CASE("feature processor - task group sleeps while its tasks run elsewhere")
+{
+    mapnik::vector_tile_impl::work_stealing_executor exec(1);
+    mapnik::vector_tile_impl::task_group group(exec);
+    std::atomic<bool> started(false);
+    group.run([&started]() {
+        started = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    });
+    while (!started)
+    {
+        std::this_thread::yield();
+    }
+    // Spinning until the task is done would use about as much cpu as it sleeps
+    std::clock_t start = std::clock();
+    group.wait();
+    std::clock_t used = std::clock() - start;
+    CHECK(used < CLOCKS_PER_SEC / 10);
+}
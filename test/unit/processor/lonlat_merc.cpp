@@ -0,0 +1,47 @@
+#include "catch.hpp"
+
+// mapnik-vector-tile
+#include "vector_tile_map_plan.hpp"
+#include "vector_tile_projection.hpp"
+#include "vector_tile_strategy.hpp"
+
+// mapnik
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/view_transform.hpp>
+
+// std
+#include <cstdlib>
+
+TEST_CASE("lonlat to mercator strategy matches the proj strategy")
+{
+    std::string merc = "+init=epsg:3857";
+    std::string lonlat = "+init=epsg:4326";
+    mapnik::vector_tile_impl::layer_projections projections(merc, lonlat);
+    REQUIRE(projections.lonlat_to_merc);
+    CHECK_FALSE(mapnik::vector_tile_impl::layer_projections(merc, merc).lonlat_to_merc);
+    CHECK_FALSE(mapnik::vector_tile_impl::layer_projections(lonlat, merc).lonlat_to_merc);
+
+    for (unsigned z : {0u, 5u, 12u})
+    {
+        std::uint64_t x = (1u << z) / 3;
+        std::uint64_t y = (1u << z) / 2;
+        mapnik::box2d<double> extent = mapnik::vector_tile_impl::tile_mercator_bbox(x, y, z);
+        mapnik::view_transform tr(4096, 4096, extent, 0.0, 0.0);
+        mapnik::vector_tile_impl::vector_tile_strategy_proj proj_strategy(projections.transform, tr);
+        mapnik::vector_tile_impl::vector_tile_strategy_lonlat_merc closed_form(tr);
+
+        for (double lon = -180.0; lon <= 180.0; lon += 7.5)
+        {
+            for (double lat = -89.0; lat <= 89.0; lat += 4.5)
+            {
+                mapnik::geometry::point<double> pt(lon, lat);
+                mapbox::geometry::point<std::int64_t> expected;
+                mapbox::geometry::point<std::int64_t> result;
+                REQUIRE(proj_strategy.apply(pt, expected));
+                REQUIRE(closed_form.apply(pt, result));
+                CHECK(std::llabs(expected.x - result.x) <= 1);
+                CHECK(std::llabs(expected.y - result.y) <= 1);
+            }
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#include "catch.hpp"
+
+// test utils
+#include "test_utils.hpp"
+
+// mapnik
+#include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
+#include <mapnik/memory_datasource.hpp>
+
+// mapnik-vector-tile
+#include "vector_tile_processor.hpp"
+#include "vector_tile_merc_tile.hpp"
+
+namespace {
+
+std::shared_ptr<mapnik::memory_datasource> build_ds()
+{
+    return testing::build_features_ds(1, { "name" }, [](mapnik::feature_impl & feature, std::int64_t) {
+        testing::put_string(feature, "name", "line");
+        feature.set_geometry(testing::build_line(-100.0, 50.0, 100.0, -50.0));
+    });
+}
+
+} // end anonymous ns
+
+TEST_CASE("feature processor - compiled plan encodes the same tiles")
+{
+    mapnik::Map map(256, 256, "epsg:3857");
+    mapnik::layer merc_layer("merc", "epsg:3857");
+    merc_layer.set_datasource(build_ds());
+    map.add_layer(merc_layer);
+    mapnik::layer wgs84_layer("wgs84", "epsg:4326");
+    wgs84_layer.set_datasource(build_ds());
+    map.add_layer(wgs84_layer);
+
+    mapnik::vector_tile_impl::processor ren(map);
+    mapnik::vector_tile_impl::merc_tile expected = ren.create_tile(0, 0, 0, 4096, 64);
+    CHECK(expected.get_layers().size() == 2);
+
+    ren.compile();
+    REQUIRE(ren.get_plan());
+    CHECK(ren.get_plan()->size() == 2);
+    CHECK(ren.get_plan()->layer(0).property_names() == std::vector<std::string>{ "name" });
+    mapnik::vector_tile_impl::merc_tile planned = ren.create_tile(0, 0, 0, 4096, 64);
+    CHECK(planned.get_layers() == expected.get_layers());
+    CHECK(planned.get_buffer() == expected.get_buffer());
+
+    // A plan can be shared by another processor of the same map
+    mapnik::vector_tile_impl::processor other(map);
+    other.set_plan(ren.get_plan());
+    mapnik::vector_tile_impl::merc_tile shared = other.create_tile(0, 0, 0, 4096, 64);
+    CHECK(shared.get_buffer() == expected.get_buffer());
+}
+
+TEST_CASE("feature processor - plan must match the layers of the map")
+{
+    mapnik::Map map(256, 256, "epsg:3857");
+    mapnik::vector_tile_impl::processor ren(map);
+    ren.compile();
+    mapnik::layer lyr("layer", "epsg:3857");
+    lyr.set_datasource(build_ds());
+    map.add_layer(lyr);
+    CHECK_THROWS_AS(ren.create_tile(0, 0, 0), std::runtime_error);
+}
+
+TEST_CASE("feature processor - plan must match the name, srs and datasource of each layer")
+{
+    mapnik::Map map(256, 256, "epsg:3857");
+    mapnik::layer lyr("layer", "epsg:3857");
+    lyr.set_datasource(build_ds());
+    map.add_layer(lyr);
+    mapnik::vector_tile_impl::processor ren(map);
+    ren.compile();
+    REQUIRE(ren.get_plan());
+    CHECK(ren.get_plan()->layer(0).name() == "layer");
+    CHECK(ren.get_plan()->layer(0).srs() == "epsg:3857");
+
+    SECTION("renamed layer")
+    {
+        map.get_layer(0).set_name("other");
+        CHECK_THROWS_AS(ren.create_tile(0, 0, 0), std::runtime_error);
+    }
+
+    SECTION("reprojected layer")
+    {
+        map.get_layer(0).set_srs("epsg:4326");
+        CHECK_THROWS_AS(ren.create_tile(0, 0, 0), std::runtime_error);
+    }
+
+    SECTION("reprojected map")
+    {
+        map.set_srs("epsg:4326");
+        CHECK_THROWS_AS(ren.create_tile(0, 0, 0), std::runtime_error);
+    }
+
+    SECTION("replaced datasource")
+    {
+        map.get_layer(0).set_datasource(build_ds());
+        CHECK_THROWS_AS(ren.create_tile(0, 0, 0), std::runtime_error);
+    }
+}
@@ -0,0 +1,176 @@
+#include "catch.hpp"
+
+// mapnik-vector-tile
+#include "vector_tile_processor.hpp"
+#include "vector_tile_reprojection_grid.hpp"
+#include "vector_tile_strategy.hpp"
+
+// mapnik
+#include <mapnik/datasource_cache.hpp>
+#include <mapnik/geometry/box2d.hpp>
+#include <mapnik/projection.hpp>
+#include <mapnik/proj_transform.hpp>
+#include <mapnik/view_transform.hpp>
+
+// protozero
+#include <protozero/varint.hpp>
+
+// std
+#include <cstdlib>
+#include <vector>
+
+// libprotobuf
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#include "vector_tile.pb.h"
+#pragma GCC diagnostic pop
+
+namespace {
+
+std::string const nzmg = "+proj=nzmg +lat_0=-41 +lon_0=173 +x_0=2510000 +y_0=6023150 +ellps=intl +units=m +no_defs";
+
+// Every vertex of every feature of the only layer of a tile
+std::vector<std::vector<mapbox::geometry::point<std::int64_t> > > feature_vertices(vector_tile::Tile const& tile)
+{
+    std::vector<std::vector<mapbox::geometry::point<std::int64_t> > > result;
+    for (auto const& feature : tile.layers(0).features())
+    {
+        result.emplace_back();
+        std::int64_t x = 0;
+        std::int64_t y = 0;
+        int i = 0;
+        while (i < feature.geometry_size())
+        {
+            std::uint32_t cmd_length = feature.geometry(i++);
+            if ((cmd_length & 0x7) == 7) // close
+            {
+                continue;
+            }
+            for (std::uint32_t j = 0; j < (cmd_length >> 3) && i + 1 < feature.geometry_size(); ++j)
+            {
+                x += protozero::decode_zigzag32(feature.geometry(i++));
+                y += protozero::decode_zigzag32(feature.geometry(i++));
+                result.back().emplace_back(x, y);
+            }
+        }
+    }
+    return result;
+}
+
+// True when every point of a is within tolerance of a point of b
+bool close_to(std::vector<mapbox::geometry::point<std::int64_t> > const& a,
+              std::vector<mapbox::geometry::point<std::int64_t> > const& b,
+              std::int64_t tolerance)
+{
+    for (auto const& pa : a)
+    {
+        bool found = false;
+        for (auto const& pb : b)
+        {
+            if (std::llabs(pa.x - pb.x) <= tolerance && std::llabs(pa.y - pb.y) <= tolerance)
+            {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+TEST_CASE("reprojection grid stays within its error of the exact transform")
+{
+    mapnik::projection merc("epsg:3857");
+    mapnik::projection source(nzmg);
+    mapnik::proj_transform prj_trans(merc, source);
+
+    mapnik::box2d<double> source_extent(2400000, 5900000, 2700000, 6200000);
+    mapnik::box2d<double> target_extent(source_extent);
+    REQUIRE(prj_trans.backward(target_extent, 20));
+    mapnik::view_transform tr(4096, 4096, target_extent, 0.0, 0.0);
+
+    mapnik::vector_tile_impl::reprojection_grid grid(prj_trans, tr, source_extent, 0.25);
+    CHECK_FALSE(grid.built());
+    REQUIRE(grid.valid());
+    CHECK(grid.built());
+    CHECK(grid.cells() <= mapnik::vector_tile_impl::reprojection_grid::max_cells);
+
+    mapnik::vector_tile_impl::vector_tile_strategy_proj exact(prj_trans, tr);
+    mapnik::vector_tile_impl::vector_tile_strategy_proj approx(prj_trans, tr, &grid);
+    for (double x = source_extent.minx(); x <= source_extent.maxx(); x += 7001.0)
+    {
+        for (double y = source_extent.miny(); y <= source_extent.maxy(); y += 6997.0)
+        {
+            mapnik::geometry::point<double> pt(x, y);
+            mapbox::geometry::point<std::int64_t> expected;
+            mapbox::geometry::point<std::int64_t> result;
+            REQUIRE(exact.apply(pt, expected));
+            REQUIRE(approx.apply(pt, result));
+            CHECK(std::llabs(expected.x - result.x) <= 1);
+            CHECK(std::llabs(expected.y - result.y) <= 1);
+        }
+    }
+
+    // Points outside of the grid are reprojected exactly
+    mapnik::geometry::point<double> outside(source_extent.maxx() + 1000.0, source_extent.maxy() + 1000.0);
+    mapbox::geometry::point<std::int64_t> expected;
+    mapbox::geometry::point<std::int64_t> result;
+    REQUIRE(exact.apply(outside, expected));
+    REQUIRE(approx.apply(outside, result));
+    CHECK(expected == result);
+
+    // No error allowed, no grid
+    CHECK_FALSE(mapnik::vector_tile_impl::reprojection_grid(prj_trans, tr, source_extent, 0.0).valid());
+
+    // The grid is built by the first point that goes through it
+    mapnik::vector_tile_impl::reprojection_grid lazy_grid(prj_trans, tr, source_extent, 0.25);
+    mapnik::vector_tile_impl::vector_tile_strategy_proj lazy(prj_trans, tr, &lazy_grid);
+    CHECK_FALSE(lazy_grid.built());
+    mapnik::geometry::point<double> inside(source_extent.minx() + 1000.0, source_extent.miny() + 1000.0);
+    REQUIRE(lazy.apply(inside, result));
+    CHECK(lazy_grid.built());
+    CHECK(lazy_grid.valid());
+}
+
+TEST_CASE("processor encodes the same features with an approximate reprojection")
+{
+    mapnik::Map map(256, 256, "epsg:3857");
+    mapnik::layer lyr("layer", nzmg);
+    mapnik::parameters params;
+    params["type"] = "shape";
+    params["file"] = "./test/data/NZ_Coastline_NZMG.shp";
+    lyr.set_datasource(mapnik::datasource_cache::instance().create(params));
+    map.add_layer(lyr);
+
+    mapnik::vector_tile_impl::processor ren(map);
+    CHECK(ren.get_reprojection_error() == 0.0);
+    mapnik::vector_tile_impl::tile exact_tile = ren.create_tile(0, 0, 0, 4096);
+    ren.set_reprojection_error(0.25);
+    mapnik::vector_tile_impl::tile approx_tile = ren.create_tile(0, 0, 0, 4096);
+
+    vector_tile::Tile exact;
+    vector_tile::Tile approx;
+    REQUIRE(exact.ParseFromString(exact_tile.get_buffer()));
+    REQUIRE(approx.ParseFromString(approx_tile.get_buffer()));
+    REQUIRE(exact.layers_size() == 1);
+    REQUIRE(approx.layers_size() == 1);
+    CHECK(exact.layers(0).features_size() == approx.layers(0).features_size());
+
+    // Vertices move by at most the error of the grid, which can round them to
+    // the next unit. Vertices that collapse into their neighbour are dropped,
+    // so each vertex is matched with any vertex of the other feature.
+    auto exact_vertices = feature_vertices(exact);
+    auto approx_vertices = feature_vertices(approx);
+    REQUIRE(exact_vertices.size() == approx_vertices.size());
+    for (std::size_t i = 0; i < exact_vertices.size(); ++i)
+    {
+        CHECK(close_to(approx_vertices[i], exact_vertices[i], 1));
+        CHECK(close_to(exact_vertices[i], approx_vertices[i], 1));
+    }
+}
@@ -0,0 +1,289 @@
+#include "catch.hpp"
+
+// test utils
+#include "test_utils.hpp"
+
+// mapnik
+#include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
+#include <mapnik/memory_datasource.hpp>
+
+// mapnik-vector-tile
+#include "vector_tile_executor.hpp"
+#include "vector_tile_processor.hpp"
+#include "vector_tile_tile_sink.hpp"
+
+// std
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::shared_ptr<mapnik::memory_datasource> build_ds(std::int64_t count)
+{
+    return testing::build_features_ds(count, { "name" }, [](mapnik::feature_impl & feature, std::int64_t i) {
+        testing::put_string(feature, "name", "feature " + std::to_string(i));
+        double x = -15000000.0 + 300000.0 * static_cast<double>(i);
+        feature.set_geometry(testing::build_line(x, 10000000.0, x + 500000.0, -10000000.0));
+    });
+}
+
+mapnik::Map build_map()
+{
+    mapnik::Map map(256, 256, "epsg:3857");
+    // The first layer is the slowest, an empty one sits in the middle
+    for (auto const& def : { std::make_pair("slow", 100), std::make_pair("empty", 0), std::make_pair("fast", 2) })
+    {
+        mapnik::layer lyr(def.first, "epsg:3857");
+        lyr.set_datasource(build_ds(def.second));
+        map.add_layer(lyr);
+    }
+    return map;
+}
+
+class recording_sink : public mapnik::vector_tile_impl::tile_sink
+{
+public:
+    std::vector<std::string> names;
+    std::size_t finished = 0;
+
+    void add_layer(mapnik::vector_tile_impl::tile_layer & layer) override
+    {
+        CHECK(finished == 0);
+        names.push_back(layer.name());
+    }
+
+    void finish() override
+    {
+        ++finished;
+    }
+};
+
+// Runs every task on its own thread and never on the waiting one, so a
+// task that blocks can not hold up the thread giving layers to the sink.
+class thread_per_task_executor : public mapnik::vector_tile_impl::executor
+{
+    std::mutex mutex_;
+    std::vector<std::thread> threads_;
+
+public:
+    ~thread_per_task_executor()
+    {
+        for (auto & t : threads_)
+        {
+            t.join();
+        }
+    }
+
+    void submit(task_type task) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.emplace_back(std::move(task));
+    }
+
+    bool try_run_one() override
+    {
+        return false;
+    }
+};
+
+// Features are only returned once the gate is opened, or after a timeout
+class gated_datasource : public mapnik::memory_datasource
+{
+    std::shared_future<void> gate_;
+    std::atomic<bool> & timed_out_;
+
+public:
+    gated_datasource(std::shared_future<void> gate, std::atomic<bool> & timed_out)
+        : mapnik::memory_datasource(mapnik::parameters()),
+          gate_(gate),
+          timed_out_(timed_out) {}
+
+    mapnik::featureset_ptr features(mapnik::query const& q) const override
+    {
+        if (gate_.wait_for(std::chrono::seconds(5)) == std::future_status::timeout)
+        {
+            timed_out_ = true;
+        }
+        return mapnik::memory_datasource::features(q);
+    }
+};
+
+// Fails as soon as the processor asks for its features
+class throwing_datasource : public mapnik::memory_datasource
+{
+public:
+    throwing_datasource()
+        : mapnik::memory_datasource(mapnik::parameters()) {}
+
+    mapnik::featureset_ptr features(mapnik::query const&) const override
+    {
+        throw std::runtime_error("throwing_datasource");
+    }
+};
+
+} // end anonymous ns
+
+TEST_CASE("feature processor - gather sink holds the layers of update_tile")
+{
+    mapnik::Map map = build_map();
+    mapnik::vector_tile_impl::processor ren(map);
+    mapnik::vector_tile_impl::merc_tile expected = ren.create_tile(0, 0, 0);
+
+    mapnik::vector_tile_impl::gather_tile_sink sink;
+    ren.update_tile(sink, expected.extent(), expected.tile_size(), expected.buffer_size());
+
+    CHECK(sink.get_layers() == expected.get_layers());
+    CHECK(sink.get_empty_layers() == expected.get_empty_layers());
+    CHECK(sink.get_painted_layers() == expected.get_painted_layers());
+    CHECK(sink.size() == expected.size());
+
+    std::string gathered;
+    for (auto const& buffer : sink.get_buffers())
+    {
+        gathered.append(buffer.data(), buffer.size());
+    }
+    CHECK(gathered == expected.get_buffer());
+    std::string appended;
+    sink.append_to_string(appended);
+    CHECK(appended == expected.get_buffer());
+
+    // Layers the sink already has are skipped
+    mapnik::vector_tile_impl::tile_builder_sink builder(expected);
+    CHECK(builder.has_layer("slow"));
+    CHECK(!builder.has_layer("empty"));
+}
+
+TEST_CASE("feature processor - sink receives layers in the order of the map")
+{
+    mapnik::Map map = build_map();
+    mapnik::vector_tile_impl::processor ren(map);
+    mapnik::box2d<double> extent(-20037508.342789,-20037508.342789,20037508.342789,20037508.342789);
+    std::vector<std::string> expected = { "slow", "empty", "fast" };
+
+    SECTION("deferred")
+    {
+        recording_sink sink;
+        ren.update_tile(sink, extent);
+        CHECK(sink.names == expected);
+        CHECK(sink.finished == 1);
+    }
+
+    SECTION("async")
+    {
+        ren.set_threading_mode(std::launch::async);
+        recording_sink sink;
+        ren.update_tile(sink, extent);
+        CHECK(sink.names == expected);
+        CHECK(sink.finished == 1);
+    }
+
+    SECTION("executor")
+    {
+        ren.set_executor(std::make_shared<mapnik::vector_tile_impl::work_stealing_executor>(3));
+        ren.set_feature_chunk_size(8);
+        recording_sink sink;
+        ren.update_tile(sink, extent);
+        CHECK(sink.names == expected);
+        CHECK(sink.finished == 1);
+
+        mapnik::vector_tile_impl::gather_tile_sink gather;
+        ren.update_tile(gather, extent);
+        mapnik::vector_tile_impl::tile t(extent);
+        ren.update_tile(t);
+        std::string gathered;
+        gather.append_to_string(gathered);
+        CHECK(gathered == t.get_buffer());
+    }
+}
+
+TEST_CASE("feature processor - sink receives a layer before a later one is encoded")
+{
+    std::promise<void> gate;
+    std::atomic<bool> timed_out(false);
+    auto gated = std::make_shared<gated_datasource>(gate.get_future().share(), timed_out);
+    auto line_ds = build_ds(2);
+    mapnik::featureset_ptr features = line_ds->features(mapnik::query(line_ds->envelope()));
+    mapnik::feature_ptr feature;
+    while ((feature = features->next()))
+    {
+        gated->push(feature);
+    }
+
+    mapnik::Map map(256, 256, "epsg:3857");
+    mapnik::layer first("first", "epsg:3857");
+    first.set_datasource(build_ds(2));
+    map.add_layer(first);
+    mapnik::layer second("gated", "epsg:3857");
+    second.set_datasource(gated);
+    map.add_layer(second);
+
+    // The gated layer can only finish once the first one reached the sink
+    class opening_sink : public recording_sink
+    {
+        std::promise<void> & gate_;
+
+    public:
+        explicit opening_sink(std::promise<void> & gate)
+            : gate_(gate) {}
+
+        void add_layer(mapnik::vector_tile_impl::tile_layer & layer) override
+        {
+            recording_sink::add_layer(layer);
+            if (layer.name() == "first")
+            {
+                gate_.set_value();
+            }
+        }
+    };
+
+    mapnik::vector_tile_impl::processor ren(map);
+    ren.set_executor(std::make_shared<thread_per_task_executor>());
+    mapnik::box2d<double> extent(-20037508.342789,-20037508.342789,20037508.342789,20037508.342789);
+    opening_sink sink(gate);
+    ren.update_tile(sink, extent);
+    CHECK_FALSE(timed_out);
+    CHECK(sink.names == std::vector<std::string>({ "first", "gated" }));
+    CHECK(sink.finished == 1);
+}
+
+TEST_CASE("feature processor - a failing layer leaves the tile untouched")
+{
+    mapnik::Map map(256, 256, "epsg:3857");
+    mapnik::layer good("good", "epsg:3857");
+    good.set_datasource(build_ds(2));
+    map.add_layer(good);
+    mapnik::layer bad("bad", "epsg:3857");
+    bad.set_datasource(std::make_shared<throwing_datasource>());
+    map.add_layer(bad);
+
+    mapnik::vector_tile_impl::processor ren(map);
+    mapnik::box2d<double> extent(-20037508.342789,-20037508.342789,20037508.342789,20037508.342789);
+
+    SECTION("deferred")
+    {
+    }
+
+    SECTION("async")
+    {
+        ren.set_threading_mode(std::launch::async);
+    }
+
+    SECTION("executor")
+    {
+        ren.set_executor(std::make_shared<mapnik::vector_tile_impl::work_stealing_executor>(3));
+    }
+
+    mapnik::vector_tile_impl::tile t(extent);
+    CHECK_THROWS(ren.update_tile(t));
+    CHECK(t.get_layers().empty());
+    CHECK(t.get_empty_layers().empty());
+    CHECK(t.size() == 0);
+    CHECK(t.get_buffer().empty());
+}
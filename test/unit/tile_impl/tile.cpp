@@ -351,6 +351,85 @@ TEST_CASE("Vector tile base class")
         CHECK(tile2.same_extent(tile1) == true);
     }
 
+    SECTION("layers are found without walking the tile")
+    {
+        mapnik::vector_tile_impl::tile tile(global_extent);
+        std::vector<std::string> layer_buffers;
+        for (int i = 0; i < 20; ++i)
+        {
+            vector_tile::Tile_Layer layer;
+            layer.set_version(2);
+            layer.set_name("layer" + std::to_string(i));
+            layer.set_extent(4096);
+            std::string layer_buffer;
+            layer.SerializePartialToString(&layer_buffer);
+            tile.append_layer_buffer(layer_buffer.data(), layer_buffer.length(), layer.name());
+            layer_buffers.push_back(layer_buffer);
+        }
+
+        // Views stay right as the buffer of the tile grows
+        for (std::size_t i = 0; i < layer_buffers.size(); ++i)
+        {
+            protozero::data_view by_index;
+            REQUIRE(tile.layer_view(i, by_index));
+            CHECK(std::string(by_index.data(), by_index.size()) == layer_buffers[i]);
+            CHECK(by_index.data() >= tile.data());
+            CHECK(by_index.data() + by_index.size() <= tile.data() + tile.size());
+
+            protozero::data_view by_name;
+            REQUIRE(tile.layer_view("layer" + std::to_string(i), by_name));
+            CHECK(by_name.data() == by_index.data());
+            CHECK(by_name.size() == by_index.size());
+        }
+
+        protozero::pbf_reader layer_reader;
+        REQUIRE(tile.layer_reader("layer7", layer_reader));
+        CHECK(layer_reader.next(1) == true);
+        CHECK(layer_reader.get_string() == "layer7");
+
+        protozero::data_view missing;
+        CHECK(tile.layer_view("layer20", missing) == false);
+        CHECK(tile.layer_view(20, missing) == false);
+        CHECK(tile.layer_reader(20, layer_reader) == false);
+
+        tile.clear();
+        CHECK(tile.layer_view(0, missing) == false);
+        CHECK(tile.layer_view("layer0", missing) == false);
+    }
+
+    SECTION("corrupt layers are reported when a lookup reaches them")
+    {
+        mapnik::vector_tile_impl::tile tile(global_extent);
+        std::vector<std::string> names = { "first", "bogus", "last" };
+        for (auto const& name : names)
+        {
+            std::string layer_buffer;
+            if (name == "bogus")
+            {
+                layer_buffer = "blahblah";
+            }
+            else
+            {
+                vector_tile::Tile_Layer layer;
+                layer.set_version(2);
+                layer.set_name(name);
+                layer.set_extent(4096);
+                layer.SerializePartialToString(&layer_buffer);
+            }
+            tile.append_layer_buffer(layer_buffer.data(), layer_buffer.length(), name);
+        }
+
+        protozero::pbf_reader layer_reader;
+        CHECK(tile.layer_reader("first", layer_reader) == true);
+        CHECK_THROWS_AS(tile.layer_reader("last", layer_reader), protozero::end_of_buffer_exception const&);
+        CHECK_THROWS_AS(tile.layer_reader("missing", layer_reader), protozero::end_of_buffer_exception const&);
+
+        protozero::pbf_reader layer_reader_by_index;
+        REQUIRE(tile.layer_reader(1, layer_reader_by_index) == true);
+        CHECK_THROWS_AS(layer_reader_by_index.next(1), protozero::end_of_buffer_exception const&);
+        CHECK(tile.layer_reader(2, layer_reader_by_index) == true);
+    }
+
     SECTION("releasing buffer works")
     {
         // Newly added layers from buffers are added to the end of
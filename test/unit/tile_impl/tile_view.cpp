@@ -0,0 +1,108 @@
+#include "catch.hpp"
+
+// mapnik vector tile
+#include "vector_tile_tile_view.hpp"
+#include "vector_tile_datasource_pbf.hpp"
+
+// mapnik
+#include <mapnik/util/geometry_to_wkt.hpp>
+
+// libprotobuf
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#include "vector_tile.pb.h"
+#pragma GCC diagnostic pop
+
+// std
+#include <memory>
+#include <string>
+
+namespace {
+
+std::shared_ptr<const std::string> build_tile_buffer()
+{
+    vector_tile::Tile tile;
+    for (auto const& name : { "water", "roads" })
+    {
+        vector_tile::Tile_Layer * layer = tile.add_layers();
+        layer->set_name(name);
+        layer->set_version(2);
+        layer->set_extent(4096);
+        vector_tile::Tile_Feature * new_feature = layer->add_features();
+        new_feature->set_type(vector_tile::Tile_GeomType_POINT);
+        // MoveTo(5,5)
+        new_feature->add_geometry(9); // move_to | (1 << 3)
+        new_feature->add_geometry(protozero::encode_zigzag32(5));
+        new_feature->add_geometry(protozero::encode_zigzag32(5));
+    }
+    auto buffer = std::make_shared<std::string>();
+    tile.SerializeToString(buffer.get());
+    return buffer;
+}
+
+}
+
+TEST_CASE("tile view reads the layers of a buffer it does not own")
+{
+    std::shared_ptr<const std::string> buffer = build_tile_buffer();
+    mapnik::vector_tile_impl::tile_view view(buffer);
+
+    CHECK(view.data() == buffer->data());
+    CHECK(view.size() == buffer->size());
+    CHECK(!view.is_empty());
+    REQUIRE(view.get_layers().size() == 2);
+    CHECK(view.get_layers()[0] == "water");
+    CHECK(view.get_layers()[1] == "roads");
+    CHECK(view.has_layer("roads"));
+    CHECK(!view.has_layer("buildings"));
+
+    protozero::pbf_reader layer_msg;
+    CHECK(view.layer_reader("roads", layer_msg));
+    CHECK(layer_msg.next(mapnik::vector_tile_impl::Layer_Encoding::NAME));
+    CHECK(layer_msg.get_string() == "roads");
+    CHECK(view.layer_reader(0, layer_msg));
+    CHECK(layer_msg.next(mapnik::vector_tile_impl::Layer_Encoding::NAME));
+    CHECK(layer_msg.get_string() == "water");
+    CHECK(!view.layer_reader("buildings", layer_msg));
+    CHECK(!view.layer_reader(2, layer_msg));
+
+    std::size_t count = 0;
+    protozero::pbf_reader tile_msg = view.get_reader();
+    while (tile_msg.next(mapnik::vector_tile_impl::Tile_Encoding::LAYERS))
+    {
+        tile_msg.skip();
+        ++count;
+    }
+    CHECK(count == 2);
+}
+
+TEST_CASE("tile view of an empty buffer")
+{
+    auto buffer = std::make_shared<const std::string>();
+    mapnik::vector_tile_impl::tile_view view(buffer);
+    CHECK(view.is_empty());
+    CHECK(view.get_layers().empty());
+    protozero::pbf_reader layer_msg;
+    CHECK(!view.layer_reader("water", layer_msg));
+}
+
+TEST_CASE("datasource keeps the buffer of a tile view alive")
+{
+    std::unique_ptr<mapnik::vector_tile_impl::tile_datasource_pbf> ds;
+    {
+        mapnik::vector_tile_impl::tile_view view(build_tile_buffer());
+        protozero::pbf_reader layer_msg;
+        REQUIRE(view.layer_reader("water", layer_msg));
+        ds.reset(new mapnik::vector_tile_impl::tile_datasource_pbf(layer_msg, 0, 0, 0, view.owner()));
+    }
+    CHECK(ds->get_name() == "water");
+    mapnik::query q(ds->get_tile_extent());
+    mapnik::featureset_ptr featureset = ds->features(q);
+    REQUIRE(featureset);
+    mapnik::feature_ptr feature = featureset->next();
+    REQUIRE(feature);
+    std::string wkt0;
+    mapnik::util::to_wkt(wkt0, feature->get_geometry());
+    CHECK(wkt0 == "POINT(-19988588.6446867 19988588.6446867)");
+}